@@ -2,6 +2,11 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "driver/gpio.h"
+#include "esp_timer.h"
+#include "esp_rom_sys.h"
 #include "i2c_bus.h"
 #include "board.h"
 
@@ -11,8 +16,56 @@ static i2c_bus_handle_t i2c_handle;
 
 static int i2c_addr = (0x28 << 1) | I2C_MASTER_WRITE;
 
+#define RC522_IRQ_TIMEOUT_MS 50 // the reader timer (0x2A..0x2D) expires after ~15ms without a card
+#define RC522_POLL_INTERVAL_US 250 // keep the bus free for the codec between status reads
+#define RC522_TRANSCEIVE_TIMEOUT_US 25000
+#define RC522_CRC_TIMEOUT_US 5000
+
+static uint32_t transactions = 0;
+
+// configuration/control registers only the driver writes: ComIEn, DivIEn, BitFraming, Mode, TxMode, RxMode,
+// TxControl, TxASK, ModWidth, RFCfg and the timer settings (status and FIFO registers are never cached)
+#define RC522_CACHEABLE ((1ULL << 0x02) | (1ULL << 0x03) | (1ULL << 0x0D) | (1ULL << 0x11) | (1ULL << 0x12) \
+                       | (1ULL << 0x13) | (1ULL << 0x14) | (1ULL << 0x15) | (1ULL << 0x24) | (1ULL << 0x26) \
+                       | (1ULL << 0x2A) | (1ULL << 0x2B) | (1ULL << 0x2C) | (1ULL << 0x2D))
+
+static bool cache_enabled = false;
+static uint64_t cache_valid = 0;
+static uint8_t cache[0x40];
+
+static gpio_num_t irq_gpio = GPIO_NUM_NC;
+static SemaphoreHandle_t irq_sem = NULL;
+
+static void IRAM_ATTR rc522_irq_handler(void *arg) {
+    BaseType_t woken = pdFALSE;
+    xSemaphoreGiveFromISR(irq_sem, &woken);
+    if (woken == pdTRUE) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+static bool rc522_cached(uint8_t reg) {
+    return cache_enabled && reg < 0x40 && (RC522_CACHEABLE & (1ULL << reg));
+}
+
 esp_err_t rc522_write_n(uint8_t reg, uint8_t n, uint8_t *data) {
-    return i2c_bus_write_bytes(i2c_handle, i2c_addr, &reg, sizeof(reg), data, n);
+    transactions++;
+    esp_err_t ret = i2c_bus_write_bytes(i2c_handle, i2c_addr, &reg, sizeof(reg), data, n);
+    if (rc522_cached(reg)) { // write-through, the register holds the last byte
+        if (ret == ESP_OK && n > 0) {
+            cache[reg] = data[n - 1];
+            cache_valid |= 1ULL << reg;
+        } else {
+            cache_valid &= ~(1ULL << reg);
+        }
+    }
+    return ret;
+}
+
+/* Reads n bytes from the same register in one transaction (the RC522 does not auto-increment over I2C, used for the FIFO) */
+esp_err_t rc522_read_n(uint8_t reg, uint8_t n, uint8_t *data) {
+    transactions++;
+    return i2c_bus_read_bytes(i2c_handle, i2c_addr, &reg, sizeof(reg), data, n);
 }
 
 esp_err_t rc522_write(uint8_t reg, uint8_t val) {
@@ -21,10 +74,42 @@ esp_err_t rc522_write(uint8_t reg, uint8_t val) {
 
 uint8_t rc522_read(uint8_t reg) {
     uint8_t data = 0xFF;
-    ESP_ERROR_CHECK(i2c_bus_read_bytes(i2c_handle, i2c_addr, &reg, sizeof(reg), &data, 1));
+    if (rc522_cached(reg) && (cache_valid & (1ULL << reg))) {
+        return cache[reg];
+    }
+    ESP_ERROR_CHECK(rc522_read_n(reg, 1, &data));
+    if (rc522_cached(reg)) {
+        cache[reg] = data;
+        cache_valid |= 1ULL << reg;
+    }
     return data;
 }
 
+void rc522_enable_cache(bool enable) {
+    cache_enabled = enable;
+    cache_valid = 0;
+}
+
+uint32_t rc522_transactions() {
+    return transactions;
+}
+
+/* Polls reg until one of the mask bits is set, returns false on timeout */
+static bool rc522_poll(uint8_t reg, uint8_t mask, uint8_t *val, int64_t timeout_us) {
+    int64_t deadline = esp_timer_get_time() + timeout_us;
+
+    for(;;) {
+        *val = rc522_read(reg);
+        if (*val & mask) {
+            return true;
+        }
+        if (esp_timer_get_time() >= deadline) {
+            return false;
+        }
+        esp_rom_delay_us(RC522_POLL_INTERVAL_US);
+    }
+}
+
 esp_err_t rc522_set_bitmask(uint8_t reg, uint8_t mask) {
     return rc522_write(reg, rc522_read(reg) | mask);
 }
@@ -113,17 +198,64 @@ esp_err_t rc522_init() {
     return ret;
 }
 
+esp_err_t rc522_enable_irq(gpio_num_t gpio) {
+    esp_err_t ret = ESP_OK;
+
+    if (irq_sem == NULL) {
+        irq_sem = xSemaphoreCreateBinary();
+        if (irq_sem == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    gpio_config_t io_cfg = {
+        .pin_bit_mask = 1ULL << gpio,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_NEGEDGE, // ComIEnReg IRqInv is set, IRQ is active low
+    };
+    ret = gpio_config(&io_cfg);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    ret = gpio_install_isr_service(0);
+    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) { // ESP_ERR_INVALID_STATE: already installed by the button peripheral
+        return ret;
+    }
+    ret = gpio_isr_handler_add(gpio, rc522_irq_handler, NULL);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    ret = rc522_write(0x03, 0x80); // DivIEnReg: IRQ pin push-pull
+    if (ret != ESP_OK) {
+        gpio_isr_handler_remove(gpio);
+        return ret;
+    }
+
+    irq_gpio = gpio;
+    return ret;
+}
+
 esp_err_t rc522_clear() {
+    if (irq_gpio != GPIO_NUM_NC) {
+        gpio_isr_handler_remove(irq_gpio);
+        irq_gpio = GPIO_NUM_NC;
+    }
+    rc522_enable_cache(false);
     return i2c_bus_delete(i2c_handle);
 }
 
-uint8_t* rc522_card_write(uint8_t cmd, uint8_t *data, uint8_t n, uint8_t* res_n) {
-    uint8_t *result = NULL;
+esp_err_t rc522_transceive(uint8_t cmd, uint8_t *data, uint8_t n, uint8_t *res, uint8_t res_size, uint8_t *res_n) {
     uint8_t irq = 0x00;
     uint8_t irq_wait = 0x00;
     uint8_t last_bits = 0;
     uint8_t nn = 0;
-    
+
+    *res_n = 0;
+
     if(cmd == 0x0E) {
         irq = 0x12;
         irq_wait = 0x10;
@@ -133,9 +265,17 @@ uint8_t* rc522_card_write(uint8_t cmd, uint8_t *data, uint8_t n, uint8_t* res_n)
         irq_wait = 0x30;
     }
 
-    rc522_write(0x02, irq | 0x80);
-    rc522_clear_bitmask(0x04, 0x80);
-    rc522_set_bitmask(0x0A, 0x80);
+    if (irq_gpio != GPIO_NUM_NC) {
+        // only completion, error and timer raise the pin (LoAlert would fire right away)
+        rc522_write(0x02, (irq_wait | 0x03) | 0x80);
+    } else {
+        rc522_write(0x02, irq | 0x80);
+    }
+    rc522_write(0x04, 0x7F); // Set1=0 clears all marked IRQ bits, no read needed
+    if (irq_gpio != GPIO_NUM_NC) {
+        xSemaphoreTake(irq_sem, 0); // drop a stale edge from the previous command
+    }
+    rc522_write(0x0A, 0x80); // FlushBuffer, the other bits are read-only
     rc522_write(0x01, 0x00);
 
     rc522_write_n(0x09, n, data);
@@ -146,68 +286,82 @@ uint8_t* rc522_card_write(uint8_t cmd, uint8_t *data, uint8_t n, uint8_t* res_n)
         rc522_set_bitmask(0x0D, 0x80);
     }
 
-    uint16_t i = 1000;
-
-    for(;;) {
+    // with IRQ wired a single ComIrqReg read follows the edge, otherwise (or on a missed edge) we poll
+    bool done;
+    if (irq_gpio != GPIO_NUM_NC && xSemaphoreTake(irq_sem, RC522_IRQ_TIMEOUT_MS / portTICK_PERIOD_MS) == pdTRUE) {
         nn = rc522_read(0x04);
-        i--;
-
-        if(! (i != 0 && (((nn & 0x01) == 0) && ((nn & irq_wait) == 0)))) {
-            break;
-        }
+        done = true;
+    } else {
+        done = rc522_poll(0x04, 0x01 | irq_wait, &nn, RC522_TRANSCEIVE_TIMEOUT_US);
     }
 
     rc522_clear_bitmask(0x0D, 0x80);
 
-    if(i != 0) {
-        if((rc522_read(0x06) & 0x1B) == 0x00) {
-            if(cmd == 0x0C) {
-                nn = rc522_read(0x0A);
-                last_bits = rc522_read(0x0C) & 0x07;
-
-                if (last_bits != 0) {
-                    *res_n = (nn - 1) + last_bits;
-                } else {
-                    *res_n = nn;
-                }
+    if(! done) {
+        return ESP_ERR_TIMEOUT;
+    }
+    if((rc522_read(0x06) & 0x1B) != 0x00) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
 
-                result = (uint8_t*) malloc(*res_n);
+    if(cmd == 0x0C) {
+        nn = rc522_read(0x0A);
+        last_bits = rc522_read(0x0C) & 0x07;
 
-                for(i = 0; i < *res_n; i++) {
-                    result[i] = rc522_read(0x09);
-                }
+        if (last_bits != 0) {
+            nn = (nn - 1) + last_bits;
+        }
+        if (nn > res_size) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        if (nn > 0) {
+            esp_err_t ret = rc522_read_n(0x09, nn, res);
+            if (ret != ESP_OK) {
+                return ret;
             }
         }
+        *res_n = nn;
+    }
+
+    return ESP_OK;
+}
+
+uint8_t* rc522_card_write(uint8_t cmd, uint8_t *data, uint8_t n, uint8_t* res_n) {
+    uint8_t buf[RC522_FIFO_SIZE];
+    uint8_t *result = NULL;
+
+    if (rc522_transceive(cmd, data, n, buf, sizeof(buf), res_n) == ESP_OK && cmd == 0x0C) {
+        result = (uint8_t*) malloc(*res_n);
+        memcpy(result, buf, *res_n);
     }
 
     return result;
 }
 
-/* Returns pointer to dynamically allocated array of two element */
-uint8_t* rc522_calculate_crc(uint8_t *data, uint8_t n) {
-    rc522_clear_bitmask(0x05, 0x04);
-    rc522_set_bitmask(0x0A, 0x80);
+esp_err_t rc522_crc(uint8_t *data, uint8_t n, uint8_t *crc) {
+    rc522_write(0x05, 0x04); // Set2=0 clears CRCIRq
+    rc522_write(0x0A, 0x80);
 
     rc522_write_n(0x09, n, data);
 
     rc522_write(0x01, 0x03);
 
-    uint8_t i = 255;
     uint8_t nn = 0;
+    if (! rc522_poll(0x05, 0x04, &nn, RC522_CRC_TIMEOUT_US)) {
+        return ESP_ERR_TIMEOUT;
+    }
 
-    for(;;) {
-        nn = rc522_read(0x05);
-        i--;
+    crc[0] = rc522_read(0x22);
+    crc[1] = rc522_read(0x21);
 
-        if(! (i != 0 && ! (nn & 0x04))) {
-            break;
-        }
-    }
+    return ESP_OK;
+}
 
-    uint8_t* res = (uint8_t*) malloc(2); 
-    
-    res[0] = rc522_read(0x22);
-    res[1] = rc522_read(0x21);
+/* Returns pointer to dynamically allocated array of two element */
+uint8_t* rc522_calculate_crc(uint8_t *data, uint8_t n) {
+    uint8_t* res = (uint8_t*) malloc(2);
+
+    rc522_crc(data, n, res);
 
     return res;
 }
@@ -244,35 +398,93 @@ uint8_t* rc522_anticoll() {
     return result;
 }
 
-uint8_t* rc522_get_tag() {
-    uint8_t* result = NULL;
-    uint8_t* res_data = NULL;
-    uint8_t res_data_n;
+/* Sends REQA (0x26) or WUPA (0x52), ESP_OK if a tag answered with an ATQA */
+static esp_err_t rc522_request_mode(uint8_t req_mode) {
+    uint8_t buf[RC522_FIFO_SIZE];
+    uint8_t n;
 
-    res_data = rc522_request(&res_data_n);
+    rc522_write(0x0D, 0x07);
+    esp_err_t ret = rc522_transceive(0x0C, &req_mode, 1, buf, sizeof(buf), &n);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (n * 8 != 0x10) {
+        return ESP_ERR_NOT_FOUND;
+    }
 
-    if(res_data != NULL) {
-        free(res_data);
+    return ESP_OK;
+}
 
-        result = rc522_anticoll(&res_data_n);
+esp_err_t rc522_is_present(rc522_uid_t *uid) {
+    esp_err_t ret = rc522_request_mode(0x52); // WUPA, answered in IDLE and HALT state
+    if (ret != ESP_OK) {
+        return ret;
+    }
 
-        if(result != NULL) {
-            uint8_t buf[] = { 0x50, 0x00, 0x00, 0x00 };
-            uint8_t* crc = rc522_calculate_crc(buf, 2);
+    // CL1 anticollision, so a figure swapped between two polls is not taken for the one read before
+    uint8_t buf[RC522_FIFO_SIZE];
+    uint8_t n;
+    uint8_t serial_number[] = { 0x93, 0x20 };
+    rc522_write(0x0D, 0x00);
+    ret = rc522_transceive(0x0C, serial_number, 2, buf, sizeof(buf), &n);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (n != RC522_UID_SIZE) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    memcpy(uid->bytes, buf, RC522_UID_SIZE);
 
-            buf[2] = crc[0];
-            buf[3] = crc[1];
+    // the tag is READY now and would ignore the next WUPA, any further frame sends it back
+    // to IDLE without a select (HLTA here, CRC_A of 50 00 is always 57 CD)
+    uint8_t halt[] = { 0x50, 0x00, 0x57, 0xCD };
+    rc522_transceive(0x0C, halt, 4, buf, sizeof(buf), &n);
 
-            free(crc);
+    return ESP_OK;
+}
 
-            res_data = rc522_card_write(0x0C, buf, 4, &res_data_n);
-            free(res_data);
+esp_err_t rc522_read_tag(rc522_uid_t *uid) {
+    uint8_t buf[RC522_FIFO_SIZE];
+    uint8_t n;
+    esp_err_t ret;
 
-            rc522_clear_bitmask(0x08, 0x08);
+    ret = rc522_request_mode(0x26); // REQA
+    if (ret != ESP_OK) {
+        return ret;
+    }
 
-            return result;
-        }
+    // anticollision
+    rc522_write(0x0D, 0x00);
+    uint8_t serial_number[] = { 0x93, 0x20 };
+    ret = rc522_transceive(0x0C, serial_number, 2, buf, sizeof(buf), &n);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (n != RC522_UID_SIZE) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    memcpy(uid->bytes, buf, RC522_UID_SIZE);
+
+    // halt, the tag does not answer
+    uint8_t halt[] = { 0x50, 0x00, 0x00, 0x00 };
+    if (rc522_crc(halt, 2, &halt[2]) == ESP_OK) {
+        rc522_transceive(0x0C, halt, 4, buf, sizeof(buf), &n);
     }
 
-    return NULL;
+    rc522_clear_bitmask(0x08, 0x08);
+
+    return ESP_OK;
+}
+
+uint8_t* rc522_get_tag() {
+    rc522_uid_t uid;
+
+    if (rc522_read_tag(&uid) != ESP_OK) {
+        return NULL;
+    }
+
+    uint8_t* result = (uint8_t*) malloc(RC522_UID_SIZE);
+    memcpy(result, uid.bytes, RC522_UID_SIZE);
+
+    return result;
 }
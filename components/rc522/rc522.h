@@ -1,12 +1,27 @@
 #pragma once
 
+#include <stdbool.h>
+#include "esp_err.h"
+#include "driver/gpio.h"
+
+#define RC522_FIFO_SIZE 64
+#define RC522_UID_SIZE 5 // 4 byte UID + BCC as returned by anticollision
+
+typedef struct {
+    uint8_t bytes[RC522_UID_SIZE];
+} rc522_uid_t;
+
 esp_err_t rc522_write_n(uint8_t reg, uint8_t n, uint8_t *data);
 esp_err_t rc522_write(uint8_t reg, uint8_t val);
 
 uint8_t rc522_read(uint8_t reg);
+esp_err_t rc522_read_n(uint8_t reg, uint8_t n, uint8_t *data);
+uint32_t rc522_transactions(); // I2C transactions since boot, diff around a call to measure it
 #define rc522_fw_version() rc522_read(0x37)
 esp_err_t rc522_init();
 esp_err_t rc522_clear();
+esp_err_t rc522_enable_irq(gpio_num_t gpio); // wait for the IRQ pin instead of polling ComIrqReg
+void rc522_enable_cache(bool enable); // write-through shadow of configuration registers, call after rc522_init()
 
 esp_err_t rc522_set_bitmask(uint8_t reg, uint8_t mask);
 esp_err_t rc522_clear_bitmask(uint8_t reg, uint8_t mask);
@@ -16,3 +31,9 @@ uint8_t* rc522_card_write(uint8_t cmd, uint8_t *data, uint8_t n, uint8_t* res_n)
 uint8_t* rc522_request(uint8_t* res_n);
 uint8_t* rc522_anticoll();
 uint8_t* rc522_get_tag();
+
+// allocation free variants, results go to caller owned buffers
+esp_err_t rc522_transceive(uint8_t cmd, uint8_t *data, uint8_t n, uint8_t *res, uint8_t res_size, uint8_t *res_n);
+esp_err_t rc522_crc(uint8_t *data, uint8_t n, uint8_t *crc); // crc must hold 2 bytes
+esp_err_t rc522_read_tag(rc522_uid_t *uid); // ESP_ERR_NOT_FOUND if no tag is present
+esp_err_t rc522_is_present(rc522_uid_t *uid); // cheap check of the tag in the field (WUPA, CL1 anticollision and HALT, no CRC calculation)
@@ -0,0 +1,326 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+
+#include "rc522.h"
+#include "rfid_poll.h"
+#include "player.h"
+#include "player_action.h"
+#include "playlist.h"
+#include "position_store.h"
+#include "tag_catalog.h"
+#include "seek_index.h"
+#include "seek_scrub.h"
+#include "audio_engine.h"
+#include "boot.h"
+#include "trace.h"
+
+#include "sim.h"
+#include "rc522_sim.h"
+#include "nvs_sim.h"
+#include "heap_sim.h"
+#include "sdcard_sim.h"
+#include "audio_sim.h"
+#include "mp3_sim.h"
+
+/*
+ * Control path benchmark: replays tag place, remove, swap and seek sequences through rfid_poll, the player
+ * queue and state machine, the player actions, position_store and tag_catalog, on simulated time. The loop
+ * below plays rfid_task and sound_task; their waits are interleaved as the FreeRTOS scheduler would.
+ * "bench_control irq" runs with the RC522 IRQ pin wired. Reports per phase:
+ *   tag-to-play latency (the card enters the field -> audio_engine_play()), I2C transactions per poll,
+ *   NVS entries written, heap allocations and SD card path lookups.
+ */
+
+#define SOUND_TIMEOUT_MS 2000 // audio_event_iface_listen() of sound_task once the catalog is built
+#define TRACK_FRAMES 23000 // 10 minutes
+
+static const uint8_t uid_a[4] = {0x11, 0x22, 0x33, 0x44};
+static const uint8_t uid_b[4] = {0xa0, 0x5b, 0x7c, 0x01};
+static const uint8_t uid_c[4] = {0x42, 0x42, 0x42, 0x42}; // nothing on the card
+
+static rfid_poll_t poll;
+static int64_t rfid_due = 0;
+static bool rfid_running = true;
+
+static player_state_t state = PLAYER_IDLE;
+static int64_t sound_due = 0;
+static seek_index_t seek_index;
+static bool seekable = false;
+static seek_scrub_t scrub;
+static char playing_no[11];
+
+typedef struct {
+    const char *name;
+    int64_t latency_us; // -1 if nothing started
+    uint32_t polls;
+    uint32_t transactions;
+    uint32_t nvs_writes;
+    uint32_t allocations;
+    uint32_t sd_accesses;
+} phase_t;
+
+static phase_t phases[16];
+static int phase_count = 0;
+static phase_t start;
+
+static void tag_no(const uint8_t uid[4], char *no) {
+    sprintf(no, "%02x%02x%02x%02x%02x", uid[0], uid[1], uid[2], uid[3], uid[0] ^ uid[1] ^ uid[2] ^ uid[3]);
+}
+
+static void write_track(const uint8_t uid[4], int kbps) {
+    char path[32];
+    tag_no(uid, path + sprintf(path, "/sdcard/"));
+    strcat(path, ".mp3");
+    mp3_sim_write(path, TRACK_FRAMES, kbps, uid[0], NULL);
+}
+
+// what sound_task does with the tracks of the playlist once the decoder reports music info
+static void track_started() {
+    seekable = false;
+    if (!audio_sim_playing() || playlist_index(audio_sim()->uri) < 0 || !playlist_no(playing_no)) {
+        playing_no[0] = 0;
+        return;
+    }
+    seek_index_close(&seek_index);
+    seekable = seek_index_open(&seek_index, audio_sim()->uri) == ESP_OK;
+    if (seekable && seek_index.entries == 0) { // seek_index_build_async() in the firmware
+        seek_index_build(audio_sim()->uri);
+        seek_index_refresh(&seek_index);
+    }
+}
+
+// one pass of the sound_task loop: player events, scrub step, position and catalog bookkeeping
+static void sound_run() {
+    player_event_t event;
+    while (state != PLAYER_ASLEEP && player_receive(&event)) {
+        player_action_t action;
+        state = player_transition(state, event.type, &action);
+        switch (action) {
+            case PLAYER_ACTION_PLAY:
+            case PLAYER_ACTION_SWAP:
+            case PLAYER_ACTION_STOP:
+                seek_scrub_stop(&scrub);
+                if (playing_no[0] != 0) {
+                    player_save_position(playing_no, 0, &seek_index, seekable);
+                }
+                playing_no[0] = 0;
+                seekable = false;
+                if (action == PLAYER_ACTION_STOP) {
+                    player_stop();
+                } else {
+                    player_play(&event, action == PLAYER_ACTION_SWAP);
+                    track_started();
+                }
+                break;
+            case PLAYER_ACTION_SHUTDOWN:
+                seek_scrub_stop(&scrub);
+                player_shutdown();
+                state = player_transition(state, PLAYER_EVENT_EOF, &action); // the beep is not played out
+                break;
+            default:
+                break;
+        }
+    }
+    int timeout_ms = player_scrub_step(&seek_index, &scrub, SOUND_TIMEOUT_MS);
+    if (playing_no[0] != 0) {
+        player_save_position(playing_no, 0, &seek_index, seekable);
+    }
+    position_store_flush_if_due();
+    tag_catalog_flush();
+    sound_due = sim_now_us() + timeout_ms * 1000LL;
+}
+
+static void rfid_run() {
+    uint32_t posts = poll.stats.posts;
+    if (!rfid_poll(&poll)) {
+        player_event_t event = {.type = PLAYER_EVENT_SHUTDOWN, .posted_us = sim_now_us()};
+        player_post(&event);
+        rfid_running = false;
+    }
+    if (poll.stats.posts != posts || !rfid_running) { // the post wakes sound_task
+        sound_due = sim_now_us();
+    }
+    rfid_due = rfid_running ? sim_now_us() + poll.interval_ms * 1000LL : INT64_MAX;
+}
+
+static void run_until(int64_t until_us) {
+    while (state != PLAYER_ASLEEP) {
+        int64_t next = rfid_due < sound_due ? rfid_due : sound_due;
+        if (next > until_us) {
+            break;
+        }
+        if (next > sim_now_us()) {
+            sim_advance_us(next - sim_now_us());
+        }
+        if (rfid_due <= sound_due) {
+            rfid_run();
+        } else {
+            sound_run();
+        }
+    }
+    if (until_us > sim_now_us() && state != PLAYER_ASLEEP) {
+        sim_advance_us(until_us - sim_now_us());
+    }
+}
+
+static void run_for(int64_t ms) {
+    run_until(sim_now_us() + ms * 1000);
+}
+
+static void phase_begin() {
+    start.polls = poll.stats.polls;
+    start.transactions = poll.stats.transactions;
+    start.nvs_writes = nvs_sim_stats()->entry_writes;
+    start.allocations = heap_sim_allocations();
+    start.sd_accesses = sdcard_sim_accesses();
+}
+
+static phase_t *phase_end(const char *name, int64_t latency_us) {
+    phase_t *phase = &phases[phase_count++];
+    phase->name = name;
+    phase->latency_us = latency_us;
+    phase->polls = poll.stats.polls - start.polls;
+    phase->transactions = poll.stats.transactions - start.transactions;
+    phase->nvs_writes = nvs_sim_stats()->entry_writes - start.nvs_writes;
+    phase->allocations = heap_sim_allocations() - start.allocations;
+    phase->sd_accesses = sdcard_sim_accesses() - start.sd_accesses;
+    return phase;
+}
+
+// the card enters the field at a given phase of the poll cycle, latency until the pipeline runs
+static phase_t *place(const char *name, const uint8_t uid[4], int64_t offset_ms, int64_t hold_ms) {
+    run_for(offset_ms);
+    phase_begin();
+    uint32_t plays = audio_sim()->plays;
+    int64_t placed_us = sim_now_us();
+    rc522_sim_place(uid);
+    run_for(hold_ms);
+    return phase_end(name, audio_sim()->plays != plays ? audio_sim()->play_us - placed_us : -1);
+}
+
+static phase_t *remove_tag(const char *name, int64_t hold_ms) {
+    phase_begin();
+    uint32_t stops = audio_sim()->stops;
+    int64_t removed_us = sim_now_us();
+    rc522_sim_remove();
+    run_for(hold_ms);
+    return phase_end(name, audio_sim()->stops != stops ? audio_sim()->stop_us - removed_us : -1);
+}
+
+// a seek button held for held_ms, sound_task steps the scrub until the release
+static phase_t *hold(const char *name, int direction, int64_t held_ms) {
+    phase_begin();
+    player_scrub_start(&seek_index, &scrub, seekable, direction, false);
+    sound_due = sim_now_us();
+    run_for(held_ms);
+    player_scrub_release(&seek_index, &scrub, false);
+    return phase_end(name, -1);
+}
+
+static void report(const char *mode) {
+    printf("\ncontrol path, RC522 %s\n", mode);
+    printf("%-28s %12s %7s %10s %11s %11s %11s\n", "phase", "latency ms", "polls", "I2C/poll", "NVS writes",
+            "heap allocs", "SD lookups");
+    for (int i = 0; i < phase_count; i++) {
+        phase_t *phase = &phases[i];
+        char latency[16] = "-";
+        if (phase->latency_us >= 0) {
+            snprintf(latency, sizeof(latency), "%.1f", phase->latency_us / 1000.0);
+        }
+        printf("%-28s %12s %7" PRIu32 " %10.1f %11" PRIu32 " %11" PRIu32 " %11" PRIu32 "\n", phase->name, latency,
+                phase->polls, phase->polls > 0 ? (double) phase->transactions / phase->polls : 0.0,
+                phase->nvs_writes, phase->allocations, phase->sd_accesses);
+    }
+    const nvs_sim_stats_t *nvs = nvs_sim_stats();
+    printf("total: %" PRIu32 " polls, %.1f I2C transactions/poll, %" PRIu32 " position writes, %" PRIu32
+            " NVS entries written, %" PRIu32 " page erases, %.1f s simulated\n",
+            poll.stats.polls, (double) poll.stats.transactions / poll.stats.polls, position_store_writes(),
+            nvs->entry_writes, nvs->page_erases, sim_now_us() / 1e6);
+}
+
+int main(int argc, char **argv) {
+    bool irq = argc > 1 && strcmp(argv[1], "irq") == 0;
+
+    sim_reset();
+    rc522_sim_reset();
+    nvs_sim_reset();
+    audio_sim_reset();
+    sdcard_sim_init();
+    write_track(uid_a, 128);
+    write_track(uid_b, 0);
+    mp3_sim_write("/sdcard/system_not_found.mp3", 40, 128, 1, NULL);
+    mp3_sim_write("/sdcard/system_beep.mp3", 20, 128, 1, NULL);
+
+    // app_main and the init phases of both tasks, the catalog is built before the first tag here
+    CHECK_EQ(position_store_init(), ESP_OK);
+    CHECK_EQ(playlist_init(), ESP_OK);
+    trace_init();
+    boot_init();
+    player_init();
+    CHECK_EQ(rc522_init(), ESP_OK);
+    rc522_enable_cache(true);
+    if (irq) {
+        rc522_sim_wire_irq(GPIO_NUM_22);
+        CHECK_EQ(rc522_enable_irq(GPIO_NUM_22), ESP_OK);
+    }
+    CHECK_EQ(tag_catalog_init(), ESP_OK);
+    rfid_poll_init(&poll);
+    rfid_due = sound_due = sim_now_us();
+    run_for(1000);
+
+    char no_a[11];
+    char no_b[11];
+    tag_no(uid_a, no_a);
+    tag_no(uid_b, no_b);
+
+    phase_t *phase = place("place A, cold", uid_a, 0, 3000);
+    CHECK(phase->latency_us > 0);
+    CHECK(strstr(audio_sim()->uri, no_a) != NULL);
+    run_for(30000);
+    hold("fast-forward held 8 s", 1, 8000);
+    run_for(20000);
+    hold("rewind held 4 s", -1, 4000);
+    run_for(10000);
+    phase = remove_tag("remove A", 3000);
+    CHECK(phase->latency_us > 0);
+    CHECK(!audio_sim_playing());
+
+    place("place A, resume", uid_a, 333, 3000);
+    CHECK(audio_sim()->start_pos > PLAYER_POSITION_MIN_BYTES);
+    run_for(10000); // the swap within the periodic flush interval after the removal
+    int64_t a_ms = seek_index_time(&seek_index, audio_engine_position());
+    uint32_t writes = position_store_writes();
+    phase = place("swap A -> B", uid_b, 77, 1000);
+    CHECK(phase->latency_us > 0);
+    CHECK(strstr(audio_sim()->uri, no_b) != NULL);
+    int64_t stored;
+    CHECK(position_store_get(no_a, &stored)); // where A was swapped out, flushed with the swap
+    CHECK(POSITION_MS(stored) >= a_ms && POSITION_MS(stored) < a_ms + 1000);
+    CHECK(position_store_writes() > writes);
+    run_for(5000);
+    run_for(15000);
+    place("swap B -> unknown", uid_c, 500, 6000);
+    CHECK(strstr(audio_sim()->uri, "system_not_found") != NULL);
+    place("swap unknown -> B", uid_b, 120, 6000);
+    CHECK(strstr(audio_sim()->uri, no_b) != NULL);
+
+    phase_begin();
+    run_for(10 * 60 * 1000);
+    phase = phase_end("B steady, 10 min", -1);
+    CHECK_EQ(phase->allocations, 0);
+    remove_tag("remove B", 3000);
+
+    phase_begin();
+    run_for(11 * 60 * 1000);
+    phase_end("no tag until shutdown", -1);
+    CHECK_EQ(state, PLAYER_ASLEEP);
+    position_store_flush();
+
+    report(irq ? "IRQ pin wired" : "polling ComIrq");
+    return sim_failures() != 0;
+}
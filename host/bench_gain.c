@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "hal/cpu_hal.h"
+
+#include "gain_filter.h"
+
+#include "sim.h"
+#include "audio_element_sim.h"
+
+/*
+ * gain_filter kernel on synthetic programme material: cycles per sample of the Q14 gain and limiter path,
+ * the loudness it settles at and the peaks it lets through. Host cycles are TSC ticks, the element logs the
+ * ESP32 cycle count on the target. A tagged track gain replaces the loudness estimate, a volume step is ramped in
+ * within one block, without a jump in the output, and PCM other than 16 bit passes unchanged.
+ */
+
+#define RATE 44100
+#define SECONDS 20
+#define SAMPLES (RATE * 2 * SECONDS) // stereo
+#define SETTLE_SECONDS 10 // loudness is measured over the rest
+#define LIMIT 29205 // GAIN_FILTER_LIMIT_DBFS
+#define RAMP_LEVEL 4125 // -18 dBFS DC, normalised at unity
+#define RAMP_SAMPLES 512 // GAIN_FILTER_BLOCK_BYTES
+#define RAMP_VOLUME_DB (-12)
+#define TRACK_GAIN (-1000) // 1/100 dB, below GAIN_FILTER_MIN_DB
+
+typedef struct {
+    const char *name;
+    float rms_dbfs; // of the bursts
+    float crest; // peak / rms of the bursts
+    int pause_ms; // silence between 2 s bursts
+} programme_t;
+
+static const programme_t programmes[] = {
+    {"quiet speech", -26, 4, 400},
+    {"nominal", -18, 4, 0},
+    {"loud master", -8, 1.6, 0},
+    {"peaky drums", -20, 16, 100},
+};
+#define PROGRAMME_COUNT (sizeof(programmes) / sizeof(programmes[0]))
+
+static int16_t in[SAMPLES];
+static int16_t out[SAMPLES];
+
+static uint32_t noise_state = 1;
+
+static float noise() { // uniform in -1..1
+    noise_state ^= noise_state << 13;
+    noise_state ^= noise_state >> 17;
+    noise_state ^= noise_state << 5;
+    return (float) noise_state / 2147483648.0f - 1.0f;
+}
+
+static void programme_write(const programme_t *p) {
+    float rms = 32768.0f * powf(10.0f, p->rms_dbfs / 20.0f);
+    int burst = 2 * RATE;
+    int period = burst + p->pause_ms * RATE / 1000;
+    for (int i = 0; i < SAMPLES / 2; i++) {
+        float s = 0;
+        if (i % period < burst) {
+            s = noise() * rms * sqrtf(3.0f); // uniform noise, crest factor 1.7
+            if (i % (RATE / 8) == 0) {
+                s = (noise() > 0 ? 1 : -1) * rms * p->crest; // a transient every 125 ms
+            }
+        }
+        s = s > INT16_MAX ? INT16_MAX : s < INT16_MIN ? INT16_MIN : s;
+        in[i * 2] = (int16_t) s;
+        in[i * 2 + 1] = (int16_t) s;
+    }
+}
+
+static float rms_dbfs(const int16_t *pcm, int n) {
+    double energy = 0;
+    int counted = 0;
+    for (int i = 0; i < n; i++) {
+        if (pcm[i] != 0) { // pauses do not count
+            energy += (double) pcm[i] * pcm[i];
+            counted++;
+        }
+    }
+    return counted > 0 ? 10 * log10(energy / counted) - 20 * log10(32768.0) : -INFINITY;
+}
+
+int main() {
+    gain_filter_cfg_t cfg = GAIN_FILTER_CFG_DEFAULT();
+    audio_element_handle_t gain = gain_filter_init(&cfg);
+    CHECK(gain != NULL);
+
+    printf("%-14s %9s %10s %10s %10s %12s %10s\n", "programme", "in rms", "out rms", "in peak", "out peak",
+            "cycles/smp", "ns/smp");
+    for (int i = 0; i < PROGRAMME_COUNT; i++) {
+        const programme_t *p = &programmes[i];
+        programme_write(p);
+        gain_filter_reset(gain, GAIN_FILTER_TRACK_GAIN_NONE);
+        audio_element_sim_open(gain);
+
+        struct timespec t0;
+        struct timespec t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        uint32_t start = cpu_hal_get_cycle_count();
+        int n = audio_element_sim_process(gain, in, out, sizeof(in)) / sizeof(int16_t);
+        uint32_t cycles = cpu_hal_get_cycle_count() - start;
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        audio_element_sim_close(gain);
+        CHECK_EQ(n, SAMPLES);
+
+        int in_peak = 0;
+        int out_peak = 0;
+        for (int j = 0; j < SAMPLES; j++) {
+            in_peak = abs(in[j]) > in_peak ? abs(in[j]) : in_peak;
+            out_peak = abs(out[j]) > out_peak ? abs(out[j]) : out_peak;
+        }
+        int settled = RATE * 2 * SETTLE_SECONDS;
+        float in_rms = rms_dbfs(in + settled, SAMPLES - settled);
+        float out_rms = rms_dbfs(out + settled, SAMPLES - settled);
+        double ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+        printf("%-14s %5.1f dBFS %6.1f dBFS %10d %10d %12.2f %10.2f\n", p->name, in_rms, out_rms, in_peak, out_peak,
+                (double) cycles / SAMPLES, ns / SAMPLES);
+
+        CHECK(out_peak <= LIMIT); // the limiter attacks within the block
+        float expected = in_rms + fminf(fmaxf(GAIN_FILTER_TARGET_DBFS - in_rms, GAIN_FILTER_MIN_DB), GAIN_FILTER_MAX_DB);
+        if (p->crest * powf(10.0f, expected / 20.0f) < 0.89f) { // the limiter does not hold it down
+            CHECK(fabsf(out_rms - expected) < 1.5f);
+        } else {
+            CHECK(out_rms < expected + 0.5f);
+        }
+    }
+    // tagged file: its gain, not the running estimate
+    programme_write(&programmes[1]);
+    gain_filter_reset(gain, TRACK_GAIN);
+    audio_element_sim_open(gain);
+    audio_element_sim_process(gain, in, out, sizeof(in));
+    audio_element_sim_close(gain);
+    int settled = RATE * 2 * SETTLE_SECONDS;
+    float tagged = rms_dbfs(out + settled, SAMPLES - settled) - rms_dbfs(in + settled, SAMPLES - settled);
+    printf("track gain %.1f dB: %.1f dB\n", TRACK_GAIN / 100.0f, tagged);
+    CHECK(fabsf(tagged - TRACK_GAIN / 100.0f) < 0.1f);
+
+    // 24 bit output of a decoder passes unchanged
+    gain_filter_reset(gain, GAIN_FILTER_TRACK_GAIN_NONE);
+    gain_filter_set_bits(gain, 24);
+    audio_element_sim_open(gain);
+    audio_element_sim_process(gain, in, out, sizeof(in));
+    audio_element_sim_close(gain);
+    gain_filter_set_bits(gain, 16);
+    CHECK_EQ(memcmp(in, out, sizeof(in)), 0);
+
+    // volume step in the middle of steady input
+    for (int j = 0; j < SAMPLES; j++) {
+        in[j] = RAMP_LEVEL;
+    }
+    gain_filter_reset(gain, GAIN_FILTER_TRACK_GAIN_NONE);
+    audio_element_sim_open(gain);
+    int half = audio_element_sim_process(gain, in, out, sizeof(in) / 2) / sizeof(int16_t);
+    gain_filter_set_volume(gain, gain_filter_q14(RAMP_VOLUME_DB));
+    audio_element_sim_process(gain, in + half, out + half, sizeof(in) / 2);
+    audio_element_sim_close(gain);
+    gain_filter_set_volume(gain, gain_filter_q14(0));
+    int jump = 0;
+    for (int j = 1; j < SAMPLES; j++) {
+        jump = abs(out[j] - out[j - 1]) > jump ? abs(out[j] - out[j - 1]) : jump;
+    }
+    int quiet = (int) (RAMP_LEVEL * powf(10.0f, RAMP_VOLUME_DB / 20.0f));
+    printf("volume %d dB: %d -> %d within %d samples, largest step %d\n", RAMP_VOLUME_DB, out[half - 1],
+            out[half + RAMP_SAMPLES], RAMP_SAMPLES, jump);
+    CHECK(abs(out[half - 1] - RAMP_LEVEL) <= 2);
+    CHECK(abs(out[half + RAMP_SAMPLES] - quiet) <= 2);
+    CHECK(abs(out[SAMPLES - 1] - quiet) <= 2);
+    CHECK(jump <= 2 * (RAMP_LEVEL - quiet) / RAMP_SAMPLES + 1); // linear across the block
+
+    audio_element_deinit(gain);
+    return sim_failures() != 0;
+}
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+
+#include "seek_index.h"
+
+#include "sim.h"
+#include "sdcard_sim.h"
+#include "mp3_sim.h"
+
+/*
+ * seek_index on a corpus of CBR and VBR files: simulated build time on the card, index size, and how far
+ * a seek lands from the requested time with the bitrate estimate and with the index, and what a seek costs.
+ * The way back, the time of a byte position, is looked up on every pass of sound_task and must not touch the card.
+ */
+
+#define SEEKS 500
+#define FRAME_MS 27 // 1152 samples at 44.1 kHz, rounded up
+#define SEEK_INDEX_SCAN_SIZE 2048 // header search window of seek_index.c
+
+typedef struct {
+    const char *name;
+    int minutes;
+    int kbps; // 0 for VBR
+} corpus_file_t;
+
+static const corpus_file_t corpus[] = {
+    {"song 128k", 3, 128},
+    {"chapter 128k", 20, 128},
+    {"album 320k", 10, 320},
+    {"speech 64k", 10, 64},
+    {"song vbr", 3, 0},
+    {"chapter vbr", 20, 0},
+};
+#define CORPUS_COUNT (sizeof(corpus) / sizeof(corpus[0]))
+
+typedef struct {
+    int64_t max_error_ms;
+    uint32_t misaligned; // offsets that are no frame start
+    int64_t seek_us; // mean simulated time of seek_index_offset
+    int64_t max_time_error_ms; // of seek_index_time
+    uint32_t time_accesses; // SD card lookups of seek_index_time
+} seek_result_t;
+
+static uint32_t frame_at(const uint32_t *offsets, uint32_t frames, int64_t offset) {
+    uint32_t lo = 0;
+    uint32_t hi = frames;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (offsets[mid] < offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static seek_result_t seek_corpus(seek_index_t *index, const uint32_t *offsets, uint32_t frames) {
+    seek_result_t result = {0};
+    int64_t duration_ms = mp3_sim_frame_ms(frames);
+    srand(frames);
+    for (int i = 0; i < SEEKS; i++) {
+        int64_t ms = (int64_t) rand() * (duration_ms - 1000) / RAND_MAX;
+        int64_t start = sim_now_us();
+        int64_t offset = seek_index_offset(index, ms);
+        result.seek_us += (sim_now_us() - start) / SEEKS;
+        uint32_t frame = frame_at(offsets, frames, offset);
+        if (offsets[frame] != offset) {
+            result.misaligned++;
+        }
+        int64_t error_ms = llabs(mp3_sim_frame_ms(frame) - ms);
+        result.max_error_ms = error_ms > result.max_error_ms ? error_ms : result.max_error_ms;
+
+        // and back: the time of a frame start, as sound_task saves positions
+        uint32_t accesses = sdcard_sim_accesses();
+        error_ms = llabs(seek_index_time(index, offsets[frame]) - mp3_sim_frame_ms(frame));
+        result.time_accesses += sdcard_sim_accesses() - accesses;
+        result.max_time_error_ms = error_ms > result.max_time_error_ms ? error_ms : result.max_time_error_ms;
+    }
+    return result;
+}
+
+int main() {
+    sim_reset();
+    sdcard_sim_init();
+    printf("%-14s %9s %10s %9s %9s %13s %10s %13s %10s %13s\n", "file", "size", "build", "index", "per hour",
+            "estimate err", "seek", "index err", "seek", "time err");
+    for (int i = 0; i < CORPUS_COUNT; i++) {
+        const corpus_file_t *file = &corpus[i];
+        uint32_t frames = (uint32_t) ((int64_t) file->minutes * 60 * 44100 / MP3_SIM_FRAME_SAMPLES);
+        uint32_t *offsets = malloc((frames + 1) * sizeof(uint32_t));
+        char path[32];
+        sprintf(path, "/sdcard/%d.mp3", i);
+        uint32_t size = mp3_sim_write(path, frames, file->kbps, i + 1, offsets);
+
+        seek_index_t index;
+        CHECK_EQ(seek_index_open(&index, path), ESP_OK);
+        CHECK_EQ(index.entries, 0);
+        seek_result_t estimate = seek_corpus(&index, offsets, frames);
+
+        int64_t start = sim_now_us();
+        uint64_t read = sdcard_sim_bytes_read();
+        CHECK_EQ(seek_index_build(path), ESP_OK);
+        int64_t build_ms = (sim_now_us() - start) / 1000;
+        read = sdcard_sim_bytes_read() - read;
+        CHECK(seek_index_refresh(&index));
+        struct stat st;
+        sprintf(path, "/sdcard/%d.idx", i);
+        CHECK_EQ(stat(path, &st), 0);
+        seek_result_t indexed = seek_corpus(&index, offsets, frames);
+
+        printf("%-14s %6.1f MB %7" PRId64 " ms %7ld B %7ld B %10" PRId64 " ms %7.1f ms %10" PRId64 " ms %7.1f ms %10" PRId64
+                " ms\n", file->name, size / 1048576.0, build_ms, (long) st.st_size, (long) (st.st_size * 60 / file->minutes),
+                estimate.max_error_ms, estimate.seek_us / 1000.0, indexed.max_error_ms, indexed.seek_us / 1000.0,
+                indexed.max_time_error_ms);
+
+        CHECK(read <= size + SEEK_INDEX_SCAN_SIZE); // one pass over the frame headers
+        CHECK_EQ(index.entries, (mp3_sim_frame_ms(frames) + SEEK_INDEX_INTERVAL_MS - 1) / SEEK_INDEX_INTERVAL_MS);
+        CHECK_EQ(seek_index_duration(&index) / 1000, file->minutes * 60);
+        CHECK_EQ(estimate.misaligned, 0);
+        CHECK_EQ(indexed.misaligned, 0);
+        if (file->kbps > 0) {
+            CHECK(estimate.max_error_ms <= FRAME_MS); // exact for CBR, the index is not needed
+            CHECK(estimate.max_time_error_ms <= FRAME_MS);
+            CHECK(indexed.max_time_error_ms <= FRAME_MS);
+        }
+        CHECK(indexed.max_error_ms <= FRAME_MS); // within a frame of the requested time
+        CHECK(indexed.max_time_error_ms <= SEEK_INDEX_INTERVAL_MS / 4); // VBR interpolated between two entries
+        CHECK_EQ(indexed.time_accesses, 0);
+        seek_index_close(&index);
+        free(offsets);
+    }
+    sdcard_sim_remove_all();
+    return sim_failures() != 0;
+}
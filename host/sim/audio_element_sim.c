@@ -0,0 +1,93 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "audio_element.h"
+
+#include "audio_element_sim.h"
+
+struct audio_element {
+    audio_element_cfg_t cfg;
+    audio_element_info_t info;
+    char *buffer; // buffer_len, what the element task would pass to process()
+    const char *in;
+    int in_len;
+    char *out;
+    int out_len;
+};
+
+audio_element_handle_t audio_element_init(audio_element_cfg_t *config) {
+    audio_element_handle_t el = calloc(1, sizeof(struct audio_element));
+    if (el == NULL) {
+        return NULL;
+    }
+    el->cfg = *config;
+    el->buffer = malloc(config->buffer_len);
+    if (el->buffer == NULL) {
+        free(el);
+        return NULL;
+    }
+    return el;
+}
+
+esp_err_t audio_element_deinit(audio_element_handle_t el) {
+    if (el->cfg.destroy != NULL) {
+        el->cfg.destroy(el);
+    }
+    free(el->buffer);
+    free(el);
+    return ESP_OK;
+}
+
+void *audio_element_getdata(audio_element_handle_t el) {
+    return el->cfg.data;
+}
+
+esp_err_t audio_element_setdata(audio_element_handle_t el, void *data) {
+    el->cfg.data = data;
+    return ESP_OK;
+}
+
+esp_err_t audio_element_getinfo(audio_element_handle_t el, audio_element_info_t *info) {
+    *info = el->info;
+    return ESP_OK;
+}
+
+esp_err_t audio_element_setinfo(audio_element_handle_t el, audio_element_info_t *info) {
+    el->info = *info;
+    return ESP_OK;
+}
+
+int audio_element_input(audio_element_handle_t el, char *buffer, int wanted_size) {
+    int n = wanted_size < el->in_len ? wanted_size : el->in_len;
+    if (n == 0) {
+        return AEL_IO_DONE;
+    }
+    memcpy(buffer, el->in, n);
+    el->in += n;
+    el->in_len -= n;
+    return n;
+}
+
+int audio_element_output(audio_element_handle_t el, char *buffer, int write_size) {
+    memcpy(el->out + el->out_len, buffer, write_size);
+    el->out_len += write_size;
+    return write_size;
+}
+
+esp_err_t audio_element_sim_open(audio_element_handle_t el) {
+    return el->cfg.open != NULL ? el->cfg.open(el) : ESP_OK;
+}
+
+int audio_element_sim_process(audio_element_handle_t el, const void *in, void *out, int len) {
+    el->in = in;
+    el->in_len = len;
+    el->out = out;
+    el->out_len = 0;
+    while (el->in_len > 0 && el->cfg.process(el, el->buffer, el->cfg.buffer_len) > 0) {
+    }
+    return el->out_len;
+}
+
+esp_err_t audio_element_sim_close(audio_element_handle_t el) {
+    return el->cfg.close != NULL ? el->cfg.close(el) : ESP_OK;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "audio_element.h"
+
+/*
+ * Runs the callbacks of an ADF element on buffers instead of ring buffers: audio_element_sim_process() feeds
+ * in through the element's process() in buffer_len pieces, as its task would, and collects what it outputs.
+ */
+esp_err_t audio_element_sim_open(audio_element_handle_t el);
+int audio_element_sim_process(audio_element_handle_t el, const void *in, void *out, int len); // bytes output
+esp_err_t audio_element_sim_close(audio_element_handle_t el);
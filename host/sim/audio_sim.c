@@ -0,0 +1,100 @@
+#include <string.h>
+
+#include "audio_engine.h"
+#include "system_sound.h"
+#include "seek_index.h"
+#include "media_probe.h"
+
+#include "audio_sim.h"
+#include "sim.h"
+
+static audio_sim_t state;
+static bool playing = false;
+static bool paused = false;
+static int64_t stopped_at_us = 0; // stop requested, the pipeline is down AUDIO_SIM_STOP_US later
+static int64_t position = 0; // byte_pos at resumed_us
+static int64_t resumed_us = 0;
+static uint32_t bitrate = AUDIO_SIM_BITRATE_KBPS;
+
+void audio_sim_reset() {
+    memset(&state, 0, sizeof(state));
+    playing = false;
+    paused = false;
+    stopped_at_us = 0;
+    position = 0;
+}
+
+const audio_sim_t *audio_sim() {
+    return &state;
+}
+
+bool audio_sim_playing() {
+    return playing;
+}
+
+esp_err_t audio_engine_play(const char *uri, int64_t byte_pos) {
+    media_format_t format;
+    esp_err_t ret = media_probe(uri, &format);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    seek_index_t index;
+    bitrate = seek_index_open(&index, uri) == ESP_OK ? index.bitrate : AUDIO_SIM_BITRATE_KBPS;
+    strlcpy(state.uri, uri, sizeof(state.uri));
+    state.plays++;
+    state.play_us = sim_now_us();
+    state.start_pos = byte_pos;
+    position = byte_pos;
+    resumed_us = sim_now_us();
+    playing = true;
+    paused = false;
+    return ESP_OK;
+}
+
+void audio_engine_stop() {
+    if (playing) {
+        state.stops++;
+        playing = false;
+        stopped_at_us = sim_now_us();
+        state.stop_us = stopped_at_us;
+    }
+}
+
+void audio_engine_wait_for_stop() {
+    int64_t down = stopped_at_us + AUDIO_SIM_STOP_US;
+    if (down > sim_now_us()) {
+        sim_advance_us(down - sim_now_us());
+    }
+}
+
+void audio_engine_pause() {
+    if (playing && !paused) {
+        position = audio_engine_position();
+        paused = true;
+    }
+}
+
+void audio_engine_seek(int64_t byte_pos) {
+    state.seeks++;
+    state.start_pos = byte_pos;
+    position = byte_pos;
+}
+
+void audio_engine_resume() {
+    paused = false;
+    resumed_us = sim_now_us();
+}
+
+int64_t audio_engine_position() {
+    if (!playing || paused) {
+        return playing ? position : 0;
+    }
+    return position + (sim_now_us() - resumed_us) * bitrate / 8 / 1000;
+}
+
+esp_err_t system_sound_play(const char *name, bool wait) {
+    return ESP_ERR_NOT_FOUND;
+}
+
+void system_sound_stop() {
+}
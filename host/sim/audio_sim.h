@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define AUDIO_SIM_STOP_US 40000 // pipeline stop until every element task has quit
+#define AUDIO_SIM_BITRATE_KBPS 128 // playback speed for files without a frame header
+
+/*
+ * Fake audio_engine: records what the control path asks for and advances the reader position with the
+ * simulated clock at the bitrate of the file. Files media_probe() rejects are not played. system_sound has no cue partition, so the SD card files are used.
+ */
+typedef struct {
+    uint32_t plays;
+    uint32_t stops;
+    uint32_t seeks;
+    int64_t play_us; // simulated time of the last audio_engine_play()
+    int64_t stop_us; // of the last audio_engine_stop() of a playing pipeline
+    char uri[128];
+    int64_t start_pos; // byte_pos of the last play or seek
+} audio_sim_t;
+
+void audio_sim_reset();
+const audio_sim_t *audio_sim();
+bool audio_sim_playing();
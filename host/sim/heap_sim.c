@@ -0,0 +1,43 @@
+#include <stdlib.h>
+
+#include "heap_sim.h"
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+static uint32_t allocations = 0;
+static uint32_t frees = 0;
+
+void *__wrap_malloc(size_t size) {
+    allocations++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+    allocations++;
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    if (ptr == NULL) {
+        allocations++;
+    }
+    return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr) {
+    if (ptr != NULL) {
+        frees++;
+    }
+    __real_free(ptr);
+}
+
+uint32_t heap_sim_allocations() {
+    return allocations;
+}
+
+uint32_t heap_sim_frees() {
+    return frees;
+}
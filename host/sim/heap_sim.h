@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Counts heap calls of the code linked into a host program (malloc, calloc and realloc are wrapped with
+ * ld --wrap, so allocations inside libc itself are not seen). Diff the counters around the code under test.
+ */
+uint32_t heap_sim_allocations(); // since start
+uint32_t heap_sim_frees();
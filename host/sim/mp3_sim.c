@@ -0,0 +1,64 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "mp3_sim.h"
+#include "sdcard_sim.h"
+
+static const uint16_t bitrates[] = { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 };
+
+static uint32_t mp3_sim_random(uint32_t *state) { // xorshift, the corpus is the same on every run
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+uint32_t mp3_sim_write(const char *path, uint32_t frames, int kbps, uint32_t seed, uint32_t *offsets) {
+    uint32_t capacity = MP3_SIM_ID3_BYTES + frames * 1045; // 320 kbit/s with padding
+    uint8_t *data = calloc(1, capacity);
+    uint32_t state = seed | 1;
+
+    // ID3v2.3 tag with a syncsafe size, its content never looks like a frame header
+    memcpy(data, "ID3\x03\x00\x00", 6);
+    uint32_t id3_size = MP3_SIM_ID3_BYTES - 10;
+    data[6] = (id3_size >> 21) & 0x7F;
+    data[7] = (id3_size >> 14) & 0x7F;
+    data[8] = (id3_size >> 7) & 0x7F;
+    data[9] = id3_size & 0x7F;
+
+    uint32_t pos = MP3_SIM_ID3_BYTES;
+    uint32_t rest = 0; // CBR: the padding bit keeps the average frame length at 144 * bitrate / 44100 bytes
+    for (uint32_t i = 0; i < frames; i++) {
+        int index = 9; // 128 kbit/s
+        for (int j = 1; kbps > 0 && j < 15; j++) {
+            if (bitrates[j] == kbps) {
+                index = j;
+            }
+        }
+        rest += 144 * bitrates[index] * 1000 % 44100;
+        int padding = rest >= 44100;
+        rest -= padding ? 44100 : 0;
+        if (kbps == 0) {
+            index = 5 + mp3_sim_random(&state) % 10; // 64 .. 320 kbit/s
+            padding = mp3_sim_random(&state) & 1;
+        }
+        if (offsets != NULL) {
+            offsets[i] = pos;
+        }
+        data[pos] = 0xFF;
+        data[pos + 1] = 0xFB; // MPEG-1 layer III, no CRC
+        data[pos + 2] = (index << 4) | (padding << 1); // 44.1 kHz
+        data[pos + 3] = 0x00; // stereo
+        pos += 144 * bitrates[index] * 1000 / 44100 + padding;
+    }
+    if (offsets != NULL) {
+        offsets[frames] = pos;
+    }
+    sdcard_sim_write(path, data, pos);
+    free(data);
+    return pos;
+}
+
+int64_t mp3_sim_frame_ms(uint32_t frame) {
+    return (int64_t) frame * MP3_SIM_FRAME_SAMPLES * 1000 / 44100;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+
+#define MP3_SIM_FRAME_SAMPLES 1152 // MPEG-1 layer III, 44.1 kHz stereo
+#define MP3_SIM_ID3_BYTES 2048 // ID3v2 tag in front of the first frame
+
+/*
+ * Synthetic MP3s for the host programs: valid frame headers with silent payload, so seek_index and
+ * media_probe see real frame structure. kbps 0 writes VBR with a random bitrate and padding per frame.
+ * offsets (frames + 1 entries, may be NULL) receives the byte offset of every frame and the file size.
+ */
+uint32_t mp3_sim_write(const char *path, uint32_t frames, int kbps, uint32_t seed, uint32_t *offsets); // file size
+int64_t mp3_sim_frame_ms(uint32_t frame); // start time of a frame
@@ -0,0 +1,382 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "nvs.h"
+#include "nvs_flash.h"
+
+#include "nvs_sim.h"
+
+#define NVS_SIM_MAX_ITEMS (NVS_SIM_PAGES * NVS_SIM_PAGE_ENTRIES)
+#define NVS_SIM_MAX_VALUE 512
+#define NVS_SIM_MAX_NAMESPACES 16
+#define NVS_SIM_MAX_HANDLES 16
+
+typedef enum {
+    PAGE_FREE,
+    PAGE_ACTIVE,
+    PAGE_FULL,
+} page_state_t;
+
+typedef struct {
+    bool used;
+    int ns; // 0: the namespace entries themselves
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    nvs_type_t type;
+    uint8_t value[NVS_SIM_MAX_VALUE];
+    size_t len;
+    int page;
+    int span; // entries on the page
+} item_t;
+
+typedef struct {
+    page_state_t state;
+    int written;
+    int erased;
+} page_t;
+
+struct nvs_opaque_iterator_t {
+    int ns;
+    nvs_type_t type;
+    int index;
+};
+
+static item_t items[NVS_SIM_MAX_ITEMS];
+static page_t pages[NVS_SIM_PAGES];
+static int free_pages[NVS_SIM_PAGES]; // FIFO, erased pages are reused last
+static int free_count = 0;
+static int active = -1;
+static char namespaces[NVS_SIM_MAX_NAMESPACES][16];
+static int namespace_count = 1;
+static struct {
+    bool open;
+    int ns;
+    nvs_open_mode_t mode;
+} handles[NVS_SIM_MAX_HANDLES];
+static nvs_sim_stats_t stats;
+
+void nvs_sim_reset() {
+    memset(items, 0, sizeof(items));
+    memset(pages, 0, sizeof(pages));
+    memset(namespaces, 0, sizeof(namespaces));
+    memset(handles, 0, sizeof(handles));
+    memset(&stats, 0, sizeof(stats));
+    for (int i = 0; i < NVS_SIM_PAGES; i++) {
+        free_pages[i] = i;
+    }
+    free_count = NVS_SIM_PAGES;
+    active = -1;
+    namespace_count = 1;
+}
+
+const nvs_sim_stats_t *nvs_sim_stats() {
+    return &stats;
+}
+
+uint32_t nvs_sim_live_entries() {
+    uint32_t n = 0;
+    for (int i = 0; i < NVS_SIM_MAX_ITEMS; i++) {
+        if (items[i].used) {
+            n += items[i].span;
+        }
+    }
+    return n;
+}
+
+static int nvs_sim_pop_free() {
+    int page = free_pages[0];
+    memmove(&free_pages[0], &free_pages[1], --free_count * sizeof(int));
+    pages[page].state = PAGE_ACTIVE;
+    return page;
+}
+
+/* Compacts the full page with the most erased entries into the reserved free page, false if none has any */
+static bool nvs_sim_compact() {
+    int victim = -1;
+    for (int i = 0; i < NVS_SIM_PAGES; i++) {
+        if (pages[i].state == PAGE_FULL && pages[i].erased > 0 && (victim < 0 || pages[i].erased > pages[victim].erased)) {
+            victim = i;
+        }
+    }
+    if (victim < 0 || free_count == 0) {
+        return false;
+    }
+    int target = nvs_sim_pop_free();
+    for (int i = 0; i < NVS_SIM_MAX_ITEMS; i++) {
+        if (items[i].used && items[i].page == victim) {
+            items[i].page = target;
+            pages[target].written += items[i].span;
+            stats.entry_writes += items[i].span;
+            stats.moved += items[i].span;
+        }
+    }
+    pages[victim] = (page_t) {.state = PAGE_FREE};
+    free_pages[free_count++] = victim;
+    stats.page_erases++;
+    stats.erase_counts[victim]++;
+    active = target;
+    return true;
+}
+
+static int nvs_sim_alloc(int span) {
+    for (;;) {
+        if (active >= 0 && pages[active].written + span <= NVS_SIM_PAGE_ENTRIES) {
+            pages[active].written += span;
+            stats.entry_writes += span;
+            return active;
+        }
+        if (active >= 0) {
+            pages[active].state = PAGE_FULL;
+            active = -1;
+        }
+        if (free_count > 1) { // the last free page is kept for compaction
+            active = nvs_sim_pop_free();
+        } else if (!nvs_sim_compact()) {
+            return -1;
+        }
+    }
+}
+
+static item_t *nvs_sim_find(int ns, const char *key) {
+    for (int i = 0; i < NVS_SIM_MAX_ITEMS; i++) {
+        if (items[i].used && items[i].ns == ns && strcmp(items[i].key, key) == 0) {
+            return &items[i];
+        }
+    }
+    return NULL;
+}
+
+static void nvs_sim_erase(item_t *item) {
+    pages[item->page].erased += item->span;
+    item->used = false;
+}
+
+static esp_err_t nvs_sim_write(int ns, const char *key, nvs_type_t type, const void *value, size_t len) {
+    if (strlen(key) >= NVS_KEY_NAME_MAX_SIZE) {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+    if (len > NVS_SIM_MAX_VALUE) {
+        return ESP_ERR_NVS_VALUE_TOO_LONG;
+    }
+    item_t *old = nvs_sim_find(ns, key);
+    if (old != NULL && old->type == type && old->len == len && memcmp(old->value, value, len) == 0) {
+        return ESP_OK; // same value, nothing is written
+    }
+    item_t *item = NULL;
+    for (int i = 0; i < NVS_SIM_MAX_ITEMS && item == NULL; i++) {
+        if (!items[i].used) {
+            item = &items[i];
+        }
+    }
+    int span = type == NVS_TYPE_BLOB ? 2 + (len + 31) / 32 : type == NVS_TYPE_STR ? 1 + (len + 31) / 32 : 1;
+    int page = item != NULL ? nvs_sim_alloc(span) : -1;
+    if (page < 0) {
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+    if (old != NULL) { // the new entry is complete before the old one is marked erased
+        nvs_sim_erase(old);
+    }
+    *item = (item_t) {.used = true, .ns = ns, .type = type, .len = len, .page = page, .span = span};
+    strcpy(item->key, key);
+    memcpy(item->value, value, len);
+    return ESP_OK;
+}
+
+static int nvs_sim_namespace(const char *name) {
+    for (int i = 1; i < namespace_count; i++) {
+        if (strcmp(namespaces[i], name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int nvs_sim_handle_ns(nvs_handle_t handle, bool write) {
+    if (handle == 0 || handle > NVS_SIM_MAX_HANDLES || !handles[handle - 1].open) {
+        return -ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (write && handles[handle - 1].mode == NVS_READONLY) {
+        return -ESP_ERR_NVS_READ_ONLY;
+    }
+    return handles[handle - 1].ns;
+}
+
+static esp_err_t nvs_sim_get(nvs_handle_t handle, const char *key, nvs_type_t type, void *out, size_t *len) {
+    int ns = nvs_sim_handle_ns(handle, false);
+    if (ns < 0) {
+        return -ns;
+    }
+    item_t *item = nvs_sim_find(ns, key);
+    if (item == NULL) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (item->type != type) {
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+    if (out != NULL && *len < item->len) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    if (out != NULL) {
+        memcpy(out, item->value, item->len);
+    }
+    *len = item->len;
+    return ESP_OK;
+}
+
+static esp_err_t nvs_sim_set(nvs_handle_t handle, const char *key, nvs_type_t type, const void *value, size_t len) {
+    int ns = nvs_sim_handle_ns(handle, true);
+    if (ns < 0) {
+        return -ns;
+    }
+    return nvs_sim_write(ns, key, type, value, len);
+}
+
+esp_err_t nvs_flash_init() {
+    if (free_count == 0 && active < 0) { // never reset
+        nvs_sim_reset();
+    }
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase() {
+    nvs_sim_reset();
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle) {
+    nvs_flash_init();
+    int ns = nvs_sim_namespace(name);
+    if (ns < 0 && open_mode == NVS_READONLY) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (ns < 0) {
+        if (namespace_count == NVS_SIM_MAX_NAMESPACES || strlen(name) >= sizeof(namespaces[0])) {
+            return ESP_ERR_NVS_INVALID_NAME;
+        }
+        uint8_t index = namespace_count;
+        esp_err_t ret = nvs_sim_write(0, name, NVS_TYPE_U8, &index, 1);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        strcpy(namespaces[namespace_count], name);
+        ns = namespace_count++;
+    }
+    for (int i = 0; i < NVS_SIM_MAX_HANDLES; i++) {
+        if (!handles[i].open) {
+            handles[i].open = true;
+            handles[i].ns = ns;
+            handles[i].mode = open_mode;
+            *out_handle = i + 1;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    if (handle > 0 && handle <= NVS_SIM_MAX_HANDLES) {
+        handles[handle - 1].open = false;
+    }
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    int ns = nvs_sim_handle_ns(handle, false);
+    if (ns < 0) {
+        return -ns;
+    }
+    stats.commits++;
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    int ns = nvs_sim_handle_ns(handle, true);
+    if (ns < 0) {
+        return -ns;
+    }
+    item_t *item = nvs_sim_find(ns, key);
+    if (item == NULL) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    nvs_sim_erase(item);
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle) {
+    int ns = nvs_sim_handle_ns(handle, true);
+    if (ns < 0) {
+        return -ns;
+    }
+    for (int i = 0; i < NVS_SIM_MAX_ITEMS; i++) {
+        if (items[i].used && items[i].ns == ns) {
+            nvs_sim_erase(&items[i]);
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_i32(nvs_handle_t handle, const char *key, int32_t value) {
+    return nvs_sim_set(handle, key, NVS_TYPE_I32, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_i32(nvs_handle_t handle, const char *key, int32_t *out_value) {
+    size_t len = sizeof(*out_value);
+    return nvs_sim_get(handle, key, NVS_TYPE_I32, out_value, &len);
+}
+
+esp_err_t nvs_set_i64(nvs_handle_t handle, const char *key, int64_t value) {
+    return nvs_sim_set(handle, key, NVS_TYPE_I64, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_i64(nvs_handle_t handle, const char *key, int64_t *out_value) {
+    size_t len = sizeof(*out_value);
+    return nvs_sim_get(handle, key, NVS_TYPE_I64, out_value, &len);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+    return nvs_sim_set(handle, key, NVS_TYPE_BLOB, value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length) {
+    return nvs_sim_get(handle, key, NVS_TYPE_BLOB, out_value, length);
+}
+
+static bool nvs_sim_matches(const struct nvs_opaque_iterator_t *it, int i) {
+    return items[i].used && items[i].ns == it->ns && (it->type == NVS_TYPE_ANY || items[i].type == it->type);
+}
+
+static nvs_iterator_t nvs_sim_seek(nvs_iterator_t it) {
+    while (it->index < NVS_SIM_MAX_ITEMS && !nvs_sim_matches(it, it->index)) {
+        it->index++;
+    }
+    if (it->index == NVS_SIM_MAX_ITEMS) {
+        free(it);
+        return NULL;
+    }
+    return it;
+}
+
+nvs_iterator_t nvs_entry_find(const char *part_name, const char *namespace_name, nvs_type_t type) {
+    int ns = nvs_sim_namespace(namespace_name);
+    if (ns < 0) {
+        return NULL;
+    }
+    nvs_iterator_t it = malloc(sizeof(*it));
+    *it = (struct nvs_opaque_iterator_t) {.ns = ns, .type = type, .index = 0};
+    return nvs_sim_seek(it);
+}
+
+nvs_iterator_t nvs_entry_next(nvs_iterator_t iterator) {
+    iterator->index++;
+    return nvs_sim_seek(iterator);
+}
+
+void nvs_entry_info(nvs_iterator_t iterator, nvs_entry_info_t *out_info) {
+    const item_t *item = &items[iterator->index];
+    strcpy(out_info->namespace_name, namespaces[item->ns]);
+    strcpy(out_info->key, item->key);
+    out_info->type = item->type;
+}
+
+void nvs_release_iterator(nvs_iterator_t iterator) {
+    free(iterator);
+}
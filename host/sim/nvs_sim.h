@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+
+#define NVS_SIM_PAGES 6 // nvs partition of partitions.csv, 0x6000 bytes
+#define NVS_SIM_PAGE_ENTRIES 126 // 32 byte entries of a 4 KB page behind header and state bitmap
+
+/*
+ * NVS on a page model: entries are appended to the active page, an overwrite or erase marks the old
+ * entry erased. One page is kept free; when it would be needed, the full page with the most erased
+ * entries is compacted into it and erased, like the ESP-IDF page manager does. Counts what reaches the flash.
+ */
+typedef struct {
+    uint32_t entry_writes; // including entries moved by compaction
+    uint32_t moved;
+    uint32_t page_erases;
+    uint32_t commits;
+    uint32_t erase_counts[NVS_SIM_PAGES]; // per page, the flash sectors wear out at ~100k
+} nvs_sim_stats_t;
+
+void nvs_sim_reset(); // erased partition, statistics cleared
+const nvs_sim_stats_t *nvs_sim_stats();
+uint32_t nvs_sim_live_entries();
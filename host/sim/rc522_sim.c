@@ -0,0 +1,282 @@
+#include <string.h>
+
+#include "i2c_bus.h"
+
+#include "rc522_sim.h"
+#include "sim.h"
+
+#define REG_COMMAND 0x01
+#define REG_COM_IEN 0x02
+#define REG_COM_IRQ 0x04
+#define REG_DIV_IRQ 0x05
+#define REG_FIFO_DATA 0x09
+#define REG_FIFO_LEVEL 0x0A
+#define REG_BIT_FRAMING 0x0D
+#define REG_CRC_MSB 0x21
+#define REG_CRC_LSB 0x22
+#define REG_VERSION 0x37
+
+#define CMD_IDLE 0x00
+#define CMD_CALC_CRC 0x03
+#define CMD_TRANSCEIVE 0x0C
+
+typedef enum {
+    CARD_IDLE,
+    CARD_READY,
+    CARD_HALT,
+} card_state_t;
+
+static uint8_t regs[0x40];
+static uint8_t fifo[64];
+static int fifo_level = 0;
+static bool irq_active = false;
+static int irq_gpio = -1;
+static bool pending = false; // transceive waiting for the card or the timer
+static uint8_t answer[64];
+static int answer_len = 0;
+static int fail_writes = 0;
+
+static bool card_present = false;
+static uint8_t card_uid[4];
+static card_state_t card_state = CARD_IDLE;
+
+static uint32_t transactions = 0;
+static uint32_t waiting = 0;
+static uint32_t frames = 0;
+static uint32_t reads[0x40];
+
+static void rc522_sim_update_irq() {
+    bool active = (regs[REG_COM_IRQ] & regs[REG_COM_IEN] & 0x7F) != 0;
+    if (active && !irq_active) { // IRqInv: the pin falls
+        irq_active = true;
+        sim_gpio_edge(irq_gpio);
+    } else if (!active) {
+        irq_active = false;
+    }
+}
+
+static void rc522_sim_crc(const uint8_t *data, int n, uint8_t *crc) { // CRC_A of ISO 14443-3
+    uint16_t w = 0x6363;
+    for (int i = 0; i < n; i++) {
+        uint8_t b = data[i] ^ (w & 0xFF);
+        b ^= b << 4;
+        w = (w >> 8) ^ ((uint16_t) b << 8) ^ ((uint16_t) b << 3) ^ (b >> 4);
+    }
+    crc[0] = w & 0xFF;
+    crc[1] = w >> 8;
+}
+
+/* Answer of the card to a frame, -1 if it stays silent */
+static int rc522_sim_card(const uint8_t *frame, int n, uint8_t *out) {
+    if (!card_present || n == 0) {
+        return -1;
+    }
+    if (n == 1 && (frame[0] == 0x26 || frame[0] == 0x52)) { // REQA, WUPA
+        if (card_state == CARD_IDLE || (card_state == CARD_HALT && frame[0] == 0x52)) {
+            card_state = CARD_READY;
+            out[0] = 0x04; // ATQA
+            out[1] = 0x00;
+            return 2;
+        }
+        return -1;
+    }
+    if (n == 2 && frame[0] == 0x93 && frame[1] == 0x20 && card_state == CARD_READY) {
+        memcpy(out, card_uid, 4);
+        out[4] = card_uid[0] ^ card_uid[1] ^ card_uid[2] ^ card_uid[3];
+        return 5;
+    }
+    if (card_state == CARD_READY) { // not selected, HLTA and anything else fall back to IDLE
+        card_state = CARD_IDLE;
+    }
+    return -1;
+}
+
+static void rc522_sim_answer(void *arg) {
+    memcpy(fifo, answer, answer_len);
+    fifo_level = answer_len;
+    regs[REG_COM_IRQ] |= 0x30; // RxIRq, IdleIRq
+    pending = false;
+    rc522_sim_update_irq();
+}
+
+static void rc522_sim_timeout(void *arg) {
+    regs[REG_COM_IRQ] |= 0x01; // TimerIRq
+    pending = false;
+    rc522_sim_update_irq();
+}
+
+static void rc522_sim_crc_done(void *arg) {
+    regs[REG_DIV_IRQ] |= 0x04; // CRCIRq
+}
+
+static void rc522_sim_send() {
+    frames++;
+    pending = true;
+    answer_len = rc522_sim_card(fifo, fifo_level, answer);
+    fifo_level = 0;
+    if (answer_len >= 0) {
+        sim_schedule(sim_now_us() + RC522_SIM_CARD_US, rc522_sim_answer, NULL);
+    } else {
+        sim_schedule(sim_now_us() + RC522_SIM_TIMER_US, rc522_sim_timeout, NULL);
+    }
+}
+
+static void rc522_sim_write(uint8_t reg, uint8_t val) {
+    switch (reg) {
+        case REG_COMMAND:
+            regs[reg] = val;
+            if ((val & 0x0F) == CMD_CALC_CRC) {
+                uint8_t crc[2];
+                rc522_sim_crc(fifo, fifo_level, crc);
+                regs[REG_CRC_LSB] = crc[0];
+                regs[REG_CRC_MSB] = crc[1];
+                fifo_level = 0;
+                sim_schedule(sim_now_us() + RC522_SIM_CRC_US, rc522_sim_crc_done, NULL);
+            } else if ((val & 0x0F) == CMD_IDLE && pending) {
+                sim_cancel(rc522_sim_answer, NULL);
+                sim_cancel(rc522_sim_timeout, NULL);
+                pending = false;
+            }
+            break;
+        case REG_COM_IRQ:
+        case REG_DIV_IRQ:
+            if (val & 0x80) { // Set1/Set2
+                regs[reg] |= val & 0x7F;
+            } else {
+                regs[reg] &= ~val;
+            }
+            break;
+        case REG_FIFO_DATA:
+            if (fifo_level < (int) sizeof(fifo)) {
+                fifo[fifo_level++] = val;
+            }
+            break;
+        case REG_FIFO_LEVEL:
+            if (val & 0x80) { // FlushBuffer
+                fifo_level = 0;
+            }
+            break;
+        case REG_BIT_FRAMING:
+            regs[reg] = val;
+            if ((val & 0x80) && (regs[REG_COMMAND] & 0x0F) == CMD_TRANSCEIVE && !pending) { // StartSend
+                rc522_sim_send();
+            }
+            break;
+        default:
+            regs[reg] = val;
+            break;
+    }
+    rc522_sim_update_irq();
+}
+
+static uint8_t rc522_sim_read(uint8_t reg) {
+    if (reg == REG_FIFO_DATA) {
+        if (fifo_level == 0) {
+            return 0;
+        }
+        uint8_t val = fifo[0];
+        memmove(fifo, fifo + 1, --fifo_level);
+        return val;
+    }
+    if (reg == REG_FIFO_LEVEL) {
+        return fifo_level;
+    }
+    return regs[reg];
+}
+
+static void rc522_sim_transaction(int bytes) {
+    transactions++;
+    if (pending) {
+        waiting++;
+    }
+    sim_advance_us(RC522_SIM_I2C_SETUP_US + bytes * RC522_SIM_I2C_BYTE_US);
+}
+
+void rc522_sim_reset() {
+    memset(regs, 0, sizeof(regs));
+    memset(reads, 0, sizeof(reads));
+    regs[REG_VERSION] = 0x92;
+    regs[0x14] = 0x80; // TxControl reset value
+    fifo_level = 0;
+    irq_active = false;
+    irq_gpio = -1;
+    pending = false;
+    fail_writes = 0;
+    card_present = false;
+    transactions = 0;
+    waiting = 0;
+    frames = 0;
+    sim_cancel(rc522_sim_answer, NULL);
+    sim_cancel(rc522_sim_timeout, NULL);
+    sim_cancel(rc522_sim_crc_done, NULL);
+}
+
+void rc522_sim_wire_irq(int gpio) {
+    irq_gpio = gpio;
+}
+
+void rc522_sim_place(const uint8_t uid[4]) {
+    memcpy(card_uid, uid, 4);
+    card_present = true;
+    card_state = CARD_IDLE;
+}
+
+void rc522_sim_remove() {
+    card_present = false;
+}
+
+void rc522_sim_fail_writes(int n) {
+    fail_writes = n;
+}
+
+uint8_t rc522_sim_register(uint8_t reg) {
+    return regs[reg & 0x3F];
+}
+
+uint32_t rc522_sim_transactions() {
+    return transactions;
+}
+
+uint32_t rc522_sim_reads(uint8_t reg) {
+    return reads[reg & 0x3F];
+}
+
+uint32_t rc522_sim_waiting_transactions() {
+    return waiting;
+}
+
+uint32_t rc522_sim_frames() {
+    return frames;
+}
+
+// i2c_bus, the RC522 does not auto-increment: all bytes of a transfer go to the same register
+
+i2c_bus_handle_t i2c_bus_create(i2c_port_t port, i2c_config_t *conf) {
+    static int bus;
+    return &bus;
+}
+
+esp_err_t i2c_bus_delete(i2c_bus_handle_t bus) {
+    return ESP_OK;
+}
+
+esp_err_t i2c_bus_write_bytes(i2c_bus_handle_t bus, int addr, uint8_t *reg, int reglen, uint8_t *data, int datalen) {
+    rc522_sim_transaction(1 + reglen + datalen);
+    if (fail_writes > 0) {
+        fail_writes--;
+        return ESP_FAIL;
+    }
+    for (int i = 0; i < datalen; i++) {
+        rc522_sim_write(reg[0] & 0x3F, data[i]);
+    }
+    return ESP_OK;
+}
+
+esp_err_t i2c_bus_read_bytes(i2c_bus_handle_t bus, int addr, uint8_t *reg, int reglen, uint8_t *outdata, int datalen) {
+    rc522_sim_transaction(2 + reglen + datalen);
+    reads[reg[0] & 0x3F]++;
+    for (int i = 0; i < datalen; i++) {
+        outdata[i] = rc522_sim_read(reg[0] & 0x3F);
+    }
+    return ESP_OK;
+}
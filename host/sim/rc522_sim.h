@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define RC522_SIM_I2C_BYTE_US 90 // 9 bits at 100 kHz
+#define RC522_SIM_I2C_SETUP_US 50 // start, stop and driver overhead per transaction
+#define RC522_SIM_CARD_US 500 // frame out, frame delay time and answer of the card
+#define RC522_SIM_TIMER_US 15000 // timer of rc522_init(), raises TimerIRq when no card answers
+#define RC522_SIM_CRC_US 20
+
+/*
+ * Register level model of the RC522 behind i2c_bus: FIFO, ComIrq/DivIrq with their enable masks, the
+ * Transceive and CalcCRC commands, the timer and the IRQ pin. The card in the field follows the
+ * ISO 14443-3 states (IDLE, READY, HALT) for REQA, WUPA, anticollision CL1 and anything else.
+ */
+void rc522_sim_reset(); // empty field, IRQ pin not connected
+void rc522_sim_wire_irq(int gpio); // -1: IRQ pin not connected, rc522_enable_irq() then waits for the timeout
+void rc522_sim_place(const uint8_t uid[4]); // a card enters the field now, in IDLE
+void rc522_sim_remove();
+void rc522_sim_fail_writes(int n); // the next n register writes are not acknowledged
+uint8_t rc522_sim_register(uint8_t reg); // register file, without side effects
+
+uint32_t rc522_sim_transactions(); // since reset
+uint32_t rc522_sim_reads(uint8_t reg);
+uint32_t rc522_sim_waiting_transactions(); // while a frame was in the air or the card had not answered yet
+uint32_t rc522_sim_frames(); // sent to the card
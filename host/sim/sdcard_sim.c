@@ -0,0 +1,203 @@
+#define _GNU_SOURCE // nftw
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "sdcard_scan.h"
+#include "ff.h"
+
+#include "sdcard_sim.h"
+#include "sim.h"
+
+FILE *__real_fopen(const char *path, const char *mode);
+int __real_stat(const char *path, struct stat *st);
+DIR *__real_opendir(const char *path);
+int __real_remove(const char *path);
+int __real_rename(const char *from, const char *to);
+int __real_mkdir(const char *path, mode_t mode);
+size_t __real_fread(void *ptr, size_t size, size_t n, FILE *file);
+
+static char root[256];
+static uint32_t accesses = 0;
+static uint64_t bytes_read = 0;
+
+/* Host path of a /sdcard path, other paths are left alone */
+static const char *sdcard_sim_path(const char *path, char *buf, size_t size) {
+    if (root[0] == 0 || strncmp(path, "/sdcard", 7) != 0 || (path[7] != '/' && path[7] != 0)) {
+        return path;
+    }
+    accesses++;
+    sim_advance_us(SDCARD_SIM_ACCESS_US);
+    snprintf(buf, size, "%s%s", root, path + 7);
+    return buf;
+}
+
+static void sdcard_sim_cleanup() {
+    sdcard_sim_remove_all();
+    rmdir(root);
+}
+
+const char *sdcard_sim_init() {
+    if (root[0] == 0) {
+        strcpy(root, "/tmp/hoerbox-sdcard-XXXXXX");
+        if (mkdtemp(root) == NULL) {
+            perror("mkdtemp");
+            exit(1);
+        }
+        atexit(sdcard_sim_cleanup);
+    }
+    sdcard_sim_remove_all();
+    return root;
+}
+
+void sdcard_sim_write(const char *path, const void *data, uint32_t size) {
+    char buf[512];
+    FILE *file = __real_fopen(sdcard_sim_path(path, buf, sizeof(buf)), "w");
+    if (file == NULL) {
+        perror(path);
+        exit(1);
+    }
+    fwrite(data, 1, size, file);
+    fclose(file);
+}
+
+static int sdcard_sim_unlink(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    return ftw->level > 0 ? __real_remove(path) : 0;
+}
+
+void sdcard_sim_remove_all() {
+    nftw(root, sdcard_sim_unlink, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+uint32_t sdcard_sim_accesses() {
+    return accesses;
+}
+
+uint64_t sdcard_sim_bytes_read() {
+    return bytes_read;
+}
+
+FILE *__wrap_fopen(const char *path, const char *mode) {
+    char buf[512];
+    return __real_fopen(sdcard_sim_path(path, buf, sizeof(buf)), mode);
+}
+
+int __wrap_stat(const char *path, struct stat *st) {
+    char buf[512];
+    return __real_stat(sdcard_sim_path(path, buf, sizeof(buf)), st);
+}
+
+DIR *__wrap_opendir(const char *path) {
+    char buf[512];
+    return __real_opendir(sdcard_sim_path(path, buf, sizeof(buf)));
+}
+
+int __wrap_remove(const char *path) {
+    char buf[512];
+    return __real_remove(sdcard_sim_path(path, buf, sizeof(buf)));
+}
+
+int __wrap_rename(const char *from, const char *to) {
+    char buf_from[512];
+    char buf_to[512];
+    return __real_rename(sdcard_sim_path(from, buf_from, sizeof(buf_from)), sdcard_sim_path(to, buf_to, sizeof(buf_to)));
+}
+
+int __wrap_mkdir(const char *path, mode_t mode) {
+    char buf[512];
+    return __real_mkdir(sdcard_sim_path(path, buf, sizeof(buf)), mode);
+}
+
+size_t __wrap_fread(void *ptr, size_t size, size_t n, FILE *file) {
+    size_t ret = __real_fread(ptr, size, n, file);
+    bytes_read += ret * size;
+    sim_advance_us((int64_t) ret * size * SDCARD_SIM_READ_US_PER_KB / 1024);
+    return ret;
+}
+
+// ADF sdcard_scan: reports file://sdcard/... URLs of matching files up to depth directories down
+
+static void sdcard_sim_scan(sdcard_scan_cb_t cb, const char *path, int depth, const char *file_extension[], int filter_num, void *user_data) {
+    DIR *dir = __wrap_opendir(path);
+    if (dir == NULL) {
+        return;
+    }
+    struct dirent *entry;
+    char child[512];
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        if (entry->d_type == DT_DIR) {
+            if (depth > 0) {
+                sdcard_sim_scan(cb, child, depth - 1, file_extension, filter_num, user_data);
+            }
+            continue;
+        }
+        const char *ext = strrchr(entry->d_name, '.');
+        for (int i = 0; ext != NULL && i < filter_num; i++) {
+            if (strcasecmp(ext + 1, file_extension[i]) == 0) {
+                char url[520];
+                snprintf(url, sizeof(url), "file:/%s", child);
+                cb(user_data, url);
+                break;
+            }
+        }
+    }
+    closedir(dir);
+}
+
+esp_err_t sdcard_scan(sdcard_scan_cb_t cb, const char *path, int depth, const char *file_extension[], int filter_num, void *user_data) {
+    sdcard_sim_scan(cb, path, depth, file_extension, filter_num, user_data);
+    return ESP_OK;
+}
+
+// FatFS directory reads on drive 0:, size and time come with the entry like from the FAT directory
+
+FRESULT f_opendir(FF_DIR *dp, const TCHAR *path) {
+    if (strncmp(path, "0:", 2) != 0) {
+        return FR_NO_PATH;
+    }
+    snprintf(dp->path, sizeof(dp->path), "/sdcard%s", path[2] == '/' ? path + 2 : "/");
+    dp->dir = __wrap_opendir(dp->path);
+    return dp->dir != NULL ? FR_OK : FR_NO_PATH;
+}
+
+FRESULT f_readdir(FF_DIR *dp, FILINFO *fno) {
+    memset(fno, 0, sizeof(*fno));
+    struct dirent *entry;
+    while ((entry = readdir(dp->dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        char path[sizeof(dp->path) + 1 + sizeof(entry->d_name)];
+        char buf[sizeof(root) + sizeof(path)];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", dp->path, entry->d_name);
+        snprintf(buf, sizeof(buf), "%s%s", root, path + 7);
+        if (__real_stat(buf, &st) != 0) {
+            return FR_DISK_ERR;
+        }
+        struct tm tm;
+        localtime_r(&st.st_mtime, &tm);
+        fno->fsize = S_ISDIR(st.st_mode) ? 0 : st.st_size;
+        fno->fdate = (tm.tm_year - 80) << 9 | (tm.tm_mon + 1) << 5 | tm.tm_mday;
+        fno->ftime = tm.tm_hour << 11 | tm.tm_min << 5 | tm.tm_sec / 2;
+        fno->fattrib = S_ISDIR(st.st_mode) ? AM_DIR : AM_ARC;
+        strlcpy(fno->fname, entry->d_name, sizeof(fno->fname));
+        break;
+    }
+    return FR_OK;
+}
+
+FRESULT f_closedir(FF_DIR *dp) {
+    closedir(dp->dir);
+    dp->dir = NULL;
+    return FR_OK;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+
+#define SDCARD_SIM_ACCESS_US 1500 // FATFS directory walk per open, stat or opendir on a 1-line card
+#define SDCARD_SIM_READ_US_PER_KB 1000 // ~1 MB/s through FATFS on the 1-line bus
+
+/*
+ * Maps /sdcard to a temporary directory for the host programs: fopen, stat, opendir, remove, rename and
+ * mkdir are wrapped with ld --wrap, the FatFS f_opendir/f_readdir of drive 0: and sdcard_scan are implemented on
+ * it. Every path lookup costs SDCARD_SIM_ACCESS_US of simulated time, fread SDCARD_SIM_READ_US_PER_KB (the host
+ * programs read nothing but the card).
+ */
+const char *sdcard_sim_init(); // fresh temporary directory behind /sdcard, returned as host path
+void sdcard_sim_write(const char *path, const void *data, uint32_t size); // path below /sdcard
+void sdcard_sim_remove_all(); // empties the directory behind /sdcard
+uint32_t sdcard_sim_accesses(); // path lookups since start
+uint64_t sdcard_sim_bytes_read(); // fread since start
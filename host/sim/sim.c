@@ -0,0 +1,471 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_rom_sys.h"
+#include "driver/gpio.h"
+#include "driver/uart.h"
+#include "hal/cpu_hal.h"
+#include "audio_event_iface.h"
+#include "board.h"
+
+#include "sim.h"
+
+#define SIM_MAX_TASKS 16
+#define SIM_MAX_TAGS 32
+
+typedef struct {
+    int64_t at_us;
+    sim_event_fn fn;
+    void *arg;
+} sim_event_t;
+
+struct sim_queue {
+    uint8_t *storage;
+    size_t item_size;
+    size_t length;
+    size_t head;
+    size_t count; // items, or the count of a semaphore
+};
+
+struct sim_event_group {
+    EventBits_t bits;
+};
+
+struct sim_task {
+    TaskFunction_t fn;
+    const char *name;
+    uint32_t notifications;
+};
+
+static int64_t now_us = 0;
+static sim_event_t events[SIM_MAX_EVENTS];
+static int event_count = 0;
+static int failures = 0;
+static struct sim_task tasks[SIM_MAX_TASKS];
+static int task_count = 0;
+static struct {
+    const char *tag;
+    esp_log_level_t level;
+} levels[SIM_MAX_TAGS];
+static int level_count = 0;
+static esp_log_level_t default_level = ESP_LOG_NONE; // read from HOERBOX_LOG on first use
+static gpio_isr_t isr_handlers[GPIO_NUM_MAX];
+static void *isr_args[GPIO_NUM_MAX];
+
+void sim_reset() {
+    now_us = 0;
+    event_count = 0;
+}
+
+int64_t sim_now_us() {
+    return now_us;
+}
+
+void sim_schedule(int64_t at_us, sim_event_fn fn, void *arg) {
+    if (event_count == SIM_MAX_EVENTS) {
+        fprintf(stderr, "sim: more than %d events\n", SIM_MAX_EVENTS);
+        abort();
+    }
+    int i = event_count++;
+    while (i > 0 && events[i - 1].at_us > at_us) { // same time: in order of scheduling
+        events[i] = events[i - 1];
+        i--;
+    }
+    events[i] = (sim_event_t) {.at_us = at_us, .fn = fn, .arg = arg};
+}
+
+void sim_cancel(sim_event_fn fn, void *arg) {
+    int n = 0;
+    for (int i = 0; i < event_count; i++) {
+        if (events[i].fn != fn || events[i].arg != arg) {
+            events[n++] = events[i];
+        }
+    }
+    event_count = n;
+}
+
+bool sim_run_next(int64_t until_us) {
+    if (event_count == 0 || events[0].at_us > until_us) {
+        return false;
+    }
+    sim_event_t event = events[0];
+    memmove(&events[0], &events[1], --event_count * sizeof(sim_event_t));
+    if (event.at_us > now_us) {
+        now_us = event.at_us;
+    }
+    event.fn(event.arg);
+    return true;
+}
+
+void sim_advance_us(int64_t us) {
+    int64_t until = now_us + us;
+    while (sim_run_next(until)) {
+    }
+    now_us = until;
+}
+
+void sim_gpio_edge(int gpio) {
+    if (gpio >= 0 && gpio < GPIO_NUM_MAX && isr_handlers[gpio] != NULL) {
+        isr_handlers[gpio](isr_args[gpio]);
+    }
+}
+
+bool sim_check(bool ok, const char *expr, const char *file, int line) {
+    if (!ok) {
+        failures++;
+        printf("FAIL %s:%d: %s\n", file, line, expr);
+    }
+    return ok;
+}
+
+bool sim_check_eq(int64_t a, int64_t b, const char *expr_a, const char *expr_b, const char *file, int line) {
+    if (a != b) {
+        failures++;
+        printf("FAIL %s:%d: %s == %s (%" PRId64 " != %" PRId64 ")\n", file, line, expr_a, expr_b, a, b);
+    }
+    return a == b;
+}
+
+int sim_failures() {
+    return failures;
+}
+
+// newlib
+
+size_t strlcpy(char *dst, const char *src, size_t size) {
+    size_t len = strlen(src);
+    if (size > 0) {
+        size_t n = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = 0;
+    }
+    return len;
+}
+
+// esp_timer, esp_rom, cpu_hal
+
+int64_t esp_timer_get_time() {
+    return now_us;
+}
+
+void esp_rom_delay_us(uint32_t us) {
+    sim_advance_us(us);
+}
+
+uint32_t cpu_hal_get_cycle_count() {
+#if defined(__x86_64__) || defined(__i386__)
+    return (uint32_t) __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) (ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+#endif
+}
+
+// esp_log
+
+static esp_log_level_t sim_log_level(const char *tag) {
+    for (int i = 0; i < level_count; i++) {
+        if (strcmp(levels[i].tag, tag) == 0) {
+            return levels[i].level;
+        }
+    }
+    if (default_level == ESP_LOG_NONE) {
+        const char *env = getenv("HOERBOX_LOG");
+        const char *names = "NEWIDV";
+        const char *l = env != NULL && env[0] != 0 ? strchr(names, env[0]) : NULL;
+        default_level = l != NULL ? (esp_log_level_t) (l - names) : ESP_LOG_WARN;
+    }
+    return default_level;
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level) {
+    if (strcmp(tag, "*") == 0) {
+        default_level = level;
+        level_count = 0;
+        return;
+    }
+    for (int i = 0; i < level_count; i++) {
+        if (strcmp(levels[i].tag, tag) == 0) {
+            levels[i].level = level;
+            return;
+        }
+    }
+    if (level_count < SIM_MAX_TAGS) {
+        levels[level_count].tag = tag;
+        levels[level_count].level = level;
+        level_count++;
+    }
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...) {
+    if (level > sim_log_level(tag)) {
+        return;
+    }
+    printf("%c (%" PRId64 ") %s: ", "NEWIDV"[level], now_us / 1000, tag);
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    printf("\n");
+}
+
+// FreeRTOS
+
+static bool sim_block(size_t *count, TickType_t ticks) {
+    int64_t deadline = ticks == portMAX_DELAY ? INT64_MAX : now_us + (int64_t) ticks * portTICK_PERIOD_MS * 1000;
+    while (*count == 0) {
+        if (!sim_run_next(deadline)) {
+            if (ticks == portMAX_DELAY) {
+                fprintf(stderr, "sim: blocking forever, nothing is scheduled\n");
+                abort();
+            }
+            now_us = deadline > now_us ? deadline : now_us;
+            return false;
+        }
+    }
+    return true;
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_size, void *arg,
+        UBaseType_t prio, StackType_t *stack, StaticTask_t *tcb, BaseType_t core) {
+    if (task_count == SIM_MAX_TASKS) {
+        return NULL;
+    }
+    tasks[task_count].fn = fn;
+    tasks[task_count].name = name;
+    return &tasks[task_count++];
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_size, void *arg,
+        UBaseType_t prio, TaskHandle_t *task, BaseType_t core) {
+    TaskHandle_t handle = xTaskCreateStaticPinnedToCore(fn, name, stack_size, arg, prio, NULL, NULL, core);
+    if (task != NULL) {
+        *task = handle;
+    }
+    return handle != NULL ? pdPASS : pdFAIL;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+}
+
+void vTaskDelay(TickType_t ticks) {
+    sim_advance_us((int64_t) ticks * portTICK_PERIOD_MS * 1000);
+}
+
+TickType_t xTaskGetTickCount() {
+    return now_us / 1000 / portTICK_PERIOD_MS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks) {
+    return 0;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    task->notifications++;
+    return pdPASS;
+}
+
+uint32_t sim_task_notifications(TaskHandle_t task) {
+    return task != NULL ? task->notifications : 0;
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t *storage, StaticQueue_t *buffer) {
+    QueueHandle_t queue = calloc(1, sizeof(struct sim_queue));
+    queue->storage = storage;
+    queue->item_size = item_size;
+    queue->length = length;
+    return queue;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    return xQueueCreateStatic(length, item_size, item_size > 0 ? malloc(length * item_size) : NULL, NULL);
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    free(queue);
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks) {
+    if (queue->count == queue->length) {
+        return pdFALSE; // nobody else would make room
+    }
+    memcpy(queue->storage + (queue->head + queue->count) % queue->length * queue->item_size, item, queue->item_size);
+    queue->count++;
+    return pdTRUE;
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void *item, TickType_t ticks) {
+    if (!sim_block(&queue->count, ticks)) {
+        return pdFALSE;
+    }
+    memcpy(item, queue->storage + queue->head * queue->item_size, queue->item_size);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks) {
+    if (xQueuePeek(queue, item, ticks) != pdTRUE) {
+        return pdFALSE;
+    }
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    return queue->count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+    return xQueueCreateStatic(1, 0, NULL, NULL);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    SemaphoreHandle_t sem = xSemaphoreCreateBinary();
+    sem->count = 1;
+    return sem;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+    if (!sim_block(&sem->count, ticks)) {
+        return pdFALSE;
+    }
+    sem->count--;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    if (sem->count == sem->length) {
+        return pdFALSE;
+    }
+    sem->count++;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t *woken) {
+    if (woken != NULL) {
+        *woken = pdFALSE;
+    }
+    return xSemaphoreGive(sem);
+}
+
+EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t *buffer) {
+    return calloc(1, sizeof(struct sim_event_group));
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    group->bits |= bits;
+    return group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear, BaseType_t all, TickType_t ticks) {
+    int64_t deadline = ticks == portMAX_DELAY ? INT64_MAX : now_us + (int64_t) ticks * portTICK_PERIOD_MS * 1000;
+    while (all ? (group->bits & bits) != bits : (group->bits & bits) == 0) {
+        if (!sim_run_next(deadline)) {
+            if (ticks != portMAX_DELAY && deadline > now_us) {
+                now_us = deadline;
+            }
+            break;
+        }
+    }
+    EventBits_t result = group->bits;
+    if (clear) {
+        group->bits &= ~bits;
+    }
+    return result;
+}
+
+// console UART, nothing is ever typed
+
+esp_err_t uart_driver_install(uart_port_t port, int rx_buffer_size, int tx_buffer_size, int queue_size,
+        QueueHandle_t *queue, int intr_alloc_flags) {
+    return ESP_OK;
+}
+
+int uart_read_bytes(uart_port_t port, void *buf, uint32_t length, TickType_t ticks) {
+    vTaskDelay(ticks);
+    return 0;
+}
+
+// GPIO interrupts, edges come from sim_gpio_edge()
+
+esp_err_t gpio_config(const gpio_config_t *config) {
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int flags) {
+    static bool installed = false;
+    if (installed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    installed = true;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio, gpio_isr_t handler, void *arg) {
+    if (gpio < 0 || gpio >= GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    isr_handlers[gpio] = handler;
+    isr_args[gpio] = arg;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio) {
+    if (gpio < 0 || gpio >= GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    isr_handlers[gpio] = NULL;
+    return ESP_OK;
+}
+
+// board and ADF event interface, nothing is wired
+
+esp_err_t get_i2c_pins(i2c_port_t port, i2c_config_t *config) {
+    config->sda_io_num = 18;
+    config->scl_io_num = 23;
+    return ESP_OK;
+}
+
+int get_input_rec_id() {
+    return 1;
+}
+
+int get_input_mode_id() {
+    return 2;
+}
+
+struct audio_event_iface {
+    audio_event_iface_handle_t listener;
+    uint32_t commands;
+};
+
+audio_event_iface_handle_t audio_event_iface_init(audio_event_iface_cfg_t *config) {
+    return calloc(1, sizeof(struct audio_event_iface));
+}
+
+esp_err_t audio_event_iface_destroy(audio_event_iface_handle_t evt) {
+    free(evt);
+    return ESP_OK;
+}
+
+esp_err_t audio_event_iface_set_msg_listener(audio_event_iface_handle_t evt, audio_event_iface_handle_t listener) {
+    evt->listener = listener;
+    return ESP_OK;
+}
+
+esp_err_t audio_event_iface_cmd(audio_event_iface_handle_t evt, audio_event_iface_msg_t *msg) {
+    evt->commands++;
+    return ESP_OK;
+}
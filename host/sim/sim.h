@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Simulated time for the host build. Nothing waits for real: vTaskDelay(), esp_rom_delay_us(), I2C
+ * transfers and SD card accesses advance the clock, and blocking FreeRTOS calls run the scheduled
+ * events (card responses, IRQ edges) up to their timeout instead. Everything runs on one thread.
+ */
+#define SIM_MAX_EVENTS 64
+
+typedef void (*sim_event_fn)(void *arg);
+
+void sim_reset(); // clock back to 0, events dropped
+int64_t sim_now_us();
+void sim_advance_us(int64_t us); // runs the events that fall due meanwhile
+void sim_schedule(int64_t at_us, sim_event_fn fn, void *arg);
+void sim_cancel(sim_event_fn fn, void *arg);
+bool sim_run_next(int64_t until_us); // runs the next event due by until_us, false if there is none
+void sim_gpio_edge(int gpio); // runs the ISR handler added for gpio, if any
+
+// minimal checks for the host programs, main() returns sim_failures() != 0
+#define CHECK(cond) sim_check((cond), #cond, __FILE__, __LINE__)
+#define CHECK_EQ(a, b) sim_check_eq((int64_t) (a), (int64_t) (b), #a, #b, __FILE__, __LINE__)
+bool sim_check(bool ok, const char *expr, const char *file, int line);
+bool sim_check_eq(int64_t a, int64_t b, const char *expr_a, const char *expr_b, const char *file, int line);
+int sim_failures();
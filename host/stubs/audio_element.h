@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+// the part of the ADF element API the host programs use, audio_element_sim.c runs process() on test buffers
+typedef struct audio_element *audio_element_handle_t;
+
+typedef enum {
+    AEL_IO_OK = ESP_OK,
+    AEL_IO_FAIL = ESP_FAIL,
+    AEL_IO_DONE = -2,
+    AEL_IO_ABORT = -3,
+    AEL_IO_TIMEOUT = -4,
+} audio_element_err_t;
+
+typedef struct {
+    int sample_rates;
+    int channels;
+    int bits;
+    int bps;
+    int64_t byte_pos;
+    int64_t total_bytes;
+    int duration;
+    char *uri;
+    int codec_fmt;
+} audio_element_info_t;
+
+typedef esp_err_t (*el_io_func)(audio_element_handle_t self);
+typedef int (*process_func)(audio_element_handle_t self, char *el_buffer, int el_buf_len);
+
+typedef struct {
+    el_io_func open;
+    el_io_func seek;
+    process_func process;
+    el_io_func close;
+    el_io_func destroy;
+    void *read;
+    void *write;
+    int buffer_len;
+    int task_stack;
+    int task_prio;
+    int task_core;
+    int out_rb_size;
+    void *data;
+    const char *tag;
+} audio_element_cfg_t;
+
+#define DEFAULT_AUDIO_ELEMENT_CONFIG() {    \
+    .buffer_len = 2048,                     \
+    .task_stack = 3072,                     \
+    .task_prio = 5,                         \
+    .task_core = 0,                         \
+    .out_rb_size = 8192,                    \
+}
+
+audio_element_handle_t audio_element_init(audio_element_cfg_t *config);
+esp_err_t audio_element_deinit(audio_element_handle_t el);
+void *audio_element_getdata(audio_element_handle_t el);
+esp_err_t audio_element_setdata(audio_element_handle_t el, void *data);
+esp_err_t audio_element_getinfo(audio_element_handle_t el, audio_element_info_t *info);
+esp_err_t audio_element_setinfo(audio_element_handle_t el, audio_element_info_t *info);
+char *audio_element_get_uri(audio_element_handle_t el);
+int audio_element_input(audio_element_handle_t el, char *buffer, int wanted_size);
+int audio_element_output(audio_element_handle_t el, char *buffer, int write_size);
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "esp_err.h"
+#include "driver/i2c.h"
+
+typedef struct audio_board *audio_board_handle_t;
+
+esp_err_t get_i2c_pins(i2c_port_t port, i2c_config_t *config);
+int get_input_rec_id();
+int get_input_mode_id();
@@ -0,0 +1,6 @@
+#pragma once
+
+// forced into every host translation unit: newlib has strlcpy, glibc before 2.38 does not
+#include <stddef.h>
+
+size_t strlcpy(char *dst, const char *src, size_t size);
@@ -0,0 +1,3 @@
+#pragma once
+
+typedef struct esp_periph_set *esp_periph_set_handle_t;
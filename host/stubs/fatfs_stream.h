@@ -0,0 +1,5 @@
+#pragma once
+
+// ADF defaults referenced by tasks.h
+#define FATFS_STREAM_TASK_PRIO 4
+#define FATFS_STREAM_TASK_STACK 3072
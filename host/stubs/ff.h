@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+
+// the FatFS directory calls of tag_catalog, on the simulated card (drive "0:" is /sdcard), see sdcard_sim.c
+
+#define FF_MAX_LFN 255
+
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef uint64_t FSIZE_t;
+typedef char TCHAR;
+
+typedef enum {
+    FR_OK = 0,
+    FR_DISK_ERR,
+    FR_NO_PATH = 5,
+} FRESULT;
+
+#define AM_RDO 0x01
+#define AM_HID 0x02
+#define AM_SYS 0x04
+#define AM_DIR 0x10
+#define AM_ARC 0x20
+
+typedef struct {
+    void *dir; // host DIR
+    char path[512];
+} FF_DIR;
+
+typedef struct {
+    FSIZE_t fsize;
+    WORD fdate; // bit 15:9 year from 1980, 8:5 month, 4:0 day
+    WORD ftime; // bit 15:11 hour, 10:5 minute, 4:0 second / 2
+    BYTE fattrib;
+    TCHAR altname[13];
+    TCHAR fname[FF_MAX_LFN + 1];
+} FILINFO;
+
+FRESULT f_opendir(FF_DIR *dp, const TCHAR *path);
+FRESULT f_readdir(FF_DIR *dp, FILINFO *fno); // fname[0] == 0 at the end
+FRESULT f_closedir(FF_DIR *dp);
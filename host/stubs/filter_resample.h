@@ -0,0 +1,5 @@
+#pragma once
+
+// ADF defaults referenced by tasks.h
+#define RSP_FILTER_TASK_PRIO 5
+#define RSP_FILTER_TASK_STACK 4096
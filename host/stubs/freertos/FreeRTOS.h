@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <assert.h>
+#include "esp_attr.h" // like the ESP-IDF FreeRTOS headers
+#include "esp_err.h"
+
+// single threaded FreeRTOS on the simulated clock (sim.c): blocking calls run scheduled events instead of waiting
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint8_t StackType_t;
+
+typedef struct { int unused; } StaticTask_t;
+typedef struct { int unused; } StaticQueue_t;
+typedef StaticQueue_t StaticSemaphore_t;
+typedef struct { int unused; } StaticEventGroup_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define portMAX_DELAY ((TickType_t) 0xffffffffUL)
+#define configTICK_RATE_HZ 100
+#define configMAX_PRIORITIES 25
+#define tskIDLE_PRIORITY 0
+#define portTICK_PERIOD_MS ((TickType_t) 1000 / configTICK_RATE_HZ)
+#define portTICK_RATE_MS portTICK_PERIOD_MS
+#define pdMS_TO_TICKS(ms) ((TickType_t) (((TickType_t) (ms) * (TickType_t) configTICK_RATE_HZ) / (TickType_t) 1000U))
+#define portYIELD_FROM_ISR()
+
+#ifndef BIT
+#define BIT(nr) (1UL << (nr))
+#endif
@@ -0,0 +1,5 @@
+#pragma once
+
+#include <stdint.h>
+
+uint32_t cpu_hal_get_cycle_count(); // host TSC (x86) or nanoseconds
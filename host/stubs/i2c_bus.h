@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "driver/i2c.h"
+
+// the only device on the simulated bus is the RC522 of rc522_sim.c
+typedef void *i2c_bus_handle_t;
+
+i2c_bus_handle_t i2c_bus_create(i2c_port_t port, i2c_config_t *conf);
+esp_err_t i2c_bus_delete(i2c_bus_handle_t bus);
+esp_err_t i2c_bus_write_bytes(i2c_bus_handle_t bus, int addr, uint8_t *reg, int reglen, uint8_t *data, int datalen);
+esp_err_t i2c_bus_read_bytes(i2c_bus_handle_t bus, int addr, uint8_t *reg, int reglen, uint8_t *outdata, int datalen);
@@ -0,0 +1,5 @@
+#pragma once
+
+// ADF defaults referenced by tasks.h
+#define I2S_STREAM_TASK_PRIO 23
+#define I2S_STREAM_TASK_STACK 3072
@@ -0,0 +1,5 @@
+#pragma once
+
+// ADF defaults referenced by tasks.h
+#define MP3_DECODER_TASK_PRIO 5
+#define MP3_DECODER_TASK_STACK_SIZE 5120
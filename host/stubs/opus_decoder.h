@@ -0,0 +1,4 @@
+#pragma once
+
+// ADF defaults referenced by tasks.h
+#define OPUS_DECODER_TASK_STACK_SIZE 30720
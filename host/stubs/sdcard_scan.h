@@ -0,0 +1,8 @@
+#pragma once
+
+#include "esp_err.h"
+
+typedef void (*sdcard_scan_cb_t)(void *user_data, char *url);
+
+// walks the directory behind the simulated /sdcard, see sdcard_sim.c
+esp_err_t sdcard_scan(sdcard_scan_cb_t cb, const char *path, int depth, const char *file_extension[], int filter_num, void *user_data);
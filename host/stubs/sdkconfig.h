@@ -0,0 +1,4 @@
+#pragma once
+
+#define CONFIG_FREERTOS_HZ 100
+#define CONFIG_ESP_CONSOLE_UART_NUM 0
@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "media_probe.h"
+
+#include "sim.h"
+#include "sdcard_sim.h"
+
+// track gains of synthetic MP3 (ID3v2.3 and 2.4), FLAC and Opus headers on the simulated card, and Ogg Vorbis
+// and sync words without a second frame, which must not be mistaken for MP3 by the frame sync scan
+
+static const uint8_t mp3_frame[4] = {0xFF, 0xFB, 0x90, 0x64}; // MPEG 1 layer III, 128 kbit/s, 44.1 kHz, stereo
+static const uint8_t mp2_frame[4] = {0xFF, 0xFD, 0x90, 0x64}; // the same in layer II
+#define MP3_FRAME_BYTES 417
+
+static uint8_t file[2048];
+static size_t size;
+
+static void put(const void *data, size_t n) {
+    memcpy(file + size, data, n);
+    size += n;
+}
+
+static void put_be32(uint32_t v, int syncsafe) {
+    uint8_t b[4];
+    for (int i = 0; i < 4; i++) {
+        b[i] = syncsafe ? (v >> (21 - 7 * i)) & 0x7F : v >> (24 - 8 * i);
+    }
+    put(b, 4);
+}
+
+static void put_le32(uint32_t v) {
+    uint8_t b[4] = {v, v >> 8, v >> 16, v >> 24};
+    put(b, 4);
+}
+
+static void put_frames(const uint8_t *header, int frames) {
+    for (int i = 0; i < frames; i++) {
+        put(header, 4);
+        memset(file + size, 0, MP3_FRAME_BYTES - 4);
+        size += MP3_FRAME_BYTES - 4;
+    }
+}
+
+static void put_id3_frame(const char *id, const char *body, size_t n, int version) {
+    put(id, 4);
+    put_be32(n, version == 4);
+    put("\0\0", 2);
+    put(body, n);
+}
+
+static void write_mp3(const char *path, int version) {
+    size = 0;
+    put("ID3", 3);
+    uint8_t header[3] = {version, 0, 0};
+    put(header, 3);
+    put_be32(0, 1); // patched below
+    put_id3_frame("TIT2", "\0Title", 6, version);
+    put_id3_frame("TXXX", "\0REPLAYGAIN_ALBUM_GAIN\0-3.00 dB", 31, version);
+    put_id3_frame("TXXX", "\0REPLAYGAIN_TRACK_GAIN\0-6.54 dB", 31, version);
+    memset(file + size, 0, 64); // padding
+    size += 64;
+    uint32_t tag = size - 10;
+    size = 6;
+    put_be32(tag, 1);
+    size = tag + 10;
+    put_frames(mp3_frame, 2);
+    sdcard_sim_write(path, file, size);
+}
+
+static void write_flac(const char *path) {
+    size = 0;
+    put("fLaC", 4);
+    put("\x00\x00\x00\x22", 4); // STREAMINFO
+    uint8_t info[34] = {0};
+    info[10] = 0x0A; // 44100 Hz
+    info[11] = 0xC4;
+    info[12] = 0x42; // 2 channels
+    put(info, sizeof(info));
+    put("\x03\x00\x00\xB4", 4); // SEEKTABLE
+    memset(file + size, 0, 180);
+    size += 180;
+    put("\x84\x00\x00\x00", 4); // VORBIS_COMMENT, last, size patched below
+    size_t block = size;
+    put_le32(4);
+    put("test", 4);
+    put_le32(3);
+    put_le32(8);
+    put("ARTIST=x", 8);
+    put_le32(80);
+    memset(file + size, 'x', 80); // too long to be a gain
+    memcpy(file + size, "LYRICS=", 7);
+    size += 80;
+    put_le32(30);
+    put("replaygain_track_gain=+2.10 dB", 30);
+    file[block - 1] = size - block;
+    sdcard_sim_write(path, file, size);
+}
+
+static void put_ogg_page(const void *packet, uint8_t n) {
+    uint8_t header[27] = {'O', 'g', 'g', 'S'};
+    header[26] = 1; // segments
+    put(header, sizeof(header));
+    put(&n, 1);
+    put(packet, n);
+}
+
+static void write_opus(const char *path) {
+    size = 0;
+    uint8_t head[19] = {'O', 'p', 'u', 's', 'H', 'e', 'a', 'd', 1, 2};
+    put_ogg_page(head, sizeof(head));
+    uint8_t tags[64];
+    size_t n = 0;
+    memcpy(tags, "OpusTags", 8);
+    n += 8;
+    memcpy(tags + n, "\x04\0\0\0test\x01\0\0\0\x15\0\0\0R128_TRACK_GAIN=-2560", 4 + 4 + 4 + 4 + 21);
+    n += 4 + 4 + 4 + 4 + 21;
+    put_ogg_page(tags, n);
+    sdcard_sim_write(path, file, size);
+}
+
+static void write_vorbis(const char *path) {
+    size = 0;
+    uint8_t head[30] = {1, 'v', 'o', 'r', 'b', 'i', 's'};
+    put_ogg_page(head, sizeof(head));
+    put_frames(mp3_frame, 1); // a sync word in the audio data
+    put("\x12\x34\x56\x78", 4);
+    sdcard_sim_write(path, file, size);
+}
+
+static void test_gain(const char *path, media_type_t type, int gain) {
+    media_format_t format;
+    CHECK_EQ(media_probe(path, &format), ESP_OK);
+    CHECK_EQ(format.type, type);
+    CHECK_EQ(format.gain, gain);
+}
+
+int main() {
+    sim_reset();
+    sdcard_sim_init();
+
+    write_mp3("/sdcard/v3.mp3", 3);
+    test_gain("/sdcard/v3.mp3", MEDIA_MP3, -654);
+    write_mp3("/sdcard/v4.mp3", 4);
+    test_gain("/sdcard/v4.mp3", MEDIA_MP3, -654);
+    write_flac("/sdcard/a.flac");
+    test_gain("/sdcard/a.flac", MEDIA_FLAC, 210);
+    write_opus("/sdcard/a.opus");
+    test_gain("/sdcard/a.opus", MEDIA_OPUS, -500); // -10 dB towards -23 LUFS
+
+    size = 0;
+    put_frames(mp3_frame, 2);
+    sdcard_sim_write("/sdcard/plain.mp3", file, size);
+    test_gain("/sdcard/plain.mp3", MEDIA_MP3, MEDIA_GAIN_NONE);
+
+    // layer II is not decoded, a single layer III header is no MP3 either
+    size = 0;
+    put_frames(mp2_frame, 2);
+    sdcard_sim_write("/sdcard/layer2.mp3", file, size);
+    media_format_t format;
+    CHECK_EQ(media_probe("/sdcard/layer2.mp3", &format), ESP_ERR_NOT_FOUND);
+    size = 0;
+    put("\0\0\0", 3);
+    put_frames(mp3_frame, 1);
+    put("\x12\x34\x56\x78", 4);
+    sdcard_sim_write("/sdcard/single.mp3", file, size);
+    CHECK_EQ(media_probe("/sdcard/single.mp3", &format), ESP_ERR_NOT_FOUND);
+    CHECK_EQ(format.type, MEDIA_UNKNOWN);
+
+    write_vorbis("/sdcard/vorbis.ogg");
+    CHECK_EQ(media_probe("/sdcard/vorbis.ogg", &format), ESP_ERR_NOT_SUPPORTED);
+    CHECK_EQ(format.type, MEDIA_UNKNOWN);
+
+    sdcard_sim_remove_all();
+    return sim_failures() != 0;
+}
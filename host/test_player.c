@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "player.h"
+#include "player_fsm.h"
+
+#include "sim.h"
+
+// every transition of the player state machine, and which queued events player_receive() hands out
+
+typedef struct {
+    player_state_t state;
+    player_event_type_t event;
+    player_state_t next;
+    player_action_t action;
+} transition_t;
+
+static const transition_t transitions[] = {
+    {PLAYER_IDLE, PLAYER_EVENT_TAG_PLACED, PLAYER_PLAYING, PLAYER_ACTION_PLAY},
+    {PLAYER_IDLE, PLAYER_EVENT_TAG_REMOVED, PLAYER_IDLE, PLAYER_ACTION_NONE},
+    {PLAYER_IDLE, PLAYER_EVENT_BUTTON, PLAYER_IDLE, PLAYER_ACTION_BUTTON},
+    {PLAYER_IDLE, PLAYER_EVENT_EOF, PLAYER_IDLE, PLAYER_ACTION_NONE},
+    {PLAYER_IDLE, PLAYER_EVENT_SHUTDOWN, PLAYER_SHUTTING_DOWN, PLAYER_ACTION_SHUTDOWN},
+
+    {PLAYER_PLAYING, PLAYER_EVENT_TAG_PLACED, PLAYER_PLAYING, PLAYER_ACTION_SWAP},
+    {PLAYER_PLAYING, PLAYER_EVENT_TAG_REMOVED, PLAYER_IDLE, PLAYER_ACTION_STOP},
+    {PLAYER_PLAYING, PLAYER_EVENT_BUTTON, PLAYER_PLAYING, PLAYER_ACTION_BUTTON},
+    {PLAYER_PLAYING, PLAYER_EVENT_EOF, PLAYER_PLAYING, PLAYER_ACTION_NEXT},
+    {PLAYER_PLAYING, PLAYER_EVENT_SHUTDOWN, PLAYER_SHUTTING_DOWN, PLAYER_ACTION_SHUTDOWN},
+
+    {PLAYER_SHUTTING_DOWN, PLAYER_EVENT_TAG_PLACED, PLAYER_SHUTTING_DOWN, PLAYER_ACTION_NONE},
+    {PLAYER_SHUTTING_DOWN, PLAYER_EVENT_TAG_REMOVED, PLAYER_SHUTTING_DOWN, PLAYER_ACTION_NONE},
+    {PLAYER_SHUTTING_DOWN, PLAYER_EVENT_BUTTON, PLAYER_SHUTTING_DOWN, PLAYER_ACTION_NONE},
+    {PLAYER_SHUTTING_DOWN, PLAYER_EVENT_EOF, PLAYER_ASLEEP, PLAYER_ACTION_SLEEP},
+    {PLAYER_SHUTTING_DOWN, PLAYER_EVENT_SHUTDOWN, PLAYER_SHUTTING_DOWN, PLAYER_ACTION_NONE},
+
+    {PLAYER_ASLEEP, PLAYER_EVENT_TAG_PLACED, PLAYER_ASLEEP, PLAYER_ACTION_NONE},
+    {PLAYER_ASLEEP, PLAYER_EVENT_TAG_REMOVED, PLAYER_ASLEEP, PLAYER_ACTION_NONE},
+    {PLAYER_ASLEEP, PLAYER_EVENT_BUTTON, PLAYER_ASLEEP, PLAYER_ACTION_NONE},
+    {PLAYER_ASLEEP, PLAYER_EVENT_EOF, PLAYER_ASLEEP, PLAYER_ACTION_NONE},
+    {PLAYER_ASLEEP, PLAYER_EVENT_SHUTDOWN, PLAYER_ASLEEP, PLAYER_ACTION_NONE},
+};
+#define TRANSITION_COUNT (sizeof(transitions) / sizeof(transitions[0]))
+
+static void test_transitions() {
+    CHECK_EQ(TRANSITION_COUNT, PLAYER_STATES * PLAYER_EVENTS);
+    for (int i = 0; i < TRANSITION_COUNT; i++) {
+        const transition_t *t = &transitions[i];
+        player_action_t action;
+        player_state_t next = player_transition(t->state, t->event, &action);
+        if (next != t->next || action != t->action) {
+            printf("%s + %s: %s, action %d\n", player_state_name(t->state), player_event_name(t->event),
+                    player_state_name(next), action);
+        }
+        CHECK_EQ(next, t->next);
+        CHECK_EQ(action, t->action);
+    }
+}
+
+static void post(player_event_type_t type, const char *no) {
+    player_event_t event = {.type = type};
+    strlcpy(event.no, no, sizeof(event.no));
+    CHECK_EQ(player_post(&event), ESP_OK);
+}
+
+static void expect(player_event_type_t type, const char *no) {
+    player_event_t event;
+    CHECK(player_receive(&event));
+    CHECK_EQ(event.type, type);
+    CHECK_EQ(strcmp(event.no, no), 0);
+}
+
+static void test_receive() {
+    player_init();
+
+    // a tag event with a newer tag event behind it is skipped, only the last one counts
+    post(PLAYER_EVENT_TAG_PLACED, "1111111111");
+    post(PLAYER_EVENT_TAG_REMOVED, "");
+    post(PLAYER_EVENT_TAG_PLACED, "2222222222");
+    expect(PLAYER_EVENT_TAG_PLACED, "2222222222");
+    player_event_t event;
+    CHECK(!player_receive(&event));
+
+    // other events in between keep both tag events, and are never skipped themselves
+    post(PLAYER_EVENT_TAG_PLACED, "1111111111");
+    post(PLAYER_EVENT_EOF, "");
+    post(PLAYER_EVENT_TAG_REMOVED, "");
+    post(PLAYER_EVENT_BUTTON, "");
+    post(PLAYER_EVENT_BUTTON, "");
+    post(PLAYER_EVENT_TAG_PLACED, "2222222222");
+    expect(PLAYER_EVENT_TAG_PLACED, "1111111111");
+    expect(PLAYER_EVENT_EOF, "");
+    expect(PLAYER_EVENT_TAG_REMOVED, "");
+    expect(PLAYER_EVENT_BUTTON, "");
+    expect(PLAYER_EVENT_BUTTON, "");
+    expect(PLAYER_EVENT_TAG_PLACED, "2222222222");
+    CHECK(!player_receive(&event));
+
+    // posting never blocks, a full queue drops
+    for (int i = 0; i < PLAYER_QUEUE_LENGTH; i++) {
+        post(PLAYER_EVENT_BUTTON, "");
+    }
+    player_event_t extra = {.type = PLAYER_EVENT_SHUTDOWN};
+    CHECK_EQ(player_post(&extra), ESP_ERR_TIMEOUT);
+    for (int i = 0; i < PLAYER_QUEUE_LENGTH; i++) {
+        expect(PLAYER_EVENT_BUTTON, "");
+    }
+    CHECK(!player_receive(&event));
+}
+
+int main() {
+    sim_reset();
+    test_transitions();
+    test_receive();
+    return sim_failures() != 0;
+}
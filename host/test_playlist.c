@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "playlist.h"
+#include "seek_index.h"
+
+#include "sim.h"
+#include "sdcard_sim.h"
+#include "mp3_sim.h"
+
+// playlist on the simulated card: m3u entries that are too long, missing or in Windows format, and names as long as FAT allows
+
+static void test_m3u_skips_bad_entries() {
+    sim_reset();
+    sdcard_sim_init();
+    CHECK_EQ(playlist_init(), ESP_OK);
+    sdcard_sim_write("/sdcard/a.mp3", "", 0);
+    sdcard_sim_write("/sdcard/b.mp3", "", 0);
+    char long_name[256 - 8 + 1]; // /sdcard/ and the rest of a full line
+    memset(long_name, 'n', sizeof(long_name) - 1);
+    strcpy(long_name + sizeof(long_name) - 5, ".mp3");
+    char long_path[PLAYLIST_PATH_MAX];
+    snprintf(long_path, sizeof(long_path), "/sdcard/%s", long_name);
+    sdcard_sim_write(long_path, "", 0);
+
+    char long_line[400];
+    memset(long_line, 'x', sizeof(long_line) - 1);
+    long_line[sizeof(long_line) - 1] = 0;
+    char m3u[1024];
+    snprintf(m3u, sizeof(m3u),
+            "\xEF\xBB\xBF#EXTM3U\r\n"
+            "a.mp3\r\n"
+            "%s.mp3\r\n" // longer than a line, its rest must not become an entry
+            "%s\r\n" // as long as a line may be
+            "missing.mp3\r\n"
+            "\r\n"
+            "/sdcard/b.mp3", long_line, long_name); // no line end
+    sdcard_sim_write("/sdcard/1234567890.m3u", m3u, strlen(m3u));
+
+    CHECK_EQ(playlist_load("1234567890", TAG_KIND_PLAYLIST, NULL), ESP_OK);
+    CHECK_EQ(playlist_count(), 3);
+    char path[PLAYLIST_PATH_MAX];
+    CHECK(playlist_path(0, path));
+    CHECK_EQ(strcmp(path, "/sdcard/a.mp3"), 0);
+    CHECK(playlist_path(1, path));
+    CHECK_EQ(strcmp(path, long_path), 0);
+    CHECK(playlist_path(2, path));
+    CHECK_EQ(strcmp(path, "/sdcard/b.mp3"), 0);
+    sdcard_sim_remove_all();
+}
+
+// a directory entry with a 255 character name is played and seekable
+static void test_long_names() {
+    sim_reset();
+    sdcard_sim_init();
+    CHECK_EQ(mkdir("/sdcard/1234567890", 0755), 0);
+    sdcard_sim_write("/sdcard/1234567890/01.mp3", "", 0);
+    char name[255 + 1];
+    memset(name, 'n', sizeof(name) - 1);
+    strcpy(name + sizeof(name) - 5, ".mp3");
+    name[0] = '0';
+    name[1] = '2';
+    char long_path[PLAYLIST_PATH_MAX];
+    CHECK(snprintf(long_path, sizeof(long_path), "/sdcard/1234567890/%s", name) < (int) sizeof(long_path));
+    mp3_sim_write(long_path, 100, 128, 1, NULL);
+
+    CHECK_EQ(playlist_load("1234567890", TAG_KIND_DIRECTORY, NULL), ESP_OK);
+    CHECK_EQ(playlist_count(), 2);
+    char path[PLAYLIST_PATH_MAX];
+    CHECK(playlist_path(1, path));
+    CHECK_EQ(strcmp(path, long_path), 0);
+    CHECK_EQ(playlist_index(long_path), 1);
+
+    CHECK_EQ(seek_index_build(path), ESP_OK);
+    seek_index_t index;
+    CHECK_EQ(seek_index_open(&index, path), ESP_OK);
+    CHECK(index.entries > 0);
+    CHECK_EQ(strcmp(index.path, long_path), 0);
+    seek_index_close(&index);
+    sdcard_sim_remove_all();
+}
+
+int main() {
+    test_m3u_skips_bad_entries();
+    test_long_names();
+    return sim_failures() != 0;
+}
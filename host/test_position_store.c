@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "nvs.h"
+
+#include "position_store.h"
+
+#include "sim.h"
+#include "nvs_sim.h"
+#include "sdcard_sim.h"
+#include "mp3_sim.h"
+
+/*
+ * position_store on the NVS page model: millions of position updates as sound_task makes them (one every
+ * 2 s while a tag plays), sessions ending with a removal flush and finished tracks erasing their key.
+ * Counts the flash entries written and the erase cycles per page, and projects the lifetime of the partition.
+ * Byte offsets of the former "position" namespace are converted into ms on the first lookup of a tag.
+ */
+
+#define UPDATES 3000000 // ~70 days of playback
+#define UPDATE_MS 2000 // sound_task loop while playing
+#define TAGS 40
+#define FLASH_ERASE_CYCLES 100000
+#define HOURS_PER_DAY 2
+
+static char tags[TAGS][11];
+
+static int64_t stored_in(const char *ns, const char *no) {
+    nvs_handle_t nvs;
+    int64_t position = -1;
+    if (nvs_open(ns, NVS_READONLY, &nvs) == ESP_OK) {
+        nvs_get_i64(nvs, no, &position);
+        nvs_close(nvs);
+    }
+    return position;
+}
+
+static int64_t stored(const char *no) {
+    return stored_in("resume", no);
+}
+
+static void legacy_set(const char *no, int64_t offset) {
+    nvs_handle_t nvs;
+    CHECK_EQ(nvs_open("position", NVS_READWRITE, &nvs), ESP_OK);
+    CHECK_EQ(nvs_set_i64(nvs, no, offset), ESP_OK);
+    nvs_commit(nvs);
+    nvs_close(nvs);
+}
+
+// byte offsets of the former namespace become ms once the tag is looked up, keys of missing files are kept
+static void test_legacy_migration() {
+    sim_reset();
+    nvs_sim_reset();
+    sdcard_sim_init();
+    uint32_t offsets[2001];
+    mp3_sim_write("/sdcard/1111111111.mp3", 2000, 128, 1, offsets);
+    mp3_sim_write("/sdcard/3333333333.mp3", 2000, 0, 3, NULL);
+    legacy_set("1111111111", offsets[1000]); // frame 1000, 26.1 s
+    legacy_set("2222222222", 500000); // file not on the card yet
+    legacy_set("3333333333", 100000000); // beyond the end
+    CHECK_EQ(position_store_init(), ESP_OK);
+
+    int64_t position;
+    CHECK(position_store_get("1111111111", &position));
+    CHECK_EQ(POSITION_TRACK(position), 0);
+    int64_t error_ms = POSITION_MS(position) - mp3_sim_frame_ms(1000);
+    CHECK(error_ms >= -26 && error_ms <= 26); // within a frame
+    CHECK_EQ(stored_in("position", "1111111111"), offsets[1000]); // until the flush
+    CHECK(!position_store_get("2222222222", &position));
+    CHECK_EQ(stored_in("position", "2222222222"), 500000);
+    CHECK(!position_store_get("3333333333", &position));
+    CHECK_EQ(stored_in("position", "3333333333"), -1);
+
+    CHECK_EQ(position_store_flush(), ESP_OK);
+    CHECK_EQ(stored("1111111111"), POSITION_MAKE(0, mp3_sim_frame_ms(1000) + error_ms));
+    CHECK_EQ(stored_in("position", "1111111111"), -1);
+    CHECK(position_store_get("1111111111", &position)); // from RAM now
+
+    mp3_sim_write("/sdcard/2222222222.mp3", 2000, 128, 2, offsets); // card updated, the tag resolves
+    CHECK(position_store_get("2222222222", &position));
+    CHECK(POSITION_MS(position) > 0);
+    position_store_erase("2222222222"); // played to the end before the next flush
+    CHECK_EQ(position_store_flush(), ESP_OK);
+    CHECK_EQ(stored_in("position", "2222222222"), -1);
+    CHECK_EQ(stored("2222222222"), -1);
+    sdcard_sim_remove_all();
+}
+
+static void test_erase_cycles() {
+    sim_reset();
+    nvs_sim_reset();
+    nvs_handle_t config;
+    CHECK_EQ(nvs_open("config", NVS_READWRITE, &config), ESP_OK);
+    CHECK_EQ(nvs_set_i32(config, "volume", 42), ESP_OK);
+    nvs_commit(config);
+    CHECK_EQ(position_store_init(), ESP_OK);
+    for (int i = 0; i < TAGS; i++) {
+        sprintf(tags[i], "%02x%08x", i, 0xc0ffee00 + i * 7919);
+    }
+
+    srand(7);
+    uint32_t updates = 0;
+    uint32_t sessions = 0;
+    uint32_t finished = 0;
+    const char *no = NULL;
+    int64_t ms = 0;
+    while (updates < UPDATES) {
+        no = tags[rand() % TAGS];
+        int length = 150 + rand() % 1650; // 5 .. 60 minutes
+        ms = 0;
+        if (!position_store_get(no, &ms)) {
+            ms = 0;
+        }
+        for (int i = 0; i < length && updates < UPDATES; i++) {
+            sim_advance_us(UPDATE_MS * 1000);
+            ms += UPDATE_MS;
+            position_store_set(no, POSITION_MAKE(0, ms));
+            position_store_flush_if_due();
+            updates++;
+        }
+        if (rand() % 10 == 0) { // played to the end
+            position_store_erase(no);
+            finished++;
+        }
+        position_store_flush(); // tag removed
+        sessions++;
+    }
+
+    const nvs_sim_stats_t *nvs = nvs_sim_stats();
+    uint32_t min_erases = UINT32_MAX;
+    uint32_t max_erases = 0;
+    for (int i = 0; i < NVS_SIM_PAGES; i++) {
+        min_erases = nvs->erase_counts[i] < min_erases ? nvs->erase_counts[i] : min_erases;
+        max_erases = nvs->erase_counts[i] > max_erases ? nvs->erase_counts[i] : max_erases;
+    }
+    double hours = (double) updates * UPDATE_MS / 3600000.0;
+    double years = (double) FLASH_ERASE_CYCLES / max_erases * hours / HOURS_PER_DAY / 365.0;
+    printf("%" PRIu32 " updates in %" PRIu32 " sessions (%" PRIu32 " finished), %.0f hours of playback\n",
+            updates, sessions, finished, hours);
+    printf("%" PRIu32 " position writes, %" PRIu32 " NVS entries written (%" PRIu32 " moved by compaction), %" PRIu32
+            " commits, %" PRIu32 " page erases\n", position_store_writes(), nvs->entry_writes, nvs->moved,
+            nvs->commits, nvs->page_erases);
+    printf("erases per page:");
+    for (int i = 0; i < NVS_SIM_PAGES; i++) {
+        printf(" %" PRIu32, nvs->erase_counts[i]);
+    }
+    printf("\n%.0f years at %d hours per day until a page reaches %d erase cycles\n", years, HOURS_PER_DAY,
+            FLASH_ERASE_CYCLES);
+
+    // one write per POSITION_STORE_FLUSH_INTERVAL_MS and tag at most, plus the removal flushes
+    CHECK(position_store_writes() <= updates / (POSITION_STORE_FLUSH_INTERVAL_MS / UPDATE_MS) + sessions);
+    CHECK(nvs->entry_writes < updates / 10);
+    CHECK(max_erases <= 2 * nvs->page_erases / NVS_SIM_PAGES); // no page takes much more than its share
+    CHECK(years > 10);
+    CHECK(nvs_sim_live_entries() <= NVS_SIM_PAGES * NVS_SIM_PAGE_ENTRIES);
+
+    // nothing else was lost on the way
+    int32_t volume = 0;
+    CHECK_EQ(nvs_get_i32(config, "volume", &volume), ESP_OK);
+    CHECK_EQ(volume, 42);
+    nvs_close(config);
+    int64_t position;
+    if (position_store_get(no, &position)) {
+        CHECK_EQ(stored(no), position);
+    } else {
+        CHECK_EQ(stored(no), -1);
+    }
+}
+
+int main() {
+    test_legacy_migration();
+    test_erase_cycles();
+    return sim_failures() != 0;
+}
@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+
+#include "rc522.h"
+#include "rfid_poll.h"
+#include "player.h"
+
+#include "sim.h"
+#include "rc522_sim.h"
+
+// RC522 driver against the register model of rc522_sim
+
+static const uint8_t uid[4] = {0x11, 0x22, 0x33, 0x44};
+static const uint8_t other_uid[4] = {0xa0, 0x5b, 0x7c, 0x01};
+static rc522_uid_t present;
+
+static void reader_setup(int irq_gpio, bool wired) {
+    sim_reset();
+    rc522_sim_reset();
+    CHECK_EQ(rc522_init(), ESP_OK);
+    rc522_enable_cache(true);
+    if (irq_gpio != GPIO_NUM_NC) {
+        rc522_sim_wire_irq(wired ? irq_gpio : -1);
+        CHECK_EQ(rc522_enable_irq(irq_gpio), ESP_OK);
+    }
+}
+
+// with the IRQ pin wired, nothing is read while a frame is in the air: one ComIrq read per frame after the edge
+static void test_irq_no_traffic_while_waiting() {
+    reader_setup(GPIO_NUM_22, true);
+    rc522_sim_place(uid);
+    rc522_uid_t read;
+    for (int i = 0; i < 20; i++) {
+        CHECK_EQ(i % RFID_VERIFY_EVERY == 0 ? rc522_read_tag(&read) : rc522_is_present(&read), ESP_OK);
+        vTaskDelay(RFID_POLL_MAX_MS / portTICK_PERIOD_MS);
+    }
+    CHECK_EQ(memcmp(read.bytes, uid, 4), 0);
+    CHECK_EQ(rc522_sim_waiting_transactions(), 0);
+    CHECK_EQ(rc522_sim_reads(0x04), rc522_sim_frames());
+
+    rc522_sim_remove(); // the timer ends the wait, still by IRQ
+    uint32_t frames = rc522_sim_frames();
+    uint32_t irq_reads = rc522_sim_reads(0x04);
+    CHECK_EQ(rc522_read_tag(&read), ESP_ERR_NOT_FOUND);
+    CHECK_EQ(rc522_sim_waiting_transactions(), 0);
+    CHECK_EQ(rc522_sim_reads(0x04) - irq_reads, rc522_sim_frames() - frames);
+    rc522_clear();
+}
+
+// between two polls of a stable card the bus is idle
+static void test_no_traffic_between_polls() {
+    reader_setup(GPIO_NUM_22, true);
+    rc522_sim_place(uid);
+    CHECK_EQ(rc522_is_present(&present), ESP_OK);
+    uint32_t transactions = rc522_sim_transactions();
+    vTaskDelay(RFID_POLL_MAX_MS / portTICK_PERIOD_MS);
+    CHECK_EQ(rc522_sim_transactions(), transactions);
+    rc522_clear();
+}
+
+// without the pin ComIrq is polled while waiting, which the IRQ mode saves
+static void test_polling_reads_while_waiting() {
+    reader_setup(GPIO_NUM_NC, false);
+    rc522_sim_place(uid);
+    uint32_t transactions = rc522_sim_transactions();
+    CHECK_EQ(rc522_is_present(&present), ESP_OK);
+    uint32_t polling = rc522_sim_transactions() - transactions;
+    CHECK(rc522_sim_waiting_transactions() > 0);
+    rc522_clear();
+
+    reader_setup(GPIO_NUM_22, true);
+    rc522_sim_place(uid);
+    transactions = rc522_sim_transactions();
+    CHECK_EQ(rc522_is_present(&present), ESP_OK);
+    uint32_t irq = rc522_sim_transactions() - transactions;
+    printf("rc522_is_present: %u I2C transactions polling ComIrq, %u with the IRQ pin\n", polling, irq);
+    CHECK(irq < polling);
+    rc522_clear();
+}
+
+// IRQ enabled on a pin that is not connected: every frame waits RC522_IRQ_TIMEOUT_MS before falling back
+static void test_unconnected_pin_costs_timeout() {
+    reader_setup(GPIO_NUM_22, false);
+    rc522_sim_place(uid);
+    int64_t start = sim_now_us();
+    CHECK_EQ(rc522_is_present(&present), ESP_OK); // WUPA, anticollision and HLTA
+    int64_t unconnected_us = sim_now_us() - start;
+    rc522_clear();
+
+    reader_setup(GPIO_NUM_22, true);
+    rc522_sim_place(uid);
+    start = sim_now_us();
+    CHECK_EQ(rc522_is_present(&present), ESP_OK);
+    int64_t wired_us = sim_now_us() - start;
+    printf("rc522_is_present: %lld us with the IRQ pin, %lld us with an unconnected pin\n",
+            (long long) wired_us, (long long) unconnected_us);
+    CHECK(unconnected_us >= 3 * 50000);
+    CHECK(wired_us < 50000); // the HLTA is not answered, the reader timer ends it
+    rc522_clear();
+}
+
+// a tag placed right after a poll without tag is posted within 300 ms
+static void test_detection_latency() {
+    reader_setup(GPIO_NUM_22, true);
+    player_init();
+    rfid_poll_t poll;
+    rfid_poll_init(&poll);
+    for (int i = 0; i < 10; i++) { // backed off to RFID_POLL_INTERVAL_MS
+        rfid_poll(&poll);
+        vTaskDelay(poll.interval_ms / portTICK_PERIOD_MS);
+    }
+    rfid_poll(&poll);
+    int64_t placed = sim_now_us();
+    rc522_sim_place(uid);
+    while (poll.stats.posts == 0) {
+        vTaskDelay(poll.interval_ms / portTICK_PERIOD_MS);
+        rfid_poll(&poll);
+    }
+    player_event_t event;
+    CHECK(player_receive(&event));
+    CHECK_EQ(event.type, PLAYER_EVENT_TAG_PLACED);
+    printf("tag placed after a poll: posted after %lld ms\n", (long long) (event.posted_us - placed) / 1000);
+    CHECK(event.posted_us - placed < 300000);
+    rc522_clear();
+}
+
+// registers the driver shadows, see RC522_CACHEABLE
+static const uint8_t cacheable[] = {0x02, 0x03, 0x0D, 0x11, 0x12, 0x13, 0x14, 0x15, 0x24, 0x26, 0x2A, 0x2B, 0x2C, 0x2D};
+#define CACHEABLE_COUNT (sizeof(cacheable) / sizeof(cacheable[0]))
+
+static bool cache_coherent() {
+    for (int i = 0; i < CACHEABLE_COUNT; i++) {
+        if (rc522_read(cacheable[i]) != rc522_sim_register(cacheable[i])) {
+            printf("register 0x%02x: driver 0x%02x, reader 0x%02x\n", cacheable[i], rc522_read(cacheable[i]),
+                    rc522_sim_register(cacheable[i]));
+            return false;
+        }
+    }
+    return true;
+}
+
+// random writes, bit operations, failed writes and frames: the shadow always matches the register file
+static void test_cache_coherence() {
+    reader_setup(GPIO_NUM_NC, false);
+    rc522_sim_place(uid);
+    srand(4);
+    int incoherent = 0;
+    for (int i = 0; i < 20000; i++) {
+        uint8_t reg = cacheable[rand() % CACHEABLE_COUNT];
+        uint8_t val = rand() & 0x7F; // no StartSend
+        if (rand() % 8 == 0) {
+            rc522_sim_fail_writes(1);
+        }
+        switch (rand() % 5) {
+            case 0:
+                rc522_write(reg, val);
+                break;
+            case 1:
+                rc522_set_bitmask(reg, val);
+                break;
+            case 2:
+                rc522_clear_bitmask(reg, val);
+                break;
+            case 3:
+                rc522_write_n(reg, 3, (uint8_t[]) {val, val ^ 0x55, val ^ 0x0F}); // the register keeps the last byte
+                break;
+            default:
+                rc522_sim_fail_writes(0);
+                rc522_write(0x0D, 0x00);
+                rc522_is_present(&present);
+                break;
+        }
+        rc522_sim_fail_writes(0);
+        if (!cache_coherent()) {
+            incoherent++;
+        }
+    }
+    CHECK_EQ(incoherent, 0);
+    rc522_clear();
+}
+
+// with a warm shadow a bit operation is one write, status and FIFO registers are read from the bus every time
+static void test_cache_saves_reads() {
+    reader_setup(GPIO_NUM_NC, false);
+    rc522_read(0x14);
+    uint32_t transactions = rc522_sim_transactions();
+    CHECK_EQ(rc522_set_bitmask(0x14, 0x03), ESP_OK);
+    CHECK_EQ(rc522_sim_transactions() - transactions, 1);
+    CHECK_EQ(rc522_sim_register(0x14) & 0x03, 0x03);
+
+    uint8_t volatile_regs[] = {0x04, 0x05, 0x06, 0x09, 0x0A, 0x0C};
+    for (int i = 0; i < sizeof(volatile_regs); i++) {
+        uint32_t reads = rc522_sim_reads(volatile_regs[i]);
+        rc522_read(volatile_regs[i]);
+        rc522_read(volatile_regs[i]);
+        CHECK_EQ(rc522_sim_reads(volatile_regs[i]) - reads, 2);
+    }
+
+    rc522_enable_cache(false); // every read goes to the bus again
+    uint32_t reads = rc522_sim_reads(0x14);
+    rc522_read(0x14);
+    CHECK_EQ(rc522_sim_reads(0x14) - reads, 1);
+    rc522_clear();
+}
+
+// a figure swapped between two polls is reported by the cheap check too, with its own UID
+static void test_presence_check_reports_swap() {
+    reader_setup(GPIO_NUM_NC, false);
+    rc522_sim_place(uid);
+    rc522_uid_t read;
+    CHECK_EQ(rc522_read_tag(&read), ESP_OK);
+    CHECK_EQ(rc522_is_present(&present), ESP_OK);
+    CHECK_EQ(memcmp(present.bytes, read.bytes, RC522_UID_SIZE), 0);
+    rc522_sim_place(other_uid);
+    CHECK_EQ(rc522_is_present(&present), ESP_OK);
+    CHECK_EQ(memcmp(present.bytes, other_uid, 4), 0);
+    CHECK_EQ(rc522_is_present(&present), ESP_OK); // the HLTA left it in IDLE, WUPA wakes it again
+    rc522_sim_remove();
+    CHECK_EQ(rc522_is_present(&present), ESP_ERR_NOT_FOUND);
+    rc522_clear();
+}
+
+int main() {
+    test_irq_no_traffic_while_waiting();
+    test_no_traffic_between_polls();
+    test_polling_reads_while_waiting();
+    test_unconnected_pin_costs_timeout();
+    test_detection_latency();
+    test_cache_coherence();
+    test_cache_saves_reads();
+    test_presence_check_reports_swap();
+    return sim_failures() != 0;
+}
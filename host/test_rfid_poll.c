@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+
+#include "rc522.h"
+#include "rfid_poll.h"
+#include "player.h"
+
+#include "sim.h"
+#include "rc522_sim.h"
+#include "heap_sim.h"
+
+// rfid_poll on the simulated reader: heap use of the detection loop, swaps while backed off
+
+static const uint8_t uid[4] = {0x11, 0x22, 0x33, 0x44};
+static const uint8_t other_uid[4] = {0xa0, 0x5b, 0x7c, 0x01};
+
+static void reader_setup() {
+    sim_reset();
+    rc522_sim_reset();
+    CHECK_EQ(rc522_init(), ESP_OK);
+    rc522_enable_cache(true);
+    player_init();
+}
+
+static void drain() {
+    player_event_t event;
+    while (player_receive(&event)) {
+    }
+}
+
+static void run_polls(rfid_poll_t *poll, int n) {
+    for (int i = 0; i < n; i++) {
+        rfid_poll(poll);
+        drain();
+        vTaskDelay(poll->interval_ms / portTICK_PERIOD_MS);
+    }
+}
+
+// steady state, with and without tag and across a change, does not touch the heap
+static void test_steady_state_allocation_free() {
+    reader_setup();
+    rfid_poll_t poll;
+    rfid_poll_init(&poll);
+    run_polls(&poll, 5);
+
+    uint32_t allocations = heap_sim_allocations();
+    run_polls(&poll, 100); // no tag
+    rc522_sim_place(uid);
+    run_polls(&poll, 100); // verify reads and presence checks
+    rc522_sim_remove();
+    run_polls(&poll, 20); // removal confirmed by re-reads
+    uint32_t polls_allocations = heap_sim_allocations() - allocations;
+    printf("220 polls: %u heap allocations\n", polls_allocations);
+    CHECK_EQ(polls_allocations, 0);
+    CHECK_EQ(poll.stats.posts, 2);
+    rc522_clear();
+}
+
+// the legacy API still allocates per read, the reason rfid_poll does not use it
+static void test_legacy_api_allocates() {
+    reader_setup();
+    rc522_sim_place(uid);
+    uint32_t allocations = heap_sim_allocations();
+    uint32_t frees = heap_sim_frees();
+    uint8_t *tag = rc522_get_tag();
+    CHECK(tag != NULL);
+    free(tag);
+    CHECK(heap_sim_allocations() - allocations > 0);
+    CHECK_EQ(heap_sim_allocations() - allocations, heap_sim_frees() - frees);
+    rc522_clear();
+}
+
+// a figure swapped for another one while the polls are backed off is posted at the next poll
+static void test_swap_while_backed_off() {
+    reader_setup();
+    rfid_poll_t poll;
+    rfid_poll_init(&poll);
+    rc522_sim_place(uid);
+    run_polls(&poll, 12);
+    CHECK_EQ(poll.interval_ms, RFID_POLL_MAX_MS);
+    for (int phase = 0; phase < RFID_VERIFY_EVERY; phase++) { // the swap lands before every kind of poll
+        const uint8_t *next = phase % 2 == 0 ? other_uid : uid;
+        rc522_sim_place(next);
+        uint32_t posts = poll.stats.posts;
+        int64_t swapped = sim_now_us();
+        int polls = 0;
+        while (poll.stats.posts == posts && polls++ < 10) {
+            vTaskDelay(poll.interval_ms / portTICK_PERIOD_MS);
+            rfid_poll(&poll);
+        }
+        player_event_t event;
+        CHECK(player_receive(&event));
+        CHECK_EQ(event.type, PLAYER_EVENT_TAG_PLACED);
+        printf("swap %d: posted after %d polls, %lld ms\n", phase, polls, (long long) (sim_now_us() - swapped) / 1000);
+        CHECK_EQ(polls, 1);
+        drain();
+        run_polls(&poll, 5 + phase); // backed off again, at another verify phase
+    }
+    rc522_clear();
+}
+
+int main() {
+    test_steady_state_allocation_free();
+    test_legacy_api_allocates();
+    test_swap_while_backed_off();
+    return sim_failures() != 0;
+}
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "seek_scrub.h"
+#include "seek_index.h"
+#include "player_action.h"
+#include "audio_engine.h"
+
+#include "sim.h"
+#include "sdcard_sim.h"
+#include "audio_sim.h"
+#include "mp3_sim.h"
+
+// hold-to-seek: the speed curve, the target independent of when the steps run, and where a release lands in a file
+
+#define FRAME_MS 27 // MP3 frame at 44.1 kHz, rounded up
+#define TRACK_FRAMES 23000 // 10 min
+
+static void test_speed_curve() {
+    CHECK_EQ(seek_scrub_speed(0), SEEK_SCRUB_START_SPEED);
+    for (int k = 1; k <= 3; k++) { // doubles every SEEK_SCRUB_DOUBLING_MS
+        int64_t at_us = k * SEEK_SCRUB_DOUBLING_MS * 1000LL;
+        CHECK_EQ(seek_scrub_speed(at_us), SEEK_SCRUB_START_SPEED << k);
+        CHECK(seek_scrub_speed(at_us - 1000) < SEEK_SCRUB_START_SPEED << k);
+    }
+    CHECK_EQ(seek_scrub_speed(11000000), SEEK_SCRUB_MAX_SPEED);
+    CHECK_EQ(seek_scrub_speed(60000000), SEEK_SCRUB_MAX_SPEED);
+
+    int last = 0;
+    for (int64_t held_ms = 0; held_ms < 30000; held_ms += 100) {
+        int speed = seek_scrub_speed(held_ms * 1000);
+        CHECK(speed >= last && speed <= SEEK_SCRUB_MAX_SPEED);
+        last = speed;
+        // the distance grows by the speed, seconds per second are ms per ms
+        int64_t grown = seek_scrub_distance_ms((held_ms + 100) * 1000) - seek_scrub_distance_ms(held_ms * 1000);
+        CHECK(grown >= speed * 100 - 1 && grown <= (seek_scrub_speed((held_ms + 100) * 1000) + 1) * 100);
+    }
+    CHECK_EQ(seek_scrub_distance_ms(0), 0);
+    CHECK_EQ(seek_scrub_distance_ms(-1000), 0);
+}
+
+// the same release time gives the same target however the steps were spread
+static void test_steps_independent() {
+    seek_scrub_t regular;
+    seek_scrub_t jittered;
+    int64_t start_us = 5000000;
+    int64_t release_us = start_us + 14300000;
+    seek_scrub_start(&regular, 1, 60000, 3600000, start_us);
+    seek_scrub_start(&jittered, 1, 60000, 3600000, start_us);
+    for (int64_t t = start_us; t < release_us; t += SEEK_SCRUB_STEP_MS * 1000) {
+        seek_scrub_step(&regular, t);
+    }
+    srand(1);
+    for (int64_t t = start_us; t < release_us; t += SEEK_SCRUB_STEP_MS * 1000 + rand() % 200000) {
+        seek_scrub_step(&jittered, t);
+    }
+    CHECK(seek_scrub_step(&regular, release_us));
+    CHECK(seek_scrub_step(&jittered, release_us));
+    CHECK_EQ(regular.target_ms, 60000 + seek_scrub_distance_ms(release_us - start_us));
+    CHECK_EQ(jittered.target_ms, regular.target_ms);
+    CHECK_EQ(seek_scrub_due_ms(&regular, release_us), SEEK_SCRUB_STEP_MS);
+
+    // clamped at both ends, never backwards when pressed within the end margin
+    seek_scrub_t scrub;
+    seek_scrub_start(&scrub, -1, 20000, 600000, 0);
+    seek_scrub_step(&scrub, 10000000);
+    CHECK_EQ(scrub.target_ms, 0);
+    seek_scrub_start(&scrub, 1, 500000, 600000, 0);
+    seek_scrub_step(&scrub, 10000000);
+    CHECK_EQ(scrub.target_ms, 600000 - SEEK_SCRUB_END_MARGIN_MS);
+    seek_scrub_start(&scrub, 1, 598000, 600000, 0);
+    CHECK(!seek_scrub_step(&scrub, 10000000));
+    CHECK_EQ(scrub.target_ms, 598000);
+}
+
+// holding the button in the player: the release lands on the frame of its target
+static void test_release_lands(int kbps, int direction, int64_t held_ms) {
+    sim_reset();
+    sdcard_sim_init();
+    audio_sim_reset();
+    static uint32_t offsets[TRACK_FRAMES + 1];
+    mp3_sim_write("/sdcard/1111111111.mp3", TRACK_FRAMES, kbps, 1, offsets);
+    CHECK_EQ(seek_index_build("/sdcard/1111111111.mp3"), ESP_OK);
+    seek_index_t index;
+    CHECK_EQ(seek_index_open(&index, "/sdcard/1111111111.mp3"), ESP_OK);
+
+    uint32_t frame = TRACK_FRAMES / 2;
+    CHECK_EQ(audio_engine_play("/sdcard/1111111111.mp3", offsets[frame]), ESP_OK);
+    seek_scrub_t scrub;
+    seek_scrub_stop(&scrub);
+    player_scrub_start(&index, &scrub, true, direction, false);
+    int64_t start_ms = scrub.start_ms;
+    CHECK(llabs(start_ms - mp3_sim_frame_ms(frame)) <= FRAME_MS);
+    int64_t pressed_us = scrub.pressed_us;
+    int64_t release_us = pressed_us + held_ms * 1000;
+    while (sim_now_us() < release_us) {
+        int timeout_ms = player_scrub_step(&index, &scrub, 2000);
+        int64_t next = sim_now_us() + timeout_ms * 1000LL;
+        sim_advance_us((next < release_us ? next : release_us) - sim_now_us());
+    }
+    uint32_t seeks = audio_sim()->seeks;
+    player_scrub_release(&index, &scrub, false);
+    CHECK_EQ(audio_sim()->seeks, seeks + 1);
+
+    int64_t target = start_ms + direction * seek_scrub_distance_ms(release_us - pressed_us);
+    uint32_t i = 0;
+    while (i < TRACK_FRAMES && offsets[i] < audio_sim()->start_pos) {
+        i++;
+    }
+    CHECK_EQ(offsets[i], audio_sim()->start_pos); // on a frame header
+    int64_t landed = mp3_sim_frame_ms(i);
+    printf("%3d kbit/s, %+d, held %5" PRId64 " ms: %4" PRIu32 " seeks, target %7" PRId64 " ms, landed %7" PRId64 " ms\n",
+            kbps, direction, held_ms, seeks, target, landed);
+    CHECK(llabs(landed - target) <= FRAME_MS);
+    seek_index_close(&index);
+    sdcard_sim_remove_all();
+}
+
+int main() {
+    test_speed_curve();
+    test_steps_independent();
+    test_release_lands(128, 1, 7300);
+    test_release_lands(128, -1, 8100);
+    test_release_lands(0, 1, 4700);
+    test_release_lands(0, -1, 6900);
+    return sim_failures() != 0;
+}
@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "tag_catalog.h"
+
+#include "sim.h"
+#include "sdcard_sim.h"
+
+// tag_catalog on the simulated card: kinds and sizes, catalog.bin reused across boots and rebuilt when a file
+// is replaced under the same name
+
+static char data[4096];
+
+static void expect(const char *no, tag_kind_t kind, uint32_t size, const char *extension) {
+    uint32_t found_size;
+    const char *found_extension;
+    CHECK_EQ(tag_catalog_lookup(no, &found_size, &found_extension), kind);
+    if (kind == TAG_KIND_FILE) {
+        CHECK_EQ(found_size, size);
+        CHECK_EQ(strcmp(found_extension, extension), 0);
+    }
+}
+
+int main() {
+    sim_reset();
+    sdcard_sim_init();
+    sdcard_sim_write("/sdcard/aabbccddee.mp3", data, 1000);
+    sdcard_sim_write("/sdcard/0011223344.mp3", data, 500);
+    sdcard_sim_write("/sdcard/0011223344.flac", data, 3000); // not MP3 wins
+    sdcard_sim_write("/sdcard/5566778899.m3u", "aabbccddee.mp3\n", 15);
+    sdcard_sim_write("/sdcard/system_beep.mp3", data, 100);
+    CHECK_EQ(mkdir("/sdcard/1122334455", 0755), 0);
+
+    CHECK_EQ(tag_catalog_init(), ESP_OK);
+    expect("aabbccddee", TAG_KIND_FILE, 1000, "mp3");
+    expect("0011223344", TAG_KIND_FILE, 3000, "flac");
+    expect("5566778899", TAG_KIND_PLAYLIST, 0, NULL);
+    expect("1122334455", TAG_KIND_DIRECTORY, 0, NULL);
+    expect("ffffffffff", TAG_KIND_NONE, 0, NULL);
+    tag_catalog_flush(); // the _miss marker of the unknown tag, which does not change the catalog
+    struct stat st;
+    CHECK_EQ(stat(TAG_CATALOG_FILE, &st), 0);
+    CHECK_EQ(stat("/sdcard/ffffffffff.mp3_miss", &st), 0);
+
+    // next boot, nothing changed: the catalog is loaded, not looked up on the card
+    uint32_t accesses = sdcard_sim_accesses();
+    CHECK_EQ(tag_catalog_init(), ESP_OK);
+    CHECK(sdcard_sim_accesses() - accesses <= 2); // the directory and catalog.bin
+    expect("aabbccddee", TAG_KIND_FILE, 1000, "mp3");
+    expect("ffffffffff", TAG_KIND_NONE, 0, NULL);
+
+    // a file replaced under its name: same names, another size
+    sdcard_sim_write("/sdcard/aabbccddee.mp3", data, 2000);
+    CHECK_EQ(tag_catalog_init(), ESP_OK);
+    expect("aabbccddee", TAG_KIND_FILE, 2000, "mp3");
+    expect("0011223344", TAG_KIND_FILE, 3000, "flac");
+
+    sdcard_sim_remove_all();
+    return sim_failures() != 0;
+}
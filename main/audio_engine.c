@@ -0,0 +1,449 @@
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "audio_pipeline.h"
+#include "audio_common.h"
+#include "i2s_stream.h"
+#include "mp3_decoder.h"
+#include "aac_decoder.h"
+#include "opus_decoder.h"
+#include "flac_decoder.h"
+#include "periph_button.h"
+#include "filter_resample.h"
+
+#include "audio_engine.h"
+#include "gain_filter.h"
+#include "media_probe.h"
+#include "monitor.h"
+#include "power.h"
+#include "storage.h"
+#include "system_sound.h"
+#include "tasks.h"
+#include "track_stream.h"
+
+static const char *TAG = "ENGINE";
+
+static audio_board_handle_t board = NULL;
+static esp_periph_set_handle_t set = NULL;
+static storage_tuning_t storage;
+static audio_pipeline_handle_t pipeline = NULL;
+static audio_element_handle_t reader = NULL;
+static audio_element_handle_t decoders[MEDIA_UNKNOWN]; // created in audio_engine_init(), AAC and M4A share one
+static audio_element_handle_t decoder = NULL; // linked
+static audio_element_handle_t resampler = NULL;
+static audio_element_handle_t gain = NULL;
+static audio_element_handle_t writer = NULL;
+static audio_event_iface_handle_t evt = NULL;
+static audio_engine_timing_t timing;
+static media_format_t format; // of the file started last, sample_rate 0 if unknown
+static bool resampling = false; // resampler linked in
+static int output_rate = 0; // what I2S gets
+static int output_channels = 0;
+static uint64_t read_bytes = 0; // at start of the file, for the I/O per minute of audio
+static uint64_t played_samples = 0;
+static int volume = AUDIO_ENGINE_VOLUME_MAX;
+static bool codec_volume = false; // PCM the gain filter can not scale, the volume is set on the codec instead
+
+static const char *decoder_tags[MEDIA_UNKNOWN] = {"mp3", "aac", "aac", "opus", "flac"};
+
+static audio_element_handle_t audio_engine_decoder_create(media_type_t type) {
+    switch (type) {
+        case MEDIA_AAC:
+        case MEDIA_M4A: {
+            aac_decoder_cfg_t cfg = DEFAULT_AAC_DECODER_CONFIG();
+            cfg.task_core = TASK_DECODER_CORE;
+            cfg.task_prio = TASK_DECODER_PRIO;
+            cfg.task_stack = TASK_AAC_STACK;
+            return aac_decoder_init(&cfg);
+        }
+        case MEDIA_OPUS: {
+            opus_decoder_cfg_t cfg = DEFAULT_OPUS_DECODER_CONFIG();
+            cfg.task_core = TASK_DECODER_CORE;
+            cfg.task_prio = TASK_DECODER_PRIO;
+            cfg.task_stack = TASK_OPUS_STACK;
+            return decoder_opus_init(&cfg);
+        }
+        case MEDIA_FLAC: {
+            flac_decoder_cfg_t cfg = DEFAULT_FLAC_DECODER_CONFIG();
+            cfg.task_core = TASK_DECODER_CORE;
+            cfg.task_prio = TASK_DECODER_PRIO;
+            cfg.task_stack = TASK_FLAC_STACK;
+            return flac_decoder_init(&cfg);
+        }
+        default: {
+            mp3_decoder_cfg_t cfg = DEFAULT_MP3_DECODER_CONFIG();
+            cfg.task_core = TASK_DECODER_CORE;
+            cfg.task_prio = TASK_DECODER_PRIO;
+            cfg.task_stack = TASK_MP3_STACK;
+            return mp3_decoder_init(&cfg);
+        }
+    }
+}
+
+// creates and registers the decoders of all types, AAC and M4A share one
+static esp_err_t audio_engine_decoders_create() {
+    size_t free_before = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    for (media_type_t type = 0; type < MEDIA_UNKNOWN; type++) {
+        if (type == MEDIA_M4A) {
+            decoders[type] = decoders[MEDIA_AAC];
+            continue;
+        }
+        decoders[type] = audio_engine_decoder_create(type);
+        if (decoders[type] == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        audio_pipeline_register(pipeline, decoders[type], decoder_tags[type]);
+    }
+    ESP_LOGI(TAG, "Decoders created, %d bytes of heap", (int) (free_before - heap_caps_get_free_size(MALLOC_CAP_8BIT)));
+    return ESP_OK;
+}
+
+audio_board_handle_t audio_engine_codec() {
+    if (board != NULL) {
+        return board;
+    }
+    int64_t start = esp_timer_get_time();
+    ESP_LOGD(TAG, "Start codec chip");
+    board = audio_board_init();
+    audio_hal_ctrl_codec(board->audio_hal, AUDIO_HAL_CODEC_MODE_DECODE, AUDIO_HAL_CTRL_START);
+    audio_hal_set_volume(board->audio_hal, AUDIO_ENGINE_VOLUME_MAX);
+    timing.codec_us = esp_timer_get_time() - start;
+    ESP_LOGI(TAG, "Codec ready in %" PRId64 " ms", timing.codec_us / 1000);
+    return board;
+}
+
+esp_periph_set_handle_t audio_engine_storage() {
+    if (set != NULL) {
+        return set;
+    }
+    int64_t start = esp_timer_get_time();
+    ESP_LOGD(TAG, "Initialize peripherals management");
+    esp_periph_config_t periph_cfg = DEFAULT_ESP_PERIPH_SET_CONFIG();
+    set = esp_periph_set_init(&periph_cfg);
+
+    ESP_LOGD(TAG, "Initialize and start peripherals");
+    // only the two buttons, the touch pads of audio_board_key_init() share GPIO 13 with DAT3 of the SD card
+    periph_button_cfg_t button_cfg = {
+        .gpio_mask = (1ULL << get_input_rec_id()) | (1ULL << get_input_mode_id()),
+    };
+    esp_periph_start(set, periph_button_init(&button_cfg));
+    if (storage_mount(set) == ESP_OK) {
+        storage_probe(&storage);
+    } else {
+        storage_defaults(&storage);
+    }
+    timing.storage_us = esp_timer_get_time() - start;
+    ESP_LOGI(TAG, "Storage ready in %" PRId64 " ms", timing.storage_us / 1000);
+    return set;
+}
+
+esp_err_t audio_engine_init() {
+    if (pipeline != NULL) {
+        return ESP_OK;
+    }
+    audio_engine_storage();
+    audio_engine_codec();
+
+    int64_t start = esp_timer_get_time();
+    ESP_LOGD(TAG, "Create audio pipeline for playback");
+    audio_pipeline_cfg_t pipeline_cfg = DEFAULT_AUDIO_PIPELINE_CONFIG();
+    pipeline = audio_pipeline_init(&pipeline_cfg);
+    if (pipeline == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGD(TAG, "Create track stream to read data from sdcard");
+    track_stream_cfg_t track_cfg = TRACK_STREAM_CFG_DEFAULT();
+    track_cfg.buf_sz = storage.read_size;
+    track_cfg.out_rb_size = storage.read_ahead;
+    track_cfg.task_core = TASK_FATFS_CORE;
+    track_cfg.task_prio = TASK_FATFS_PRIO;
+    track_cfg.task_stack = TASK_FATFS_STACK;
+    reader = track_stream_init(&track_cfg);
+
+    ESP_LOGD(TAG, "Create i2s stream to write data to codec chip");
+    i2s_stream_cfg_t i2s_cfg = I2S_STREAM_CFG_DEFAULT();
+    i2s_cfg.type = AUDIO_STREAM_WRITER;
+    i2s_cfg.task_core = TASK_I2S_CORE;
+    i2s_cfg.task_prio = TASK_I2S_PRIO;
+    i2s_cfg.task_stack = TASK_I2S_STACK;
+    writer = i2s_stream_init(&i2s_cfg);
+
+    ESP_LOGD(TAG, "Create gain filter for loudness and limiting");
+    gain_filter_cfg_t gain_cfg = GAIN_FILTER_CFG_DEFAULT();
+    gain_cfg.task_core = TASK_GAIN_CORE;
+    gain_cfg.task_prio = TASK_GAIN_PRIO;
+    gain_cfg.task_stack = TASK_GAIN_STACK;
+    gain = gain_filter_init(&gain_cfg);
+
+    ESP_LOGD(TAG, "Create resample filter, linked in only for files not in the output format");
+    rsp_filter_cfg_t rsp_cfg = DEFAULT_RESAMPLE_FILTER_CONFIG();
+    rsp_cfg.src_rate = AUDIO_ENGINE_SAMPLE_RATE;
+    rsp_cfg.src_ch = AUDIO_ENGINE_CHANNELS;
+    rsp_cfg.dest_rate = AUDIO_ENGINE_SAMPLE_RATE;
+    rsp_cfg.dest_ch = AUDIO_ENGINE_CHANNELS;
+    rsp_cfg.task_core = TASK_RESAMPLE_CORE;
+    rsp_cfg.task_prio = TASK_RESAMPLE_PRIO;
+    rsp_cfg.task_stack = TASK_RESAMPLE_STACK;
+    resampler = rsp_filter_init(&rsp_cfg);
+    if (reader == NULL || writer == NULL || gain == NULL || resampler == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    monitor_watch_i2s(writer);
+    system_sound_init(i2s_cfg.i2s_port); // cues fall back to the MP3s on the SD card if the partition is empty
+
+    ESP_LOGD(TAG, "Register all elements to audio pipeline");
+    audio_pipeline_register(pipeline, reader, "file");
+    audio_pipeline_register(pipeline, resampler, "rsp");
+    audio_pipeline_register(pipeline, gain, "gain");
+    audio_pipeline_register(pipeline, writer, "i2s");
+
+    ESP_LOGD(TAG, "Link it together [sdcard]-->track_stream-->decoder-->gain_filter-->i2s_stream-->[codec_chip]");
+    if (audio_engine_decoders_create() != ESP_OK) { // all at boot, no allocation when a file needs another one
+        return ESP_ERR_NO_MEM;
+    }
+    decoder = decoders[MEDIA_MP3];
+    audio_pipeline_link(pipeline, (const char *[]) {"file", "mp3", "gain", "i2s"}, 4);
+
+    ESP_LOGD(TAG, "Set up event listener for the pipeline and peripherals");
+    audio_event_iface_cfg_t evt_cfg = AUDIO_EVENT_IFACE_DEFAULT_CFG();
+    evt = audio_event_iface_init(&evt_cfg);
+    audio_pipeline_set_listener(pipeline, evt);
+    audio_event_iface_set_listener(esp_periph_set_get_event_iface(set), evt);
+
+    timing.pipeline_us = esp_timer_get_time() - start;
+    ESP_LOGI(TAG, "Ready: storage %" PRId64 " ms, codec %" PRId64 " ms, pipeline %" PRId64 " ms",
+            timing.storage_us / 1000, timing.codec_us / 1000, timing.pipeline_us / 1000);
+    return ESP_OK;
+}
+
+void audio_engine_deinit() {
+    if (pipeline != NULL) {
+        ESP_LOGD(TAG, "Terminate");
+        audio_pipeline_terminate(pipeline);
+
+        ESP_LOGD(TAG, "Unregister");
+        audio_pipeline_unregister(pipeline, reader);
+        audio_pipeline_unregister(pipeline, writer);
+        for (int i = 0; i < MEDIA_UNKNOWN; i++) {
+            if (decoders[i] != NULL && i != MEDIA_M4A) { // alias of the AAC decoder
+                audio_pipeline_unregister(pipeline, decoders[i]);
+            }
+        }
+        audio_pipeline_unregister(pipeline, resampler);
+        audio_pipeline_unregister(pipeline, gain);
+
+        ESP_LOGD(TAG, "Remove listener");
+        audio_pipeline_remove_listener(pipeline);
+        audio_event_iface_remove_listener(esp_periph_set_get_event_iface(set), evt);
+
+        ESP_LOGD(TAG, "Make sure audio_pipeline_remove_listener & audio_event_iface_remove_listener are called before destroying event_iface");
+        audio_event_iface_destroy(evt);
+        evt = NULL;
+
+        ESP_LOGD(TAG, "Release all resources");
+        audio_pipeline_deinit(pipeline);
+        audio_element_deinit(reader);
+        audio_element_deinit(writer);
+        for (int i = 0; i < MEDIA_UNKNOWN; i++) {
+            if (decoders[i] != NULL && i != MEDIA_M4A) { // alias of the AAC decoder
+                audio_element_deinit(decoders[i]);
+            }
+            decoders[i] = NULL;
+        }
+        audio_element_deinit(resampler);
+        audio_element_deinit(gain);
+        pipeline = NULL;
+        reader = decoder = resampler = gain = writer = NULL;
+    }
+    if (set != NULL) {
+        ESP_LOGD(TAG, "Stop periph");
+        esp_periph_set_stop_all(set);
+        //esp_periph_set_destroy(set); // TODO causes panic
+        set = NULL;
+    }
+}
+
+const audio_engine_timing_t *audio_engine_timing() {
+    return &timing;
+}
+
+void audio_engine_set_volume(int value) {
+    volume = value;
+    int32_t factor = audio_engine_volume_gain(volume);
+    gain_filter_set_volume(gain, factor);
+    system_sound_set_volume(factor);
+    if (codec_volume) {
+        audio_hal_set_volume(board->audio_hal, volume);
+    }
+}
+
+int32_t audio_engine_volume_gain(int value) {
+    return gain_filter_q14((value - AUDIO_ENGINE_VOLUME_MAX) * 1.5f / AUDIO_ENGINE_VOLUME_STEP);
+}
+
+audio_event_iface_handle_t audio_engine_events() {
+    return evt;
+}
+
+audio_element_handle_t audio_engine_reader() {
+    return reader;
+}
+
+audio_element_handle_t audio_engine_decoder() {
+    return decoder;
+}
+
+audio_element_handle_t audio_engine_writer() {
+    return writer;
+}
+
+static bool audio_engine_native(const media_format_t *f) {
+    return f->sample_rate == 0 || (f->sample_rate == AUDIO_ENGINE_SAMPLE_RATE && f->channels == AUDIO_ENGINE_CHANNELS);
+}
+
+// links decoder and resampler for the next file, the pipeline is stopped
+static void audio_engine_link(audio_element_handle_t next, media_type_t type, bool resample) {
+    if (next == decoder && resample == resampling) {
+        return;
+    }
+    const char *tag = decoder_tags[type];
+    audio_pipeline_breakup_elements(pipeline, NULL);
+    if (resample) {
+        audio_pipeline_relink(pipeline, (const char *[]) {"file", tag, "rsp", "gain", "i2s"}, 5);
+    } else {
+        audio_pipeline_relink(pipeline, (const char *[]) {"file", tag, "gain", "i2s"}, 4);
+    }
+    audio_pipeline_set_listener(pipeline, evt);
+    decoder = next;
+    resampling = resample;
+    ESP_LOGI(TAG, "Linked %s decoder, resampler %s", tag, resample ? "linked" : "bypassed");
+}
+
+// read and played since the file started, logged when it stops or ends
+static void audio_engine_log_io() {
+    uint64_t read = track_stream_read_bytes(reader) - read_bytes;
+    uint64_t samples = gain_filter_samples(gain) - played_samples;
+    if (samples == 0 || output_rate == 0 || output_channels == 0) {
+        return;
+    }
+    float minutes = (float) samples / output_channels / output_rate / 60;
+    ESP_LOGI(TAG, "%s: %.1f min played, %" PRIu64 " KB read, %.0f KB per minute",
+            media_type_name(format.type), minutes, read / 1024, read / 1024 / minutes);
+}
+
+// (re)starts a stopped pipeline with a new file, decoder and i2s tasks are reused
+esp_err_t audio_engine_play(const char *uri, int64_t byte_pos) {
+    esp_err_t ret = media_probe(uri, &format);
+    if (ret != ESP_OK) { // no decoder would make sense of it
+        ESP_LOGW(TAG, "Not playing %s: %s", uri, ret == ESP_ERR_NOT_SUPPORTED ? "unsupported format" : "unknown format");
+        format.type = MEDIA_UNKNOWN;
+        format.sample_rate = 0;
+        format.channels = 0;
+        return ret;
+    }
+    audio_engine_link(decoders[format.type], format.type, !audio_engine_native(&format));
+    read_bytes = track_stream_read_bytes(reader);
+    played_samples = gain_filter_samples(gain);
+    if (resampling) {
+        rsp_filter_set_src_info(resampler, format.sample_rate, format.channels);
+    }
+
+    audio_element_set_uri(reader, uri);
+    track_stream_set_next(reader, NULL); // queued again on music info
+    gain_filter_reset(gain, format.gain == MEDIA_GAIN_NONE ? GAIN_FILTER_TRACK_GAIN_NONE : format.gain);
+    audio_pipeline_reset_ringbuffer(pipeline);
+    audio_pipeline_reset_elements(pipeline);
+
+    audio_element_info_t info = {0};
+    audio_element_getinfo(reader, &info);
+    info.byte_pos = byte_pos;
+    audio_element_setinfo(reader, &info);
+
+    power_playback(true);
+    audio_pipeline_run(pipeline);
+    monitor_i2s_start();
+    return ESP_OK;
+}
+
+void audio_engine_stop() {
+    audio_pipeline_stop(pipeline);
+}
+
+// codec at AUDIO_ENGINE_VOLUME_MAX unless the gain filter passes the PCM through
+static void audio_engine_codec_volume(bool on) {
+    if (on != codec_volume) {
+        codec_volume = on;
+        audio_hal_set_volume(board->audio_hal, on ? volume : AUDIO_ENGINE_VOLUME_MAX);
+    }
+}
+
+void audio_engine_wait_for_stop() {
+    audio_pipeline_wait_for_stop(pipeline);
+    audio_engine_codec_volume(false); // for the cues
+    power_playback(false);
+    audio_engine_log_io();
+}
+
+esp_err_t audio_engine_retarget(const char *uri, int64_t byte_pos) {
+    audio_engine_stop();
+    audio_engine_wait_for_stop();
+    return audio_engine_play(uri, byte_pos);
+}
+
+void audio_engine_pause() {
+    audio_pipeline_pause(pipeline);
+}
+
+void audio_engine_resume() {
+    audio_pipeline_resume(pipeline);
+}
+
+void audio_engine_seek(int64_t byte_pos) {
+    audio_element_info_t info = {0};
+    audio_element_getinfo(reader, &info);
+    info.byte_pos = byte_pos;
+    audio_element_setinfo(reader, &info);
+}
+
+int64_t audio_engine_position() {
+    audio_element_info_t info = {0};
+    audio_element_getinfo(reader, &info);
+    return info.byte_pos;
+}
+
+bool audio_engine_gapless(const char *path) {
+    media_format_t next;
+    return format.sample_rate != 0 && media_probe(path, &next) == ESP_OK && next.type == format.type
+            && next.sample_rate == format.sample_rate && next.channels == format.channels;
+}
+
+void audio_engine_music_info(audio_element_info_t *info) {
+    audio_element_getinfo(decoder, info);
+    if (resampling) { // the probe was right or the decoder output would be misread
+        if (info->sample_rates != format.sample_rate || info->channels != format.channels) {
+            ESP_LOGW(TAG, "Probed %d Hz %d ch, decoder reports %d Hz %d ch", format.sample_rate, format.channels, info->sample_rates, info->channels);
+            rsp_filter_change_src_info(resampler, info->sample_rates, info->channels, info->bits);
+        }
+        info->sample_rates = AUDIO_ENGINE_SAMPLE_RATE;
+        info->channels = AUDIO_ENGINE_CHANNELS;
+    }
+    gain_filter_set_bits(gain, info->bits);
+    audio_engine_codec_volume(info->bits != 16);
+    output_rate = info->sample_rates;
+    output_channels = info->channels;
+    audio_element_setinfo(writer, info);
+    i2s_stream_set_clk(writer, info->sample_rates, info->bits, info->channels);
+}
+
+bool audio_engine_finished() {
+    if (audio_element_get_state(writer) != AEL_STATE_FINISHED) {
+        return false;
+    }
+    power_playback(false);
+    audio_engine_log_io();
+    return true;
+}
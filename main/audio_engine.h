@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "audio_element.h"
+#include "audio_event_iface.h"
+#include "esp_peripherals.h"
+#include "board.h"
+
+#define AUDIO_ENGINE_SAMPLE_RATE 44100 // output format, other files go through the resampler
+#define AUDIO_ENGINE_CHANNELS 2
+#define AUDIO_ENGINE_VOLUME_MAX 70 // codec output level, lower volumes are applied digitally
+#define AUDIO_ENGINE_VOLUME_STEP 3 // 1.5 dB, one step of the codec's volume register
+
+// duration of each init phase, 0 if not (yet) run
+typedef struct {
+    int64_t storage_us; // peripherals, buttons, SD mount and read size probe
+    int64_t codec_us;
+    int64_t pipeline_us; // elements, links and listeners
+} audio_engine_timing_t;
+
+/*
+ * The playback pipeline [sdcard]-->track_stream-->decoder-->gain_filter-->i2s_stream-->[codec_chip] with its peripherals,
+ * created once and reused for every file. The phases are initialised lazily: the wake-up beep only needs the
+ * codec, list_sdcard_task only the storage, audio_engine_init() brings up everything. Pipeline and button
+ * events arrive on audio_engine_events().
+ * The decoders of all types (MP3, AAC, M4A, Opus, FLAC) are created with the pipeline. Before a file starts
+ * its container and first frame header are probed and the decoder for its type is linked in, a file that is not
+ * recognised or not supported is not started. Files in the output format bypass the resampler, the
+ * rest (48 kHz, 22.05 kHz, mono, ...) are converted to it, so the codec clock stays the same.
+ * The codec stays at AUDIO_ENGINE_VOLUME_MAX, the volume keeps the codec's scale (1.5 dB per AUDIO_ENGINE_VOLUME_STEP)
+ * and is ramped in by the gain filter, and applied to the flash cues, so a button press does not click. Files that do
+ * not decode to 16 bit pass the gain filter unchanged, their volume is set on the codec. Tagged files are played at
+ * their track gain (see media_probe()), files that follow gaplessly keep the gain of the file that started.
+ */
+audio_board_handle_t audio_engine_codec();
+esp_periph_set_handle_t audio_engine_storage();
+esp_err_t audio_engine_init();
+void audio_engine_deinit(); // before deep sleep
+const audio_engine_timing_t *audio_engine_timing();
+void audio_engine_set_volume(int value); // 0..AUDIO_ENGINE_VOLUME_MAX, after audio_engine_init()
+int32_t audio_engine_volume_gain(int value); // Q14 factor of the volume, for PCM written past the pipeline
+
+audio_event_iface_handle_t audio_engine_events();
+audio_element_handle_t audio_engine_reader();
+audio_element_handle_t audio_engine_decoder();
+audio_element_handle_t audio_engine_writer();
+
+esp_err_t audio_engine_play(const char *uri, int64_t byte_pos); // pipeline must be stopped or finished, see media_probe()
+void audio_engine_stop(); // returns immediately, see audio_engine_wait_for_stop()
+void audio_engine_wait_for_stop();
+esp_err_t audio_engine_retarget(const char *uri, int64_t byte_pos); // stop, then play
+void audio_engine_pause();
+void audio_engine_resume();
+void audio_engine_seek(int64_t byte_pos); // while paused, applied on resume
+int64_t audio_engine_position(); // byte_pos of the reader
+bool audio_engine_gapless(const char *path); // same format as the current file, may follow it without relinking
+void audio_engine_music_info(audio_element_info_t *info); // applies the decoder format to I2S
+bool audio_engine_finished(); // on FINISHED of the writer, false if restarted meanwhile
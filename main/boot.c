@@ -0,0 +1,56 @@
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "boot.h"
+
+static const char *TAG = "BOOT";
+
+static const char *names[BOOT_PHASES] = {"rfid_init", "first_read", "storage", "codec", "pipeline", "catalog", "lookup", "first_play"};
+static int64_t begin_us[BOOT_PHASES];
+static int64_t end_us[BOOT_PHASES];
+static EventGroupHandle_t done = NULL;
+static StaticEventGroup_t done_buffer;
+static bool logged = false;
+
+void boot_init() {
+    done = xEventGroupCreateStatic(&done_buffer);
+}
+
+void boot_begin(boot_phase_t phase) {
+    if (begin_us[phase] != 0) { // the first run is the boot phase, later lookups and plays are not
+        return;
+    }
+    begin_us[phase] = esp_timer_get_time();
+}
+
+void boot_end(boot_phase_t phase) {
+    if (end_us[phase] != 0) { // phases happen once
+        return;
+    }
+    end_us[phase] = esp_timer_get_time();
+    xEventGroupSetBits(done, BIT(phase));
+}
+
+bool boot_wait(boot_phase_t phase, uint32_t timeout_ms) {
+    EventBits_t bits = xEventGroupWaitBits(done, BIT(phase), pdFALSE, pdTRUE, timeout_ms / portTICK_PERIOD_MS);
+    return (bits & BIT(phase)) != 0;
+}
+
+void boot_log() {
+    if (logged) {
+        return;
+    }
+    logged = true;
+    for (int i = 0; i < BOOT_PHASES; i++) {
+        if (end_us[i] == 0) {
+            ESP_LOGI(TAG, "%-10s -", names[i]);
+        } else {
+            ESP_LOGI(TAG, "%-10s %5" PRId64 " .. %5" PRId64 " ms (%" PRId64 " ms)", names[i],
+                    begin_us[i] / 1000, end_us[i] / 1000, (end_us[i] - begin_us[i]) / 1000);
+        }
+    }
+}
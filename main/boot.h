@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Cold start timeline. RFID (reader init, first read) and sound_task (storage, codec, pipeline, lookup,
+ * catalog) run their phases concurrently, boot_wait() orders them where one needs the result of another.
+ * Every phase is latched at its first begin and end, later calls (the lookup of every tag) are ignored.
+ * boot_log() prints begin and end of every phase relative to app start, once.
+ */
+typedef enum {
+    BOOT_RFID_INIT,
+    BOOT_FIRST_READ,
+    BOOT_STORAGE,
+    BOOT_CODEC,
+    BOOT_PIPELINE,
+    BOOT_CATALOG,
+    BOOT_LOOKUP, // stored position, catalog and seek index of the tag found at power-on
+    BOOT_FIRST_PLAY, // from the first tag event to its pipeline run
+    BOOT_PHASES,
+} boot_phase_t;
+
+void boot_init();
+void boot_begin(boot_phase_t phase);
+void boot_end(boot_phase_t phase); // wakes boot_wait()
+bool boot_wait(boot_phase_t phase, uint32_t timeout_ms); // false on timeout
+void boot_log();
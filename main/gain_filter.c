@@ -0,0 +1,186 @@
+#include <stdlib.h>
+#include <math.h>
+#include <inttypes.h>
+
+#include "esp_log.h"
+#include "hal/cpu_hal.h"
+
+#include "gain_filter.h"
+#include "power.h"
+
+static const char *TAG = "GAIN";
+
+#define GAIN_FILTER_BLOCK_BYTES 1024 // 256 stereo frames, gain changes are ramped over one block
+#define GAIN_FILTER_UNITY (1 << 14) // gains are Q14
+
+typedef struct {
+    int32_t gain; // normalisation gain reached at the end of the last block
+    int32_t applied; // gain times volume reached at the end of the last block
+    volatile int32_t volume; // set by sound_task
+    int32_t ceiling; // lowered by the limiter, regained by GAIN_FILTER_RELEASE_STEP per block
+    uint32_t loudness; // running mean square of the blocks above the gate
+    int32_t fixed; // track gain of a tagged file, 0 follows the loudness
+    int bits;
+    uint32_t target_ms;
+    uint32_t gate_ms;
+    int32_t limit;
+    int32_t min_gain;
+    int32_t max_gain;
+    uint64_t cycles;
+    uint64_t samples;
+    uint64_t total; // samples since init
+} gain_filter_t;
+
+static uint32_t gain_filter_mean_square(int dbfs) {
+    float rms = 32768.0f * powf(10.0f, dbfs / 20.0f);
+    return (uint32_t) (rms * rms);
+}
+
+static void gain_filter_apply(gain_filter_t *g, int16_t *pcm, int n) {
+    int64_t energy = 0;
+    int32_t peak = 1;
+    for (int i = 0; i < n; i++) {
+        int32_t s = pcm[i];
+        energy += s * s;
+        s = s < 0 ? -s : s;
+        peak = s > peak ? s : peak;
+    }
+    uint32_t ms = energy / n;
+    if (ms > g->gate_ms) {
+        g->loudness += ((int64_t) ms - g->loudness) >> GAIN_FILTER_LOUDNESS_SHIFT;
+    }
+
+    // once per block in float, the per sample path below is integer only
+    int32_t target = (int32_t) (GAIN_FILTER_UNITY * sqrtf((float) g->target_ms / (g->loudness > 0 ? g->loudness : 1)));
+    target = target < g->min_gain ? g->min_gain : target > g->max_gain ? g->max_gain : target;
+    target = g->fixed > 0 ? g->fixed : target;
+
+    g->ceiling = g->ceiling + GAIN_FILTER_RELEASE_STEP > g->max_gain ? g->max_gain : g->ceiling + GAIN_FILTER_RELEASE_STEP;
+    int32_t volume = g->volume;
+    int32_t start = g->applied;
+    if (((peak * target) >> 14) > g->limit) { // attack right away, no ramp from the louder gain
+        g->ceiling = (g->limit << 14) / peak;
+        int32_t limited = (g->ceiling * volume) >> 14;
+        start = limited < start ? limited : start;
+    }
+    target = target > g->ceiling ? g->ceiling : target;
+    int32_t end = (target * volume) >> 14;
+
+    int32_t acc = start << 8; // 8 fraction bits for the ramp
+    int32_t step = ((end - start) << 8) / n;
+    for (int i = 0; i < n; i++) {
+        int32_t v = (pcm[i] * (acc >> 8)) >> 14;
+        pcm[i] = v > INT16_MAX ? INT16_MAX : v < INT16_MIN ? INT16_MIN : v;
+        acc += step;
+    }
+    g->gain = target;
+    g->applied = end;
+}
+
+static esp_err_t _gain_open(audio_element_handle_t self) {
+    gain_filter_t *g = (gain_filter_t *) audio_element_getdata(self);
+    g->applied = 0; // fade in over the first block after start, resume and seek
+    g->ceiling = g->max_gain;
+    return ESP_OK;
+}
+
+static int _gain_process(audio_element_handle_t self, char *in_buffer, int in_len) {
+    int r_size = audio_element_input(self, in_buffer, in_len);
+    if (r_size <= 0) {
+        return r_size;
+    }
+    gain_filter_t *g = (gain_filter_t *) audio_element_getdata(self);
+    int n = r_size / sizeof(int16_t);
+    if (n > 0 && g->bits == 16) {
+        uint32_t start = cpu_hal_get_cycle_count();
+        gain_filter_apply(g, (int16_t *) in_buffer, n);
+        g->cycles += cpu_hal_get_cycle_count() - start;
+        g->samples += n;
+    }
+    g->total += n;
+    return audio_element_output(self, in_buffer, r_size);
+}
+
+static esp_err_t _gain_close(audio_element_handle_t self) {
+    gain_filter_t *g = (gain_filter_t *) audio_element_getdata(self);
+    if (g->samples > 0) {
+        float cycles = (float) g->cycles / g->samples;
+        ESP_LOGI(TAG, "%.1f cycles/sample, %.2f %% of a core at 44.1 kHz stereo, gain %.2f, volume %.2f",
+                cycles, cycles * 44100 * 2 / (POWER_MAX_FREQ_MHZ * 10000.0f), (float) g->gain / GAIN_FILTER_UNITY,
+                (float) g->volume / GAIN_FILTER_UNITY);
+    }
+    g->cycles = 0;
+    g->samples = 0;
+    return ESP_OK;
+}
+
+static esp_err_t _gain_destroy(audio_element_handle_t self) {
+    free(audio_element_getdata(self));
+    return ESP_OK;
+}
+
+audio_element_handle_t gain_filter_init(gain_filter_cfg_t *config) {
+    gain_filter_t *g = calloc(1, sizeof(gain_filter_t));
+    if (g == NULL) {
+        return NULL;
+    }
+    g->target_ms = gain_filter_mean_square(GAIN_FILTER_TARGET_DBFS);
+    g->gate_ms = gain_filter_mean_square(GAIN_FILTER_GATE_DBFS);
+    g->loudness = g->target_ms; // unity until the first file has been heard
+    g->limit = (int32_t) (32768.0f * powf(10.0f, GAIN_FILTER_LIMIT_DBFS / 20.0f));
+    g->min_gain = gain_filter_q14(GAIN_FILTER_MIN_DB);
+    g->max_gain = gain_filter_q14(GAIN_FILTER_MAX_DB);
+    g->volume = GAIN_FILTER_UNITY;
+    g->bits = 16;
+
+    audio_element_cfg_t cfg = DEFAULT_AUDIO_ELEMENT_CONFIG();
+    cfg.open = _gain_open;
+    cfg.close = _gain_close;
+    cfg.process = _gain_process;
+    cfg.destroy = _gain_destroy;
+    cfg.buffer_len = GAIN_FILTER_BLOCK_BYTES;
+    cfg.out_rb_size = config->out_rb_size;
+    cfg.task_stack = config->task_stack;
+    cfg.task_core = config->task_core;
+    cfg.task_prio = config->task_prio;
+    cfg.tag = "gain";
+    audio_element_handle_t el = audio_element_init(&cfg);
+    if (el == NULL) {
+        free(g);
+        return NULL;
+    }
+    audio_element_setdata(el, g);
+    return el;
+}
+
+void gain_filter_reset(audio_element_handle_t self, int track_gain) {
+    gain_filter_t *g = (gain_filter_t *) audio_element_getdata(self);
+    g->loudness = g->target_ms;
+    g->fixed = 0;
+    if (track_gain != GAIN_FILTER_TRACK_GAIN_NONE) {
+        g->fixed = gain_filter_q14(track_gain / 100.0f);
+        g->fixed = g->fixed > g->max_gain ? g->max_gain : g->fixed > 0 ? g->fixed : 1;
+    }
+}
+
+void gain_filter_set_bits(audio_element_handle_t self, int bits) {
+    gain_filter_t *g = (gain_filter_t *) audio_element_getdata(self);
+    if (bits != 16 && bits != g->bits) {
+        ESP_LOGW(TAG, "%d bit PCM, passed without gain and volume", bits);
+    }
+    g->bits = bits;
+}
+
+void gain_filter_set_volume(audio_element_handle_t self, int32_t volume) {
+    gain_filter_t *g = (gain_filter_t *) audio_element_getdata(self);
+    g->volume = volume;
+}
+
+int32_t gain_filter_q14(float db) {
+    return (int32_t) (GAIN_FILTER_UNITY * powf(10.0f, db / 20.0f));
+}
+
+uint64_t gain_filter_samples(audio_element_handle_t self) {
+    gain_filter_t *g = (gain_filter_t *) audio_element_getdata(self);
+    return g->total;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+#include "audio_element.h"
+
+#define GAIN_FILTER_TARGET_DBFS (-18) // RMS every file is normalised to
+#define GAIN_FILTER_MIN_DB (-6)
+#define GAIN_FILTER_MAX_DB 12
+#define GAIN_FILTER_GATE_DBFS (-50) // quieter blocks (pauses, silence) do not change the loudness estimate
+#define GAIN_FILTER_LIMIT_DBFS (-1) // peak ceiling for the speakers
+#define GAIN_FILTER_LOUDNESS_SHIFT 9 // loudness averages over 2^n blocks, about 3 s with 1 KB blocks at 44.1 kHz stereo
+#define GAIN_FILTER_RELEASE_STEP 16 // Q14 gain regained per block (5.8 ms) after the limiter pulled it down
+#define GAIN_FILTER_TRACK_GAIN_NONE INT16_MIN
+
+/*
+ * Fixed-point loudness normalisation and peak limiter for 16 bit PCM, placed between decoder and i2s_stream.
+ * A file with a track gain (ReplayGain) gets that gain, up to GAIN_FILTER_MAX_DB. Otherwise the gain follows the
+ * running RMS of the file towards GAIN_FILTER_TARGET_DBFS within GAIN_FILTER_MIN_DB..GAIN_FILTER_MAX_DB.
+ * Either is lowered right away for a block whose peak would exceed
+ * GAIN_FILTER_LIMIT_DBFS. The volume is applied after both, so it never drives the limiter. Gain and volume changes
+ * are ramped linearly across a block, every open fades in from silence. Other sample widths pass unchanged.
+ * The kernel cycles per sample are logged when the element closes.
+ */
+typedef struct {
+    int out_rb_size;
+    int task_stack;
+    int task_core;
+    int task_prio;
+} gain_filter_cfg_t;
+
+#define GAIN_FILTER_CFG_DEFAULT() {                 \
+    .out_rb_size = 8 * 1024,                        \
+    .task_stack = 3 * 1024,                         \
+    .task_core = 1,                                 \
+    .task_prio = 5,                                 \
+}
+
+audio_element_handle_t gain_filter_init(gain_filter_cfg_t *config);
+void gain_filter_reset(audio_element_handle_t self, int track_gain); // new file, 1/100 dB or GAIN_FILTER_TRACK_GAIN_NONE
+void gain_filter_set_bits(audio_element_handle_t self, int bits); // of the decoder output, on music info
+void gain_filter_set_volume(audio_element_handle_t self, int32_t volume); // Q14, from any task, ramped over the next block
+int32_t gain_filter_q14(float db);
+uint64_t gain_filter_samples(audio_element_handle_t self); // processed since init, all channels
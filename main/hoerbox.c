@@ -1,25 +1,22 @@
 #include <stdio.h>
 #include <string.h>
 #include <inttypes.h>
-#include <time.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
+#include "esp_attr.h"
 #include "esp_sleep.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
 #include "nvs.h"
 #include "nvs_flash.h"
 #include "sdkconfig.h"
 #include "audio_element.h"
-#include "audio_pipeline.h"
 #include "audio_event_iface.h"
 #include "audio_common.h"
-#include "fatfs_stream.h"
-#include "i2s_stream.h"
-#include "mp3_decoder.h"
-#include "filter_resample.h"
+#include "driver/i2s.h"
 #include "esp_peripherals.h"
-#include "periph_sdcard.h"
 #include <driver/i2c.h>
 #include "board.h"
 #include "periph_button.h"
@@ -28,6 +25,22 @@
 #include "sdcard_scan.h"
 
 #include "rc522.h"
+#include "position_store.h"
+#include "seek_index.h"
+#include "seek_scrub.h"
+#include "system_sound.h"
+#include "tag_catalog.h"
+#include "playlist.h"
+#include "track_stream.h"
+#include "monitor.h"
+#include "power.h"
+#include "tasks.h"
+#include "audio_engine.h"
+#include "boot.h"
+#include "trace.h"
+#include "player.h"
+#include "player_action.h"
+#include "rfid_poll.h"
 
 static const char *TAG = "BOX";
 static const char *TAG_SOUND = "SOUND";
@@ -35,152 +48,105 @@ static const char *TAG_BEEP = "BEEP";
 static const char *TAG_RFID = "RFID";
 
 #define SLEEP_IN_MICRO_SECONDS 90000000
-#define SHUTDOWN_IF_NO_TAGS_CONSECUTIVELY 300
-#define VOLUME_MAX 70
-
-static void beep_task(void *arg) { // do noot execute togehter with sound_task!
-    audio_pipeline_handle_t pipeline;
-    audio_element_handle_t i2s_stream_writer, fatfs_stream_reader, mp3_decoder;
-
-    ESP_LOGD(TAG_BEEP, "Initialize peripherals management");
-    esp_periph_config_t periph_cfg = DEFAULT_ESP_PERIPH_SET_CONFIG();
-    esp_periph_set_handle_t set = esp_periph_set_init(&periph_cfg);
-
-    ESP_LOGD(TAG_BEEP, "Initialize and start peripherals");
-    audio_board_key_init(set);
-    audio_board_sdcard_init(set, SD_MODE_1_LINE);
-
-    ESP_LOGD(TAG_BEEP, "Start codec chip");
-    audio_board_handle_t board_handle = audio_board_init();
-    audio_hal_ctrl_codec(board_handle->audio_hal, AUDIO_HAL_CODEC_MODE_DECODE, AUDIO_HAL_CTRL_START);
-
-    ESP_LOGD(TAG_BEEP, "Create audio pipeline for playback");
-    audio_pipeline_cfg_t pipeline_cfg = DEFAULT_AUDIO_PIPELINE_CONFIG();
-    pipeline = audio_pipeline_init(&pipeline_cfg);
-    mem_assert(pipeline);
-
-    ESP_LOGD(TAG_BEEP, "Create fatfs stream to read data from sdcard");
-    fatfs_stream_cfg_t fatfs_cfg = FATFS_STREAM_CFG_DEFAULT();
-    fatfs_cfg.type = AUDIO_STREAM_READER;
-    fatfs_stream_reader = fatfs_stream_init(&fatfs_cfg);
-
-    ESP_LOGD(TAG_BEEP, "Create i2s stream to write data to codec chip");
-    i2s_stream_cfg_t i2s_cfg = I2S_STREAM_CFG_DEFAULT();
-    i2s_cfg.type = AUDIO_STREAM_WRITER;
-    i2s_stream_writer = i2s_stream_init(&i2s_cfg);
-
-    ESP_LOGD(TAG_BEEP, "Create mp3 decoder to decode mp3 file");
-    mp3_decoder_cfg_t mp3_cfg = DEFAULT_MP3_DECODER_CONFIG();
-    mp3_decoder = mp3_decoder_init(&mp3_cfg);
-
-    ESP_LOGD(TAG_BEEP, "Register all elements to audio pipeline");
-    audio_pipeline_register(pipeline, fatfs_stream_reader, "file");
-    audio_pipeline_register(pipeline, mp3_decoder, "mp3");
-    audio_pipeline_register(pipeline, i2s_stream_writer, "i2s");
-
-    ESP_LOGD(TAG_BEEP, "Link it together [sdcard]-->fatfs_stream-->mp3_decoder-->i2s_stream-->[codec_chip]");
-    audio_pipeline_link(pipeline, (const char *[]) {"file", "mp3", "i2s"}, 3);
-
-    ESP_LOGD(TAG_BEEP, "Set up  event listener");
-    audio_event_iface_cfg_t evt_cfg = AUDIO_EVENT_IFACE_DEFAULT_CFG();
-    audio_event_iface_handle_t evt = audio_event_iface_init(&evt_cfg);
-
-    ESP_LOGD(TAG_BEEP, "Listening event from all elements of pipeline");
-    audio_pipeline_set_listener(pipeline, evt);
-
-    ESP_LOGD(TAG_BEEP, "Listening event from peripherals");
-    audio_event_iface_set_listener(esp_periph_set_get_event_iface(set), evt);
+#define RFID_IRQ_GPIO GPIO_NUM_NC // IRQ line of the RFID reader if wired (see README), GPIO_NUM_NC polls ComIrqReg
+#define RFID_STATS_INTERVAL_MS 60000
+#define VOLUME_SAVE_DELAY_MS 5000 // one NVS commit after a series of presses
+#define BEEP_SAMPLE_RATE 16000 // 16 samples per beep_wave period
+#define BEEP_DURATION_MS 200
+#define I2S_TRACE_INTERVAL_MS 10 // checks for the first I2S write after the music info
+#define I2S_TRACE_CHECKS 10
+
+RTC_DATA_ATTR static int rtc_volume = -1; // survives deep sleep, so the wake path does not need NVS
+RTC_DATA_ATTR static uint32_t rtc_wakeups = 0;
+RTC_DATA_ATTR static int64_t rtc_awake_us = 0;
+
+// one period of a 1 kHz sine at BEEP_SAMPLE_RATE
+static const int16_t beep_wave[] = {0, 3061, 5657, 7391, 8000, 7391, 5657, 3061, 0, -3061, -5657, -7391, -8000, -7391, -5657, -3061};
+
+static void nvs_init() {
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+      ESP_ERROR_CHECK(nvs_flash_erase());
+      ret = nvs_flash_init();
+    } 
+    ESP_ERROR_CHECK(ret);
+}
 
-    // read volume from NVS
+static int volume_load() {
     nvs_handle nvs_config;
+    int volume = -1;
     ESP_ERROR_CHECK(nvs_open("config", NVS_READWRITE, &nvs_config));
-    int volume;
     esp_err_t ret = nvs_get_i32(nvs_config, "volume", &volume);
     if (ret == ESP_ERR_NVS_NOT_FOUND) {
         ESP_LOGI(TAG_SOUND, "No previous volume found to restore");
     } else if (ret == ESP_OK) {
         ESP_LOGI(TAG_SOUND, "Restore previous volume: %d", volume);
-        audio_hal_set_volume(board_handle->audio_hal, volume);
     } else {
         ESP_ERROR_CHECK(ret);
     }
     nvs_close(nvs_config);
+    return volume;
+}
 
-    audio_element_set_uri(fatfs_stream_reader, "/sdcard/system_beep.mp3");
-    audio_pipeline_reset_ringbuffer(pipeline);
-    audio_pipeline_reset_elements(pipeline);
-
-    // start mp3
-    audio_pipeline_run(pipeline);
-
-    ESP_LOGI(TAG_BEEP, "Listen for all pipeline events");
-    while (1) {
-        audio_event_iface_msg_t msg;
-        esp_err_t ret = audio_event_iface_listen(evt, &msg, portMAX_DELAY);
-        if (ret != ESP_OK) {
-            ESP_LOGE(TAG_BEEP, "Event interface error : %d", ret);
-            continue;
-        }
-        if (msg.source_type == AUDIO_ELEMENT_TYPE_UNKNOW) {
-            ESP_LOGD(TAG_BEEP, "Event received [source_type: AUDIO_ELEMENT_TYPE_UNKNOW, cmd: %d]", msg.cmd);
-        } else if (msg.source_type == AUDIO_ELEMENT_TYPE_ELEMENT) {
-            ESP_LOGD(TAG_BEEP, "Event received [source_type: AUDIO_ELEMENT_TYPE_ELEMENT, cmd: %d]", msg.cmd);
-        } else if (msg.source_type == AUDIO_ELEMENT_TYPE_PLAYER) {
-            ESP_LOGD(TAG_BEEP, "Event received [source_type: AUDIO_ELEMENT_TYPE_PLAYER, cmd: %d]", msg.cmd);
-        } else if (msg.source_type == AUDIO_ELEMENT_TYPE_SERVICE) {
-            ESP_LOGD(TAG_BEEP, "Event received [source_type: AUDIO_ELEMENT_TYPE_SERVICE, cmd: %d]", msg.cmd);
-        }else if (msg.source_type == AUDIO_ELEMENT_TYPE_PERIPH) {
-            ESP_LOGD(TAG_BEEP, "Event received [source_type: AUDIO_ELEMENT_TYPE_PERIPH, cmd: %d]", msg.cmd);
-        } else {
-            ESP_LOGD(TAG_BEEP, "Event received [source_type: %d, cmd: %d]", msg.source_type, msg.cmd);
-        }
+static void volume_save(int volume) {
+    nvs_handle nvs_config;
+    ESP_ERROR_CHECK(nvs_open("config", NVS_READWRITE, &nvs_config));
+    ESP_ERROR_CHECK(nvs_set_i32(nvs_config, "volume", volume));
+    ESP_ERROR_CHECK(nvs_commit(nvs_config));
+    nvs_close(nvs_config);
+    rtc_volume = volume;
+}
 
-        // start file
-        if (msg.source_type == AUDIO_ELEMENT_TYPE_ELEMENT && msg.source == (void *) mp3_decoder
-            && msg.cmd == AEL_MSG_CMD_REPORT_MUSIC_INFO) {
-            audio_element_info_t music_info = {0};
-            audio_element_getinfo(mp3_decoder, &music_info);
-            ESP_LOGI(TAG_BEEP, "Receive music info from mp3 decoder, sample_rates=%d, bits=%d, ch=%d",
-                    music_info.sample_rates, music_info.bits, music_info.channels);
-
-            audio_element_setinfo(i2s_stream_writer, &music_info);
-            i2s_stream_set_clk(i2s_stream_writer, music_info.sample_rates, music_info.bits, music_info.channels);
-            continue;
+static void beep_task(void *arg) { // do noot execute togehter with sound_task!
+    // no peripherals, SD card or pipeline: codec and I2S only, the tone is generated from beep_wave
+    audio_board_handle_t board_handle = audio_engine_codec();
+    if (rtc_volume < 0) { // RTC memory lost, e.g. first wakeup after a firmware update
+        nvs_init();
+        rtc_volume = volume_load();
+    }
+    int32_t volume = audio_engine_volume_gain(rtc_volume >= 0 ? rtc_volume : AUDIO_ENGINE_VOLUME_MAX);
+
+    ESP_LOGD(TAG_BEEP, "Start i2s");
+    i2s_config_t i2s_config = {
+        .mode = I2S_MODE_MASTER | I2S_MODE_TX,
+        .sample_rate = BEEP_SAMPLE_RATE,
+        .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
+        .channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT,
+        .communication_format = I2S_COMM_FORMAT_STAND_I2S,
+        .intr_alloc_flags = ESP_INTR_FLAG_LEVEL2,
+        .dma_buf_count = 3,
+        .dma_buf_len = 300,
+        .use_apll = true,
+        .tx_desc_auto_clear = true,
+    };
+    i2s_pin_config_t i2s_pins = {0};
+    ESP_ERROR_CHECK(i2s_driver_install(I2S_NUM_0, &i2s_config, 0, NULL));
+    ESP_ERROR_CHECK(get_i2s_pins(I2S_NUM_0, &i2s_pins));
+    ESP_ERROR_CHECK(i2s_set_pin(I2S_NUM_0, &i2s_pins));
+
+    int16_t frames[BEEP_SAMPLE_RATE / 100 * 2]; // 10 ms, stereo
+    int chunks = BEEP_DURATION_MS / 10;
+    for (int chunk = 0; chunk < chunks + 10; chunk++) { // 100 ms silence at the end flushes the DMA buffers
+        int gain = chunk < chunks ? 256 : 0;
+        if (chunk == 0 || chunk == chunks - 1) { // avoid clicks
+            gain = 128;
         }
-
-        // end of file
-        if (msg.source_type == AUDIO_ELEMENT_TYPE_ELEMENT && msg.source == (void *) i2s_stream_writer
-            && msg.cmd == AEL_MSG_CMD_REPORT_STATUS
-            && ((int)msg.data == AEL_STATUS_STATE_FINISHED)) {
-            ESP_LOGI(TAG_BEEP, "End of MP3");
-            break;
+        for (int i = 0; i < BEEP_SAMPLE_RATE / 100; i++) {
+            int16_t sample = (((beep_wave[i % 16] * gain) >> 8) * volume) >> 14;
+            frames[i * 2] = sample;
+            frames[i * 2 + 1] = sample;
         }
+        size_t written;
+        i2s_write(I2S_NUM_0, frames, sizeof(frames), &written, portMAX_DELAY);
     }
+    i2s_driver_uninstall(I2S_NUM_0);
+    audio_hal_ctrl_codec(board_handle->audio_hal, AUDIO_HAL_CODEC_MODE_DECODE, AUDIO_HAL_CTRL_STOP);
 
-    ESP_LOGD(TAG_BEEP, "Terminate");
-    audio_pipeline_terminate(pipeline);
-
-    ESP_LOGD(TAG_BEEP, "Unregister");
-    audio_pipeline_unregister(pipeline, fatfs_stream_reader);
-    audio_pipeline_unregister(pipeline, i2s_stream_writer);
-    audio_pipeline_unregister(pipeline, mp3_decoder);
-
-    ESP_LOGD(TAG_BEEP, "Remove listener");
-    audio_pipeline_remove_listener(pipeline);
-
-    ESP_LOGD(TAG_BEEP, "Stop periph");
-    esp_periph_set_stop_all(set);
-    audio_event_iface_remove_listener(esp_periph_set_get_event_iface(set), evt);
-
-    ESP_LOGD(TAG_BEEP, "Make sure audio_pipeline_remove_listener & audio_event_iface_remove_listener are called before destroying event_iface");
-    audio_event_iface_destroy(evt);
-
-    ESP_LOGD(TAG_BEEP, "Release all resources");
-    audio_pipeline_deinit(pipeline);
-    audio_element_deinit(fatfs_stream_reader);
-    audio_element_deinit(i2s_stream_writer);
-    audio_element_deinit(mp3_decoder);
-    //esp_periph_set_destroy(set); // TODO causes panic
+    int64_t awake_us = esp_timer_get_time(); // since app start, ROM and bootloader are not included
+    rtc_wakeups++;
+    rtc_awake_us += awake_us;
+    ESP_LOGI(TAG_BEEP, "Wake to sleep took %" PRId64 " ms, codec %" PRId64 " ms (wakeup %" PRIu32 ", average %" PRId64 " ms)",
+            awake_us / 1000, audio_engine_timing()->codec_us / 1000, rtc_wakeups, rtc_awake_us / rtc_wakeups / 1000);
 
     ESP_LOGI(TAG_BEEP, "Sleep");
     // go into deep sleep to save energy
@@ -189,111 +155,88 @@ static void beep_task(void *arg) { // do noot execute togehter with sound_task!
     // not reached vTaskDelete(NULL);
 }
 
-audio_pipeline_handle_t pipeline;
-audio_element_handle_t fatfs_stream_reader;
-int no_tags_consecutively = 0;
-
-static void rfid_task(void *arg) { // requires sound_task!
-    ESP_ERROR_CHECK(rc522_init());
+// logged every RFID_STATS_INTERVAL_MS
+static void rfid_stats_log(rfid_stats_t *stats) {
+    multi_heap_info_t heap;
+    heap_caps_get_info(&heap, MALLOC_CAP_8BIT);
+    ESP_LOGI(TAG_RFID, "Stats: %" PRIu32 " polls, %.1f I2C transactions/poll, %" PRIu32 " tag events, %" PRIu32 " NVS writes, %zu heap blocks",
+            stats->polls, stats->polls > 0 ? (float) stats->transactions / stats->polls : 0.0f, stats->posts,
+            position_store_writes(), heap.allocated_blocks);
+    stats->logged = esp_timer_get_time();
+}
 
-    char no[11];
-    char previous_no[11];
-    char sound_file[23];
-    char missing_sound_file[28];
-    previous_no[0] = 0;
-    while(no_tags_consecutively < SHUTDOWN_IF_NO_TAGS_CONSECUTIVELY) {
-        uint8_t* tag = rc522_get_tag();
-        no[0] = 0;
-        if (tag != NULL) {
-            sprintf(no, "%02x%02x%02x%02x%02x", tag[0], tag[1], tag[2], tag[3], tag[4]);
-            sprintf(sound_file, "/sdcard/%s.mp3", no);
-            sprintf(missing_sound_file, "%s_miss", sound_file);
-            /*printf("serial: ");
-            for(int i = 0; i < 5; i++) {
-                printf("%#x ", tag[i]);
-            }
-            printf("\n");*/
-            ESP_LOGD(TAG_RFID, "RFID tag found: %s", no);
-            free(tag);
-            no_tags_consecutively = 0;
-        } else {
-            no_tags_consecutively++;
-            ESP_LOGD(TAG_RFID, "RFID tag not found, no_tags_consecutively=%d", no_tags_consecutively);
+// plays the first playable track from track on, false at the end of the playlist
+static bool track_next(uint32_t track, char *playing_file) {
+    for (; playlist_path(track, playing_file); track++) {
+        if (audio_engine_retarget(playing_file, 0) == ESP_OK) {
+            return true;
         }
+        ESP_LOGW(TAG_SOUND, "Skipping track %" PRIu32 ": %s", track + 1, playing_file);
+    }
+    return false;
+}
 
-        if (strcmp(previous_no, no) != 0) { // tag changed
-            if (previous_no[0] != 0) { // stop pipeline
-                audio_pipeline_stop(pipeline);
-                audio_pipeline_wait_for_stop(pipeline);
-                audio_pipeline_terminate(pipeline);
-            }
-            if (no[0] == 0) {
-                ESP_LOGI(TAG_RFID, "Stop");
-            } else {
-                // check if file extsist
-                FILE *file = fopen(sound_file, "r");
-                if (file != NULL) { // file exists
-                    fclose(file);
-                    ESP_LOGI(TAG_RFID, "Play %s: %s", no, sound_file);
-
-                    // prepare pipeline
-                    audio_element_set_uri(fatfs_stream_reader, sound_file);
-                    audio_pipeline_reset_ringbuffer(pipeline);
-                    audio_pipeline_reset_elements(pipeline);
-
-                    // fetch offset
-                    nvs_handle nvs_position;
-                    esp_err_t ret1 = nvs_open("position", NVS_READONLY, &nvs_position);
-                    if (ret1 == ESP_ERR_NVS_NOT_FOUND) {
-                        ESP_LOGI(TAG_RFID, "No previous position found for %s", no);
-                    } else if (ret1 == ESP_OK) {
-                        int64_t position;
-                        esp_err_t ret2 = nvs_get_i64(nvs_position, no, &position);
-                        if (ret2 == ESP_ERR_NVS_NOT_FOUND) {
-                            ESP_LOGI(TAG_RFID, "No previous position found for %s", no);
-                        } else if (ret2 == ESP_OK) {
-                            ESP_LOGI(TAG_RFID, "Previous position found for %s: %" PRId64, no, position);
-                            audio_element_info_t info = {0};
-                            audio_element_getinfo(fatfs_stream_reader, &info);
-                            if (position > info.total_bytes) {
-                                ESP_LOGI(TAG_RFID, "Previous position for %s outside of total bytes: %" PRId64, no, info.total_bytes);
-                                info.byte_pos = 0;
-                            } else {
-                                info.byte_pos = position;
-                            }
-                            audio_element_setinfo(fatfs_stream_reader, &info);
-                        } else {
-                            ESP_ERROR_CHECK(ret2);
-                        }
-                    } else {
-                        ESP_ERROR_CHECK(ret1);
-                    }
-                    nvs_close(nvs_position);
-                    
-                    // start mp3
-                    audio_pipeline_run(pipeline);
-                } else { // file does not exist
-                    ESP_LOGI(TAG_RFID, "Not found %s: %s", no, sound_file);
-
-                    file = fopen(missing_sound_file, "w");
-                    fclose(file);
-                    
-                    // prepare pipeline
-                    audio_element_set_uri(fatfs_stream_reader, "/sdcard/system_not_found.mp3");
-                    audio_pipeline_reset_ringbuffer(pipeline);
-                    audio_pipeline_reset_elements(pipeline);
-
-                    // start mp3
-                    audio_pipeline_run(pipeline);
-                }
-            }
+// a new track reached the reader, either from pipeline_play() or gaplessly from the playlist; queues the one after it
+static int track_started(char *playing_file, char *playing_no, seek_index_t *index, bool *seekable) {
+    track_stream_current(audio_engine_reader(), playing_file);
+    int track = playlist_index(playing_file);
+    if (track < 0 || !playlist_no(playing_no)) { // system sound
+        playing_no[0] = 0;
+        *seekable = false;
+        return -1;
+    }
+    char next[PLAYLIST_PATH_MAX];
+    // a different format needs another link or resampler setup, the FINISHED handler starts it instead
+    bool gapless = playlist_path(track + 1, next) && audio_engine_gapless(next);
+    track_stream_set_next(audio_engine_reader(), gapless ? next : NULL);
+
+    seek_index_close(index);
+    *seekable = seek_index_open(index, playing_file) == ESP_OK;
+    if (*seekable && index->entries == 0) {
+        seek_index_build_async(playing_file);
+    } else if (*seekable && playlist_count() == 1) {
+        tag_catalog_set_duration(playing_no, seek_index_duration(index) / 1000);
+    }
+    return track;
+}
 
-            strcpy(previous_no, no);
+static void rfid_task(void *arg) { // starts together with sound_task, posts tag changes to it
+    boot_begin(BOOT_RFID_INIT);
+    ESP_ERROR_CHECK(rc522_init());
+    rc522_enable_cache(true);
+    if (RFID_IRQ_GPIO != GPIO_NUM_NC) {
+        esp_err_t ret = rc522_enable_irq(RFID_IRQ_GPIO);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG_RFID, "IRQ on GPIO %d not available (%d), polling", RFID_IRQ_GPIO, ret);
+        }
+    }
+    boot_end(BOOT_RFID_INIT);
+    boot_begin(BOOT_FIRST_READ);
+
+    rfid_poll_t poll;
+    rfid_poll_init(&poll);
+    bool running = true;
+    while (running) {
+        power_awake_begin(); // no light sleep during I2C transfers
+        running = rfid_poll(&poll);
+        boot_end(BOOT_FIRST_READ);
+
+        if (boot_wait(BOOT_CATALOG, 0)) {
+            boot_log();
         }
+        if (esp_timer_get_time() - poll.stats.logged > RFID_STATS_INTERVAL_MS * 1000LL) {
+            rfid_stats_log(&poll.stats);
+        }
+        power_awake_end();
 
-        vTaskDelay(2000 / portTICK_RATE_MS);
+        vTaskDelay(poll.interval_ms / portTICK_RATE_MS);
     }
 
+    player_event_t event = {.type = PLAYER_EVENT_SHUTDOWN, .posted_us = esp_timer_get_time()};
+    while (player_post(&event) != ESP_OK) {
+        vTaskDelay(RFID_POLL_INTERVAL_MS / portTICK_RATE_MS);
+    }
+    rfid_stats_log(&poll.stats);
     ESP_ERROR_CHECK(rc522_clear());
 
     ESP_LOGI(TAG_RFID, "Bye");
@@ -301,93 +244,148 @@ static void rfid_task(void *arg) { // requires sound_task!
     vTaskDelete(NULL);
 }
 
-static void sound_task(void *arg) { // controlled by rfid_task
-    audio_element_handle_t i2s_stream_writer, mp3_decoder;
-
-    ESP_LOGD(TAG_SOUND, "Initialize peripherals management");
-    esp_periph_config_t periph_cfg = DEFAULT_ESP_PERIPH_SET_CONFIG();
-    esp_periph_set_handle_t set = esp_periph_set_init(&periph_cfg);
-
-    ESP_LOGD(TAG_SOUND, "Initialize and start peripherals");
-    audio_board_key_init(set);
-    audio_board_sdcard_init(set, SD_MODE_1_LINE);
-
-    ESP_LOGD(TAG_SOUND, "Start codec chip");
-    audio_board_handle_t board_handle = audio_board_init();
-    audio_hal_ctrl_codec(board_handle->audio_hal, AUDIO_HAL_CODEC_MODE_DECODE, AUDIO_HAL_CTRL_START);
-
-    ESP_LOGD(TAG_SOUND, "Create audio pipeline for playback");
-    audio_pipeline_cfg_t pipeline_cfg = DEFAULT_AUDIO_PIPELINE_CONFIG();
-    pipeline = audio_pipeline_init(&pipeline_cfg);
-    mem_assert(pipeline);
-
-    ESP_LOGD(TAG_SOUND, "Create fatfs stream to read data from sdcard");
-    fatfs_stream_cfg_t fatfs_cfg = FATFS_STREAM_CFG_DEFAULT();
-    fatfs_cfg.type = AUDIO_STREAM_READER;
-    fatfs_stream_reader = fatfs_stream_init(&fatfs_cfg);
-
-    ESP_LOGD(TAG_SOUND, "Create i2s stream to write data to codec chip");
-    i2s_stream_cfg_t i2s_cfg = I2S_STREAM_CFG_DEFAULT();
-    i2s_cfg.type = AUDIO_STREAM_WRITER;
-    i2s_stream_writer = i2s_stream_init(&i2s_cfg);
-
-    ESP_LOGD(TAG_SOUND, "Create mp3 decoder to decode mp3 file");
-    mp3_decoder_cfg_t mp3_cfg = DEFAULT_MP3_DECODER_CONFIG();
-    mp3_decoder = mp3_decoder_init(&mp3_cfg);
-
-    ESP_LOGD(TAG_SOUND, "Register all elements to audio pipeline");
-    audio_pipeline_register(pipeline, fatfs_stream_reader, "file");
-    audio_pipeline_register(pipeline, mp3_decoder, "mp3");
-    audio_pipeline_register(pipeline, i2s_stream_writer, "i2s");
-
-    ESP_LOGD(TAG_SOUND, "Link it together [sdcard]-->fatfs_stream-->mp3_decoder-->i2s_stream-->[codec_chip]");
-    audio_pipeline_link(pipeline, (const char *[]) {"file", "mp3", "i2s"}, 3);
-
-    ESP_LOGD(TAG_SOUND, "Set up  event listener");
-    audio_event_iface_cfg_t evt_cfg = AUDIO_EVENT_IFACE_DEFAULT_CFG();
-    audio_event_iface_handle_t evt = audio_event_iface_init(&evt_cfg);
-
-    ESP_LOGD(TAG_SOUND, "Listening event from all elements of pipeline");
-    audio_pipeline_set_listener(pipeline, evt);
+static player_action_t player_step(player_state_t *state, player_event_type_t event) {
+    player_action_t action;
+    player_state_t next = player_transition(*state, event, &action);
+    if (next != *state || event != PLAYER_EVENT_BUTTON) {
+        ESP_LOGI(TAG_SOUND, "%s: %s -> %s", player_event_name(event), player_state_name(*state), player_state_name(next));
+    }
+    *state = next;
+    return action;
+}
 
-    ESP_LOGD(TAG_SOUND, "Listening event from peripherals");
-    audio_event_iface_set_listener(esp_periph_set_get_event_iface(set), evt);
+#if TRACE_ENABLED
+// i2s_stream counts written bytes in byte_pos, a timer checks it after the music info so sound_task goes on
+static esp_timer_handle_t i2s_trace_timer = NULL;
+static int64_t i2s_trace_pos = 0;
+static int i2s_trace_checks = 0;
+
+static void i2s_trace_check(void *arg) {
+    audio_element_info_t info = {0};
+    audio_element_getinfo((audio_element_handle_t) arg, &info);
+    if (info.byte_pos != i2s_trace_pos) {
+        trace(TRACE_I2S_WRITE, 0);
+    }
+    if (info.byte_pos != i2s_trace_pos || ++i2s_trace_checks >= I2S_TRACE_CHECKS) {
+        esp_timer_stop(i2s_trace_timer);
+    }
+}
 
-    TaskHandle_t rfid_handle = NULL;
-    xTaskCreate(rfid_task, "RFID", 4096, NULL, configMAX_PRIORITIES - 3, &rfid_handle);
+static void i2s_trace_start(audio_element_handle_t i2s_stream_writer) {
+    if (i2s_trace_timer == NULL) {
+        esp_timer_create_args_t args = {
+            .callback = i2s_trace_check,
+            .arg = i2s_stream_writer,
+            .name = "i2s_trace",
+        };
+        if (esp_timer_create(&args, &i2s_trace_timer) != ESP_OK) {
+            return;
+        }
+    }
+    audio_element_info_t info = {0};
+    audio_element_getinfo(i2s_stream_writer, &info);
+    i2s_trace_pos = info.byte_pos;
+    i2s_trace_checks = 0;
+    esp_timer_stop(i2s_trace_timer); // still running for the previous track
+    esp_timer_start_periodic(i2s_trace_timer, I2S_TRACE_INTERVAL_MS * 1000);
+}
+#endif
+
+static void sound_task(void *arg) { // owns the pipeline, controlled by player events
+    boot_begin(BOOT_STORAGE);
+    audio_engine_storage();
+    boot_end(BOOT_STORAGE);
+    // codec and RC522 share I2C_NUM_0, let rc522_init() create the bus first
+    if (!boot_wait(BOOT_RFID_INIT, 1000)) {
+        ESP_LOGW(TAG_SOUND, "RFID reader not ready");
+    }
+    boot_begin(BOOT_CODEC);
+    audio_engine_codec();
+    boot_end(BOOT_CODEC);
+    boot_begin(BOOT_PIPELINE);
+    ESP_ERROR_CHECK(audio_engine_init());
+    audio_event_iface_handle_t evt = audio_engine_events();
+    audio_element_handle_t reader = audio_engine_reader();
+    audio_element_handle_t i2s_stream_writer = audio_engine_writer();
+    ESP_ERROR_CHECK(player_listen(evt));
 
     // read volume from NVS
-    nvs_handle nvs_config;
-    ESP_ERROR_CHECK(nvs_open("config", NVS_READWRITE, &nvs_config));
-    int volume;
-    esp_err_t ret = nvs_get_i32(nvs_config, "volume", &volume);
-    if (ret == ESP_ERR_NVS_NOT_FOUND) {
-        ESP_LOGI(TAG_SOUND, "No previous volume found to restore");
-    } else if (ret == ESP_OK) {
-        ESP_LOGI(TAG_SOUND, "Restore previous volume: %d", volume);
-        audio_hal_set_volume(board_handle->audio_hal, volume);
-    } else {
-        ESP_ERROR_CHECK(ret);
-    }
-    nvs_close(nvs_config);
+    rtc_volume = volume_load();
+    int player_volume = rtc_volume >= 0 ? rtc_volume : AUDIO_ENGINE_VOLUME_MAX;
+    audio_engine_set_volume(player_volume);
+    boot_end(BOOT_PIPELINE);
 
-    char playing_file[23];
+    char playing_file[PLAYLIST_PATH_MAX];
     playing_file[0] = 0;
     char playing_no[11];
     playing_no[0] = 0;
+    int playing_track = -1;
 
-    time_t rewind_start = time(NULL);
     bool rewind = false;
-    time_t fastforward_start = time(NULL);
     bool fastforward = false;
 
-    bool shutdown = false;
+    seek_index_t index = {0};
+    bool seekable = false;
+    seek_scrub_t scrub = {0};
+
+    player_state_t state = PLAYER_IDLE;
+    int volume_pending = -1;
+    int64_t volume_changed = 0;
+    bool catalog = false; // built once the first events (music info of a tag found at power-on) are handled
 
     ESP_LOGI(TAG_SOUND, "Listen for all pipeline events");
     while (1) {
+        player_event_t event;
+        while (state != PLAYER_ASLEEP && player_receive(&event)) {
+            player_action_t action = player_step(&state, event.type);
+            switch (action) {
+                case PLAYER_ACTION_PLAY:
+                case PLAYER_ACTION_SWAP:
+                case PLAYER_ACTION_STOP:
+                    seek_scrub_stop(&scrub);
+                    // the old tag's last position, its bookkeeping must not see the new file (set on music info)
+                    if (playing_no[0] != 0) {
+                        player_save_position(playing_no, playing_track, &index, seekable);
+                    }
+                    playing_no[0] = 0;
+                    playing_track = -1;
+                    seekable = false;
+                    if (action == PLAYER_ACTION_STOP) {
+                        player_stop();
+                    } else {
+                        player_play(&event, action == PLAYER_ACTION_SWAP);
+                    }
+                    break;
+                case PLAYER_ACTION_SHUTDOWN:
+                    seek_scrub_stop(&scrub);
+                    if (!player_shutdown()) {
+                        player_step(&state, PLAYER_EVENT_EOF);
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+        if (state == PLAYER_ASLEEP) {
+            break;
+        }
+
+        int timeout_ms = catalog ? 2000 : 0;
+        timeout_ms = player_scrub_step(&index, &scrub, timeout_ms); // next snippet while a seek button is held
         audio_event_iface_msg_t msg;
-        esp_err_t ret = audio_event_iface_listen(evt, &msg, 2000 / portTICK_RATE_MS);
+        // rounded up to whole ticks, a scrub step due in less than a tick must not become a busy poll
+        TickType_t ticks = timeout_ms > 0 ? pdMS_TO_TICKS(timeout_ms + portTICK_PERIOD_MS - 1) : 0;
+        esp_err_t ret = audio_event_iface_listen(evt, &msg, ticks);
         if (ret == ESP_OK) { // no event, timeout, do some global checks
+            if (player_is_wake(&msg)) { // the events are drained at the top of the loop
+                continue;
+            }
+            bool button = msg.source_type == PERIPH_ID_BUTTON
+                && ((int)msg.data == get_input_rec_id() || (int)msg.data == get_input_mode_id());
+            if (button && player_step(&state, PLAYER_EVENT_BUTTON) != PLAYER_ACTION_BUTTON) {
+                continue;
+            }
+
             if (msg.source_type == AUDIO_ELEMENT_TYPE_UNKNOW) {
                 ESP_LOGD(TAG_SOUND, "Event received [source_type: AUDIO_ELEMENT_TYPE_UNKNOW, cmd: %d]", msg.cmd);
             } else if (msg.source_type == AUDIO_ELEMENT_TYPE_ELEMENT) {
@@ -404,126 +402,87 @@ static void sound_task(void *arg) { // controlled by rfid_task
 
             // volume down
             if ((int)msg.data == get_input_rec_id() && msg.cmd == PERIPH_BUTTON_RELEASE) {
-                int player_volume;
-                audio_hal_get_volume(board_handle->audio_hal, &player_volume);
-                player_volume -= 3;
-                if (player_volume < 3) {
-                    player_volume = 3;
+                player_volume -= AUDIO_ENGINE_VOLUME_STEP;
+                if (player_volume < AUDIO_ENGINE_VOLUME_STEP) {
+                    player_volume = AUDIO_ENGINE_VOLUME_STEP;
                 }
-                audio_hal_set_volume(board_handle->audio_hal, player_volume);
+                audio_engine_set_volume(player_volume);
                 ESP_LOGI(TAG_SOUND, "Volume decreased to %d %%", player_volume);
 
-                nvs_handle nvs_config;
-                ESP_ERROR_CHECK(nvs_open("config", NVS_READWRITE, &nvs_config));
-                ESP_ERROR_CHECK(nvs_set_i32(nvs_config, "volume", player_volume));
-                ESP_ERROR_CHECK(nvs_commit(nvs_config));
-                nvs_close(nvs_config);
+                volume_pending = player_volume;
+                volume_changed = esp_timer_get_time();
                 continue;
             }
 
             // start: rewind
             if ((int)msg.data == get_input_rec_id() && msg.cmd == PERIPH_BUTTON_LONG_PRESSED) {
                 ESP_LOGI(TAG_SOUND, "rewind, start");
-                audio_pipeline_pause(pipeline);
                 rewind = true;
-                rewind_start = time(NULL);
+                player_scrub_start(&index, &scrub, seekable, -1, fastforward);
                 continue;
             }
 
             // stop: rewind
             if ((int)msg.data == get_input_rec_id() && msg.cmd == PERIPH_BUTTON_LONG_RELEASE) {
-                double seconds = difftime(time(NULL), rewind_start);
-                ESP_LOGI(TAG_SOUND, "rewind, stop, seconds=%f", seconds);
-                audio_element_info_t info = {0};
-                audio_element_getinfo(fatfs_stream_reader, &info);
-                int64_t byte_offset = ((int64_t) (((double) (info.total_bytes / 100)) * seconds));
-                ESP_LOGI(TAG_SOUND, "rewind, current byte_pos=%" PRId64 ", byte_offset=%" PRId64 ", bytes=%" PRId64, info.byte_pos, byte_offset, info.total_bytes);
-                if (fastforward == true && rewind == true) { // both button pushed, reset to begin
-                    info.byte_pos = 0;
-                } else {
-                    if ((info.byte_pos - byte_offset) >= 0) {
-                        info.byte_pos -= byte_offset;
-                    } else {
-                        info.byte_pos = 0;
-                    }
-                }
-                audio_element_setinfo(fatfs_stream_reader, &info);
-                audio_pipeline_resume(pipeline);
+                ESP_LOGI(TAG_SOUND, "rewind, stop");
+                player_scrub_release(&index, &scrub, fastforward && rewind);
                 rewind = false;
                 continue;
             }
 
             // volume up
             if ((int)msg.data == get_input_mode_id() && msg.cmd == PERIPH_BUTTON_RELEASE) {
-                int player_volume;
-                audio_hal_get_volume(board_handle->audio_hal, &player_volume);
-                player_volume += 3;
-                if (player_volume > VOLUME_MAX) {
-                    player_volume = VOLUME_MAX;
+                player_volume += AUDIO_ENGINE_VOLUME_STEP;
+                if (player_volume > AUDIO_ENGINE_VOLUME_MAX) {
+                    player_volume = AUDIO_ENGINE_VOLUME_MAX;
                 }
-                audio_hal_set_volume(board_handle->audio_hal, player_volume);
+                audio_engine_set_volume(player_volume);
                 ESP_LOGI(TAG_SOUND, "Volume increased to %d %%", player_volume);
 
-                nvs_handle nvs_config;
-                ESP_ERROR_CHECK(nvs_open("config", NVS_READWRITE, &nvs_config));
-                ESP_ERROR_CHECK(nvs_set_i32(nvs_config, "volume", player_volume));
-                ESP_ERROR_CHECK(nvs_commit(nvs_config));
-                nvs_close(nvs_config);
+                volume_pending = player_volume;
+                volume_changed = esp_timer_get_time();
                 continue;
             }
 
             // start: fast-forward
             if ((int)msg.data == get_input_mode_id() && msg.cmd == PERIPH_BUTTON_LONG_PRESSED) {
                 ESP_LOGI(TAG_SOUND, "fast-forward, start");
-                audio_pipeline_pause(pipeline);
                 fastforward = true;
-                fastforward_start = time(NULL);
+                player_scrub_start(&index, &scrub, seekable, 1, rewind);
                 continue;
             }
 
             // stop: fast-forward
             if ((int)msg.data == get_input_mode_id() && msg.cmd == PERIPH_BUTTON_LONG_RELEASE) {
-                double seconds = difftime(time(NULL), fastforward_start);
-                ESP_LOGI(TAG_SOUND, "fast-forward, stop, seconds=%f", seconds);
-                audio_element_info_t info = {0};
-                audio_element_getinfo(fatfs_stream_reader, &info);
-                int64_t byte_offset = ((int64_t) (((double) (info.total_bytes / 100)) * seconds));
-                ESP_LOGI(TAG_SOUND, "fast-forward, current byte_pos=%" PRId64 ", byte_offset=%" PRId64 ", bytes=%" PRId64, info.byte_pos, byte_offset, info.total_bytes);
-                if (fastforward == true && rewind == true) { // both button pushed, reset to begin
-                    info.byte_pos = 0;
-                } else {
-                    if ((info.byte_pos + byte_offset) < info.total_bytes) {
-                        info.byte_pos += byte_offset;
-                    } else {
-                        info.byte_pos = info.total_bytes - 100000;
-                    }
-                }
+                ESP_LOGI(TAG_SOUND, "fast-forward, stop");
+                player_scrub_release(&index, &scrub, fastforward && rewind);
                 fastforward = false;
-                audio_element_setinfo(fatfs_stream_reader, &info);
-                audio_pipeline_resume(pipeline);
+                continue;
+            }
+
+            // next track of the playlist, the pipeline keeps running
+            if (msg.source_type == AUDIO_ELEMENT_TYPE_ELEMENT && msg.source == (void *) reader
+                && msg.cmd == AEL_MSG_CMD_REPORT_MUSIC_INFO) {
+                seek_scrub_stop(&scrub); // the target was in the previous track
+                playing_track = track_started(playing_file, playing_no, &index, &seekable);
+                ESP_LOGI(TAG_SOUND, "Continue with track %d: %s", playing_track + 1, playing_file);
                 continue;
             }
 
             // start file
-            if (msg.source_type == AUDIO_ELEMENT_TYPE_ELEMENT && msg.source == (void *) mp3_decoder
+            if (msg.source_type == AUDIO_ELEMENT_TYPE_ELEMENT && msg.source == (void *) audio_engine_decoder()
                 && msg.cmd == AEL_MSG_CMD_REPORT_MUSIC_INFO) {
-                if (strncmp("/sdcard/system_", audio_element_get_uri(fatfs_stream_reader), 15) == 0) {
-                    strcpy(playing_file, audio_element_get_uri(fatfs_stream_reader));
-                    playing_no[0] = 0;
-                } else {
-                    strcpy(playing_file, audio_element_get_uri(fatfs_stream_reader));
-                    memcpy(playing_no, &playing_file[8], 10);
-                    playing_no[10] = 0;
-                }
+                trace(TRACE_MUSIC_INFO, 0);
+                playing_track = track_started(playing_file, playing_no, &index, &seekable);
 
                 audio_element_info_t music_info = {0};
-                audio_element_getinfo(mp3_decoder, &music_info);
-
-                ESP_LOGI(TAG_SOUND, "Receive music info from mp3 decoder, %s, sample_rates=%d, bits=%d, ch=%d",
+                audio_engine_music_info(&music_info);
+                ESP_LOGI(TAG_SOUND, "Receive music info from decoder, %s, sample_rates=%d, bits=%d, ch=%d",
                         playing_file, music_info.sample_rates, music_info.bits, music_info.channels);
-
-                audio_element_setinfo(i2s_stream_writer, &music_info);
-                i2s_stream_set_clk(i2s_stream_writer, music_info.sample_rates, music_info.bits, music_info.channels);
+                trace(TRACE_SET_CLK, music_info.sample_rates / 100);
+#if TRACE_ENABLED
+                i2s_trace_start(i2s_stream_writer);
+#endif
                 continue;
             }
 
@@ -532,7 +491,9 @@ static void sound_task(void *arg) { // controlled by rfid_task
                 && msg.cmd == AEL_MSG_CMD_REPORT_STATUS
                 && ((int)msg.data == AEL_STATUS_STATE_STOPPED)) {
                 ESP_LOGI(TAG_SOUND, "Stop MP3: %s", playing_file);
-                if (strncmp("/sdcard/system_", audio_element_get_uri(fatfs_stream_reader), 15) == 0) {
+                seek_scrub_stop(&scrub); // a step would resume the stopped pipeline
+                track_stream_current(reader, playing_file);
+                if (strncmp("/sdcard/system_", playing_file, 15) == 0) {
                     playing_file[0] = 0;
                 } else {
                     playing_file[0] = 0;
@@ -545,91 +506,53 @@ static void sound_task(void *arg) { // controlled by rfid_task
             if (msg.source_type == AUDIO_ELEMENT_TYPE_ELEMENT && msg.source == (void *) i2s_stream_writer
                 && msg.cmd == AEL_MSG_CMD_REPORT_STATUS
                 && ((int)msg.data == AEL_STATUS_STATE_FINISHED)) {
-                if (strncmp("/sdcard/system_", audio_element_get_uri(fatfs_stream_reader), 15) == 0) {
-                    ESP_LOGI(TAG_SOUND, "End of MP3: %s, shutdown=%d)", playing_file, shutdown);
+                audio_engine_finished();
+                seek_scrub_stop(&scrub);
+                player_action_t action = player_step(&state, PLAYER_EVENT_EOF);
+                track_stream_current(reader, playing_file);
+                if (action == PLAYER_ACTION_SLEEP) {
+                    break;
+                } else if (action != PLAYER_ACTION_NEXT || strncmp("/sdcard/system_", playing_file, 15) == 0) {
+                    ESP_LOGI(TAG_SOUND, "End of MP3: %s", playing_file);
                     playing_file[0] = 0;
-                    if (shutdown == true) {
-                        break;
-                    }
+                } else if (playing_track >= 0 && track_next(playing_track + 1, playing_file)) { // next track could not be queued in time
+                    ESP_LOGI(TAG_SOUND, "End of track %d of %s, continue with %s", playing_track + 1, playing_no, playing_file);
                 } else {
                     ESP_LOGI(TAG_SOUND, "End of MP3: %s, erase last position for %s", playing_file, playing_no);
-                    nvs_handle nvs_position;
-                    ESP_ERROR_CHECK(nvs_open("position", NVS_READWRITE, &nvs_position));
-                    esp_err_t ret1 = nvs_erase_key(nvs_position, playing_no);
-                    if (ret1 == ESP_ERR_NVS_NOT_FOUND) {
-                        // already deleted
-                    } else {
-                        ESP_ERROR_CHECK(ret1);
-                    }
-                    nvs_close(nvs_position);
+                    position_store_erase(playing_no);
                     playing_file[0] = 0;
                     playing_no[0] = 0;
                 }
                 continue;
             }
         } else {
-            if (no_tags_consecutively >= SHUTDOWN_IF_NO_TAGS_CONSECUTIVELY) {
-                if (shutdown == false) {
-                    shutdown = true;
-
-                    // prepare pipeline
-                    audio_element_set_uri(fatfs_stream_reader, "/sdcard/system_beep.mp3");
-                    audio_pipeline_reset_ringbuffer(pipeline);
-                    audio_pipeline_reset_elements(pipeline);
-
-                    // start mp3
-                    audio_pipeline_run(pipeline);
-                }
+            if (!catalog) { // until then player_play() looks files up on the card
+                ESP_LOGD(TAG_SOUND, "Build tag catalog");
+                boot_begin(BOOT_CATALOG);
+                ESP_ERROR_CHECK(tag_catalog_init());
+                boot_end(BOOT_CATALOG);
+                catalog = true;
                 continue;
             }
         }
 
         if (playing_no[0] != 0) {
-            // store position
-            audio_element_info_t playing_info = {0};
-            audio_element_getinfo(fatfs_stream_reader, &playing_info);
-            if (playing_info.byte_pos > 30000) { // when the pipeline is stopped we receive file sizes of 0 bytes
-                ESP_LOGI(TAG_SOUND, "Save last position for %s: %" PRId64, playing_no, playing_info.byte_pos);
-                nvs_handle nvs_position;
-                ESP_ERROR_CHECK(nvs_open("position", NVS_READWRITE, &nvs_position));
-                esp_err_t ret1 = nvs_set_i64(nvs_position, playing_no, playing_info.byte_pos);
-                if (ret1 == ESP_ERR_NVS_NOT_ENOUGH_SPACE) {
-                    ESP_ERROR_CHECK(nvs_flash_erase());
-                    ESP_ERROR_CHECK(nvs_flash_init());
-                    ret1 = nvs_set_i64(nvs_position, playing_no, playing_info.byte_pos);
-                } 
-                ESP_ERROR_CHECK(ret1);
-                nvs_close(nvs_position);
-            } else {
-                ESP_LOGD(TAG_SOUND, "Skip last position for %s: %" PRId64, playing_no, playing_info.byte_pos);
-            }
+            player_save_position(playing_no, playing_track, &index, seekable);
+        }
+        position_store_flush_if_due();
+        tag_catalog_flush();
+        if (volume_pending >= 0 && esp_timer_get_time() - volume_changed > VOLUME_SAVE_DELAY_MS * 1000LL) {
+            volume_save(volume_pending);
+            volume_pending = -1;
         }
     }
+    if (volume_pending >= 0) {
+        volume_save(volume_pending);
+    }
 
-    ESP_LOGD(TAG_SOUND, "Terminate");
-    audio_pipeline_terminate(pipeline);
-
-    ESP_LOGD(TAG_SOUND, "Unregister");
-    audio_pipeline_unregister(pipeline, fatfs_stream_reader);
-    audio_pipeline_unregister(pipeline, i2s_stream_writer);
-    audio_pipeline_unregister(pipeline, mp3_decoder);
-
-    ESP_LOGD(TAG_SOUND, "Remove listener");
-    audio_pipeline_remove_listener(pipeline);
-
-    ESP_LOGD(TAG_SOUND, "Stop periph");
-    esp_periph_set_stop_all(set);
-    audio_event_iface_remove_listener(esp_periph_set_get_event_iface(set), evt);
-
-    ESP_LOGD(TAG_SOUND, "Make sure audio_pipeline_remove_listener & audio_event_iface_remove_listener are called before destroying event_iface");
-    audio_event_iface_destroy(evt);
-
-    ESP_LOGD(TAG_SOUND, "Release all resources");
-    audio_pipeline_deinit(pipeline);
-    audio_element_deinit(fatfs_stream_reader);
-    audio_element_deinit(i2s_stream_writer);
-    audio_element_deinit(mp3_decoder);
-    //esp_periph_set_destroy(set); // TODO causes panic
+    tag_catalog_flush();
+    audio_engine_deinit();
+    position_store_flush();
 
     ESP_LOGI(TAG_SOUND, "Sleep");
     // go into deep sleep to save energy
@@ -682,16 +605,11 @@ static void list_sdcard_db(void *user_data, char *url)
 }
 
 static void list_sdcard_task(void *arg) {
-    esp_periph_config_t periph_cfg = DEFAULT_ESP_PERIPH_SET_CONFIG();
-    esp_periph_set_handle_t set = esp_periph_set_init(&periph_cfg);
-
-    audio_board_sdcard_init(set, SD_MODE_1_LINE);
+    audio_engine_storage();
 
     sdcard_scan(list_sdcard_db, "/sdcard", 5, (const char *[]) {"mp3"}, 1, NULL);
 
-    esp_periph_set_stop_all(set);
-
-    //esp_periph_set_destroy(set); // TODO causes panic
+    audio_engine_deinit();
 
     vTaskDelete(NULL);
 }
@@ -703,30 +621,44 @@ void app_main(void)
     esp_log_level_set(TAG_RFID, ESP_LOG_INFO);
     esp_log_level_set(TAG_SOUND, ESP_LOG_INFO);
     esp_log_level_set(TAG_BEEP, ESP_LOG_INFO);
+    esp_log_level_set("ENGINE", ESP_LOG_INFO); // init phase timing
+    esp_log_level_set("BOOT", ESP_LOG_INFO);
+    esp_log_level_set("GAIN", ESP_LOG_INFO); // kernel cycles per sample
+    esp_log_level_set("PLAYER", ESP_LOG_INFO); // dropped events
     //esp_log_level_set("FATFS_STREAM", ESP_LOG_VERBOSE);
     //esp_log_level_set("SDCARD", ESP_LOG_VERBOSE);
     //esp_log_level_set("AUDIO_BOARD", ESP_LOG_VERBOSE);
     //esp_log_level_set("PERIPH_BUTTON", ESP_LOG_VERBOSE);
     //esp_log_level_set("PERIPH_TOUCH", ESP_LOG_VERBOSE);
 
-    esp_err_t ret = nvs_flash_init();
-    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-      ESP_ERROR_CHECK(nvs_flash_erase());
-      ret = nvs_flash_init();
-    } 
-    ESP_ERROR_CHECK(ret);
-
     switch (esp_sleep_get_wakeup_cause()) {
         case ESP_SLEEP_WAKEUP_TIMER:
             ESP_LOGI(TAG, "wakeup");
-            xTaskCreate(beep_task, "Beep", 4096, NULL, configMAX_PRIORITIES - 2, NULL);
+            xTaskCreatePinnedToCore(beep_task, "Beep", TASK_BEEP_STACK, NULL, TASK_BEEP_PRIO, NULL, TASK_BEEP_CORE);
             return;
         default:
             ESP_LOGI(TAG, "hello");
+            nvs_init();
+            esp_err_t ret = power_init();
+            if (ret != ESP_OK) {
+                ESP_LOGW(TAG, "Power management not available: %d", ret);
+            }
 
             //xTaskCreate(i2cscanner_task, "I2CScanner", 2048, NULL, configMAX_PRIORITIES - 3, NULL);
             //xTaskCreate(list_sdcard_task, "ListSDCard", 2048, NULL, configMAX_PRIORITIES - 3, NULL);
-            xTaskCreate(sound_task, "MP3", 4096, NULL, configMAX_PRIORITIES - 1, NULL);
+            ESP_ERROR_CHECK(position_store_init());
+            ESP_ERROR_CHECK(playlist_init());
+            trace_init();
+            boot_init();
+            player_init();
+            static StackType_t sound_stack[TASK_SOUND_STACK];
+            static StaticTask_t sound_tcb;
+            static StackType_t rfid_stack[TASK_RFID_STACK];
+            static StaticTask_t rfid_tcb;
+            monitor_init();
+            // RC522 init and the first read run while sound_task mounts the card and starts the codec
+            xTaskCreateStaticPinnedToCore(rfid_task, "RFID", sizeof(rfid_stack), NULL, TASK_RFID_PRIO, rfid_stack, &rfid_tcb, TASK_RFID_CORE);
+            xTaskCreateStaticPinnedToCore(sound_task, "MP3", sizeof(sound_stack), NULL, TASK_SOUND_PRIO, sound_stack, &sound_tcb, TASK_SOUND_CORE);
             return;
     }
 } 
@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "esp_log.h"
+
+#include "media_probe.h"
+
+static const char *TAG = "PROBE";
+
+#define MEDIA_PROBE_COMMENT_MAX 64 // longer tags (lyrics, cover art) are no gains and are skipped
+#define MEDIA_PROBE_FLAC_BLOCKS 8 // metadata blocks walked for VORBIS_COMMENT
+
+static const char *names[] = {"mp3", "aac", "m4a", "opus", "flac", "unknown"};
+static const int mp3_sample_rates[3] = {44100, 48000, 32000}; // MPEG 1, halved for MPEG 2, quartered for MPEG 2.5
+static const uint16_t mp3_bitrates_v1[15] = {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320};
+static const uint16_t mp3_bitrates_v2[15] = {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160};
+static const int adts_sample_rates[13] = {96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350};
+
+/* Length of the MPEG 1/2/2.5 layer III frame with header h, 0 if h is none (free format is not played either) */
+static uint32_t media_probe_mp3_frame(const uint8_t *h, media_format_t *format) {
+    if (h[0] != 0xFF || (h[1] & 0xE0) != 0xE0) {
+        return 0;
+    }
+    int version = (h[1] >> 3) & 0x03; // 3: MPEG 1, 2: MPEG 2, 0: MPEG 2.5
+    int layer = (h[1] >> 1) & 0x03; // 1: III
+    int bitrate = h[2] >> 4;
+    int rate = (h[2] >> 2) & 0x03;
+    if (version == 1 || layer != 1 || bitrate == 0 || bitrate == 0x0F || rate == 3) {
+        return 0;
+    }
+    format->type = MEDIA_MP3;
+    format->sample_rate = mp3_sample_rates[rate] >> (version == 3 ? 0 : version == 2 ? 1 : 2);
+    format->channels = (h[3] >> 6) == 3 ? 1 : 2;
+    uint32_t padding = (h[2] >> 1) & 0x01;
+    if (version == 3) {
+        return 144 * mp3_bitrates_v1[bitrate] * 1000 / format->sample_rate + padding;
+    }
+    return 72 * mp3_bitrates_v2[bitrate] * 1000 / format->sample_rate + padding;
+}
+
+/* True if a layer III frame header follows at pos, a sync word alone is common in other data */
+static bool media_probe_mp3_follows(FILE *file, long pos) {
+    uint8_t h[4];
+    media_format_t next;
+    return fseek(file, pos, SEEK_SET) == 0 && fread(h, 1, sizeof(h), file) == sizeof(h) && media_probe_mp3_frame(h, &next) > 0;
+}
+
+static bool media_probe_adts_frame(const uint8_t *h, media_format_t *format) {
+    if (h[0] != 0xFF || (h[1] & 0xF6) != 0xF0) { // sync, layer 0
+        return false;
+    }
+    int rate = (h[2] >> 2) & 0x0F;
+    int channels = ((h[2] & 0x01) << 2) | (h[3] >> 6);
+    if (rate >= 13 || channels == 0) {
+        return false;
+    }
+    format->type = MEDIA_AAC;
+    format->sample_rate = adts_sample_rates[rate];
+    format->channels = channels > 2 ? 2 : channels; // downmixed by the decoder
+    return true;
+}
+
+static uint32_t media_probe_le32(const uint8_t *p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static uint32_t media_probe_be32(const uint8_t *p) {
+    return (uint32_t) p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static uint32_t media_probe_syncsafe(const uint8_t *p) {
+    return (p[0] & 0x7F) << 21 | (p[1] & 0x7F) << 14 | (p[2] & 0x7F) << 7 | (p[3] & 0x7F);
+}
+
+// "REPLAYGAIN_TRACK_GAIN=-6.54 dB" or "R128_TRACK_GAIN=-1234" (Q7.8 dB towards -23 LUFS)
+static bool media_probe_gain_comment(const char *comment, int *gain) {
+    if (strncasecmp(comment, "REPLAYGAIN_TRACK_GAIN=", 22) == 0) {
+        *gain = (int) lroundf(strtof(comment + 22, NULL) * 100);
+        return true;
+    }
+    if (strncasecmp(comment, "R128_TRACK_GAIN=", 16) == 0) {
+        *gain = (int) (strtol(comment + 16, NULL, 10) * 100 / 256) + 500;
+        return true;
+    }
+    return false;
+}
+
+// Vorbis comments (FLAC VORBIS_COMMENT block, OpusTags packet) from the file position up to end
+static bool media_probe_comments_gain(FILE *file, long end, int *gain) {
+    uint8_t len[4];
+    if (fread(len, 1, 4, file) != 4 || fseek(file, media_probe_le32(len), SEEK_CUR) != 0 || fread(len, 1, 4, file) != 4) {
+        return false; // vendor string, comment count
+    }
+    uint32_t count = media_probe_le32(len);
+    char comment[MEDIA_PROBE_COMMENT_MAX];
+    for (uint32_t i = 0; i < count && fread(len, 1, 4, file) == 4; i++) {
+        uint32_t n = media_probe_le32(len);
+        long pos = ftell(file);
+        if (pos < 0 || n > end - pos) {
+            break;
+        }
+        if (n >= sizeof(comment)) {
+            fseek(file, n, SEEK_CUR);
+            continue;
+        }
+        if (fread(comment, 1, n, file) != n) {
+            break;
+        }
+        comment[n] = 0;
+        if (media_probe_gain_comment(comment, gain)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// TXXX frames of an ID3v2.3 or 2.4 tag, ISO-8859-1 or UTF-8 only
+static bool media_probe_id3_gain(FILE *file, const uint8_t *h, long size, int *gain) {
+    int version = h[3];
+    if (version != 3 && version != 4) {
+        return false;
+    }
+    long end = 10 + (size < MEDIA_PROBE_TAG_BYTES ? size : MEDIA_PROBE_TAG_BYTES);
+    long pos = 10;
+    uint8_t frame[10];
+    if (h[5] & 0x40) { // extended header
+        if (fseek(file, pos, SEEK_SET) != 0 || fread(frame, 1, 4, file) != 4) {
+            return false;
+        }
+        pos += version == 4 ? media_probe_syncsafe(frame) : media_probe_be32(frame) + 4;
+    }
+    char comment[MEDIA_PROBE_COMMENT_MAX];
+    while (pos + 10 <= end && fseek(file, pos, SEEK_SET) == 0 && fread(frame, 1, 10, file) == 10 && frame[0] != 0) {
+        uint32_t n = version == 4 ? media_probe_syncsafe(frame + 4) : media_probe_be32(frame + 4);
+        // encoding, description, 0, value
+        if (memcmp(frame, "TXXX", 4) == 0 && n > 1 && n < sizeof(comment) && fread(comment, 1, n, file) == n
+                && (comment[0] == 0 || comment[0] == 3)) {
+            comment[n] = 0;
+            size_t description = strlen(comment + 1);
+            if (1 + description < n) {
+                comment[1 + description] = '=';
+                if (media_probe_gain_comment(comment + 1, gain)) {
+                    return true;
+                }
+            }
+        }
+        pos += 10 + n;
+    }
+    return false;
+}
+
+static bool media_probe_flac_gain(FILE *file, long offset, int *gain) {
+    long pos = offset + 4; // behind fLaC
+    uint8_t h[4];
+    for (int i = 0; i < MEDIA_PROBE_FLAC_BLOCKS && fseek(file, pos, SEEK_SET) == 0 && fread(h, 1, 4, file) == 4; i++) {
+        long size = h[1] << 16 | h[2] << 8 | h[3];
+        if ((h[0] & 0x7F) == 4) { // VORBIS_COMMENT
+            return media_probe_comments_gain(file, pos + 4 + (size < MEDIA_PROBE_TAG_BYTES ? size : MEDIA_PROBE_TAG_BYTES), gain);
+        }
+        if (h[0] & 0x80) { // last block
+            break;
+        }
+        pos += 4 + size;
+    }
+    return false;
+}
+
+// OpusTags is the only packet of the second page, h is the first
+static bool media_probe_opus_gain(FILE *file, long offset, const uint8_t *h, int *gain) {
+    long pos = offset + 27 + h[26];
+    for (int i = 0; i < h[26]; i++) {
+        pos += h[27 + i];
+    }
+    uint8_t page[27 + 255];
+    if (fseek(file, pos, SEEK_SET) != 0 || fread(page, 1, 27, file) != 27 || memcmp(page, "OggS", 4) != 0
+            || fread(page + 27, 1, page[26], file) != page[26]) {
+        return false;
+    }
+    long size = 0;
+    for (int i = 0; i < page[26]; i++) {
+        size += page[27 + i];
+    }
+    char magic[8];
+    if (fread(magic, 1, 8, file) != 8 || memcmp(magic, "OpusTags", 8) != 0) {
+        return false;
+    }
+    long end = pos + 27 + page[26] + (size < MEDIA_PROBE_TAG_BYTES ? size : MEDIA_PROBE_TAG_BYTES);
+    return media_probe_comments_gain(file, end, gain);
+}
+
+// containers recognised by their first bytes, ESP_ERR_NOT_SUPPORTED if this one can not be played
+static esp_err_t media_probe_container(const uint8_t *h, size_t len, media_format_t *format) {
+    if (len >= 8 + 13 && memcmp(h, "fLaC", 4) == 0) { // STREAMINFO is the first metadata block
+        const uint8_t *info = h + 8;
+        format->type = MEDIA_FLAC;
+        format->sample_rate = (info[10] << 12) | (info[11] << 4) | (info[12] >> 4);
+        format->channels = ((info[12] >> 1) & 0x07) + 1;
+        return ESP_OK;
+    }
+    if (len >= 27 && memcmp(h, "OggS", 4) == 0) {
+        size_t packet = 27 + h[26]; // behind the segment table
+        if (len >= packet + 10 && memcmp(h + packet, "OpusHead", 8) == 0) {
+            format->type = MEDIA_OPUS;
+            format->sample_rate = 48000; // Opus always decodes to 48 kHz
+            format->channels = h[packet + 9];
+            return ESP_OK;
+        }
+        return ESP_ERR_NOT_SUPPORTED; // Vorbis and others
+    }
+    if (len >= 8 && memcmp(h + 4, "ftyp", 4) == 0) { // the format is in moov, possibly at the end of the file
+        format->type = MEDIA_M4A;
+        format->sample_rate = 0;
+        format->channels = 0;
+        return ESP_OK;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t media_probe(const char *path, media_format_t *format) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    uint8_t buffer[512];
+    size_t len = fread(buffer, 1, sizeof(buffer), file);
+    long offset = 0;
+    int gain = MEDIA_GAIN_NONE;
+    if (len >= 10 && buffer[0] == 'I' && buffer[1] == 'D' && buffer[2] == '3') { // skip ID3v2, size is syncsafe
+        long size = media_probe_syncsafe(buffer + 6);
+        media_probe_id3_gain(file, buffer, size, &gain);
+        offset = 10 + size;
+        if (buffer[5] & 0x10) { // footer
+            offset += 10;
+        }
+        len = fseek(file, offset, SEEK_SET) == 0 ? fread(buffer, 1, sizeof(buffer), file) : 0;
+    }
+
+    esp_err_t ret = media_probe_container(buffer, len, format);
+    if (ret == ESP_OK && format->type == MEDIA_FLAC) {
+        media_probe_flac_gain(file, offset, &gain);
+    } else if (ret == ESP_OK && format->type == MEDIA_OPUS) {
+        media_probe_opus_gain(file, offset, buffer, &gain);
+    }
+    // frame sync of MP3 and ADTS, not inside a container that was recognised
+    for (long scanned = 0; scanned < MEDIA_PROBE_SCAN_BYTES && ret == ESP_ERR_NOT_FOUND; scanned += len - 3) {
+        if (scanned > 0 && (fseek(file, offset + scanned, SEEK_SET) != 0 || (len = fread(buffer, 1, sizeof(buffer), file)) < 4)) {
+            break;
+        }
+        for (size_t i = 0; i + 3 < len; i++) {
+            if (media_probe_adts_frame(&buffer[i], format)) {
+                ret = ESP_OK;
+                break;
+            }
+            uint32_t length = media_probe_mp3_frame(&buffer[i], format);
+            if (length > 0 && media_probe_mp3_follows(file, offset + scanned + i + length)) {
+                ret = ESP_OK;
+                break;
+            }
+        }
+        if (len < 4) {
+            break;
+        }
+    }
+    fclose(file);
+    format->gain = gain;
+    if (ret == ESP_OK) {
+        ESP_LOGD(TAG, "%s: %s, %d Hz, %d ch, gain %d", path, names[format->type], format->sample_rate, format->channels, gain);
+    } else {
+        format->type = MEDIA_UNKNOWN;
+    }
+    return ret;
+}
+
+const char *media_type_name(media_type_t type) {
+    return names[type];
+}
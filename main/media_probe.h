@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#define MEDIA_PROBE_SCAN_BYTES 4096 // searched for the first frame behind the ID3v2 tag
+#define MEDIA_PROBE_TAG_BYTES 4096 // of the ID3v2 tag, FLAC metadata or OpusTags searched for the track gain
+#define MEDIA_GAIN_NONE INT16_MIN
+#define MEDIA_PATH_MAX (8 + 10 + 1 + 255 + 1) // /sdcard/<no>/<name>, FAT long names have up to 255 characters
+
+typedef enum {
+    MEDIA_MP3,
+    MEDIA_AAC, // ADTS
+    MEDIA_M4A,
+    MEDIA_OPUS, // in Ogg
+    MEDIA_FLAC,
+    MEDIA_UNKNOWN,
+} media_type_t;
+
+// file extensions that are played, the type is detected from the content (.ogg only with Opus inside)
+#define MEDIA_EXTENSIONS {"mp3", "aac", "m4a", "opus", "ogg", "flac"}
+#define MEDIA_EXTENSION_COUNT 6
+
+typedef struct {
+    media_type_t type;
+    int sample_rate; // 0 if the container does not tell cheaply (M4A), the decoder reports it
+    int channels;
+    int gain; // track gain in 1/100 dB towards -18 LUFS, MEDIA_GAIN_NONE if the file is not tagged
+} media_format_t;
+
+/*
+ * Detects the container of a file from its first bytes and reads the format from its header (MP3 frame,
+ * ADTS, OpusHead, FLAC STREAMINFO), without decoding. An MP3 is only taken for one if a layer III frame header
+ * is followed by another one at the frame length. Lets the engine pick decoder and resampler before the
+ * decoder reports music info. ESP_ERR_NOT_FOUND if the type is not recognised, ESP_ERR_NOT_SUPPORTED for a
+ * container that is recognised but can not be played (Ogg Vorbis); the type is MEDIA_UNKNOWN then.
+ * The track gain is read from REPLAYGAIN_TRACK_GAIN (ID3v2 TXXX frame, FLAC Vorbis comment) or R128_TRACK_GAIN
+ * (OpusTags, relative to -23 LUFS) in the first MEDIA_PROBE_TAG_BYTES of the tags.
+ */
+esp_err_t media_probe(const char *path, media_format_t *format);
+const char *media_type_name(media_type_t type);
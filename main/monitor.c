@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "ringbuf.h"
+
+#include "monitor.h"
+#include "power.h"
+#include "tasks.h"
+
+static const char *TAG = "MONITOR";
+
+typedef struct {
+    const char *name;
+    uint32_t caps;
+    size_t largest_low; // lowest largest free block seen so far
+    size_t allocated_blocks;
+} monitor_region_t;
+
+static monitor_region_t regions[] = {
+    { "internal", MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT, SIZE_MAX, 0 },
+    { "dma", MALLOC_CAP_DMA, SIZE_MAX, 0 },
+    { "32bit", MALLOC_CAP_32BIT, SIZE_MAX, 0 },
+};
+
+typedef struct {
+    TaskHandle_t handle;
+    uint32_t run_time;
+} monitor_run_time_t;
+
+static TaskStatus_t tasks[MONITOR_MAX_TASKS];
+static monitor_run_time_t run_times[MONITOR_MAX_TASKS]; // of the previous report
+static uint32_t total_run_time = 0;
+static char line[384];
+
+static audio_element_handle_t i2s_element = NULL;
+static esp_timer_handle_t i2s_timer = NULL;
+static bool i2s_primed = false;
+static bool i2s_empty = false;
+static uint32_t i2s_empty_runs = 0; // consecutive empty samples count once
+static uint32_t i2s_empty_samples = 0;
+
+static StackType_t monitor_stack[TASK_MONITOR_STACK];
+static StaticTask_t monitor_tcb;
+
+void monitor_log() {
+    // per task: core, CPU usage since the last report (% of one core) and stack left (StackType_t is a byte on the ESP32)
+    uint32_t total = 0;
+    UBaseType_t n = uxTaskGetSystemState(tasks, MONITOR_MAX_TASKS, &total);
+    uint32_t elapsed = total - total_run_time;
+    int len = 0;
+    line[0] = 0;
+    for (UBaseType_t i = 0; i < n; i++) {
+        uint32_t left = tasks[i].usStackHighWaterMark;
+        if (left < MONITOR_STACK_ALARM_BYTES) {
+            ESP_LOGW(TAG, "Task %s has only %" PRIu32 " bytes of stack left", tasks[i].pcTaskName, left);
+        }
+        uint32_t run_time = tasks[i].ulRunTimeCounter;
+        for (int j = 0; j < MONITOR_MAX_TASKS; j++) {
+            if (run_times[j].handle == tasks[i].xHandle) {
+                run_time -= run_times[j].run_time;
+                break;
+            }
+        }
+        int core = tasks[i].xCoreID == tskNO_AFFINITY ? -1 : tasks[i].xCoreID;
+        if (len < (int) sizeof(line)) {
+            len += snprintf(&line[len], sizeof(line) - len, " %s@%d=%" PRIu32 "%%/%" PRIu32, tasks[i].pcTaskName, core,
+                    elapsed > 0 ? (uint32_t) ((uint64_t) run_time * 100 / elapsed) : 0, left);
+        }
+    }
+    for (int j = 0; j < MONITOR_MAX_TASKS; j++) {
+        run_times[j].handle = j < n ? tasks[j].xHandle : NULL;
+        run_times[j].run_time = j < n ? tasks[j].ulRunTimeCounter : 0;
+    }
+    total_run_time = total;
+    ESP_LOGI(TAG, "Tasks (core=cpu/stack left):%s", line);
+    if (i2s_element != NULL) {
+        ESP_LOGI(TAG, "I2S input: empty %" PRIu32 " times, in %" PRIu32 " of the %d ms samples", i2s_empty_runs, i2s_empty_samples,
+                MONITOR_I2S_SAMPLE_MS);
+    }
+
+    // heap per capability region
+    for (int i = 0; i < (int) (sizeof(regions) / sizeof(regions[0])); i++) {
+        monitor_region_t *region = &regions[i];
+        multi_heap_info_t info;
+        heap_caps_get_info(&info, region->caps);
+        ESP_LOGI(TAG, "Heap %s: free=%u largest=%u min_free=%u allocated_blocks=%u (%+d)", region->name,
+                info.total_free_bytes, info.largest_free_block, info.minimum_free_bytes, info.allocated_blocks,
+                (int) info.allocated_blocks - (int) region->allocated_blocks);
+        region->allocated_blocks = info.allocated_blocks;
+        if (region->largest_low != SIZE_MAX && info.largest_free_block + MONITOR_SHRINK_ALARM_BYTES < region->largest_low) {
+            ESP_LOGW(TAG, "Largest free %s block shrank from %u to %u bytes", region->name, region->largest_low, info.largest_free_block);
+        }
+        if (info.largest_free_block < region->largest_low) {
+            region->largest_low = info.largest_free_block;
+        }
+    }
+    if (heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT) < MONITOR_HEAP_ALARM_BYTES) {
+        ESP_LOGW(TAG, "Largest free internal block below %d bytes", MONITOR_HEAP_ALARM_BYTES);
+    }
+
+    power_log();
+}
+
+static void monitor_task(void *arg) {
+    while (1) {
+        monitor_log();
+        vTaskDelay(MONITOR_INTERVAL_MS / portTICK_RATE_MS);
+    }
+}
+
+static void monitor_i2s_sample(void *arg) {
+    audio_element_state_t state = audio_element_get_state(i2s_element);
+    if (state == AEL_STATE_STOPPED || state == AEL_STATE_FINISHED || state == AEL_STATE_ERROR) {
+        esp_timer_stop(i2s_timer); // no wakeups while idle
+        return;
+    }
+    if (state != AEL_STATE_RUNNING) { // starting up or paused for seeking
+        return;
+    }
+    ringbuf_handle_t rb = audio_element_get_input_ringbuf(i2s_element);
+    bool empty = rb != NULL && rb_bytes_filled(rb) == 0;
+    if (!i2s_primed) { // the ringbuffer is empty until the decoder delivers its first frame
+        i2s_primed = !empty;
+        return;
+    }
+    if (empty) {
+        i2s_empty_samples++;
+        if (!i2s_empty) {
+            i2s_empty_runs++;
+        }
+    }
+    i2s_empty = empty;
+}
+
+void monitor_watch_i2s(audio_element_handle_t i2s) {
+    esp_timer_create_args_t args = {
+        .callback = monitor_i2s_sample,
+        .name = "i2s_empty",
+    };
+    if (esp_timer_create(&args, &i2s_timer) == ESP_OK) {
+        i2s_element = i2s;
+    }
+}
+
+void monitor_i2s_start() {
+    i2s_primed = false; // new file
+    i2s_empty = false;
+    if (i2s_timer != NULL && !esp_timer_is_active(i2s_timer)) {
+        esp_timer_start_periodic(i2s_timer, MONITOR_I2S_SAMPLE_MS * 1000);
+    }
+}
+
+void monitor_init() {
+    xTaskCreateStaticPinnedToCore(monitor_task, "Monitor", sizeof(monitor_stack), NULL, TASK_MONITOR_PRIO, monitor_stack, &monitor_tcb, TASK_MONITOR_CORE);
+}
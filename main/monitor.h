@@ -0,0 +1,27 @@
+#pragma once
+
+#include "audio_element.h"
+
+#define MONITOR_INTERVAL_MS 60000
+#define MONITOR_MAX_TASKS 24
+#define MONITOR_STACK_ALARM_BYTES 512 // stack high-water mark below this is logged as warning
+#define MONITOR_HEAP_ALARM_BYTES 16384 // largest free internal block below this is logged as warning
+#define MONITOR_SHRINK_ALARM_BYTES 1024 // largest free block dropping this far below its previous low
+#define MONITOR_I2S_SAMPLE_MS 10
+
+/*
+ * Logs stack high-water marks of all tasks and per capability free heap, largest free block and allocated
+ * blocks every MONITOR_INTERVAL_MS. Session long tasks use static stacks (xTaskCreateStatic), so the
+ * heap only holds the ADF pipeline and short lived buffers and the largest free block should stay flat.
+ */
+void monitor_init();
+void monitor_log();
+
+/*
+ * Samples the input ringbuffer of an i2s_stream every MONITOR_I2S_SAMPLE_MS while the element runs and counts
+ * how often (and how long) it is found empty. That is not an underrun yet, the I2S DMA buffers still play,
+ * but runs of empty samples show where the decoder barely keeps up. Sampling stops by itself when the element
+ * stops, monitor_i2s_start() resumes it.
+ */
+void monitor_watch_i2s(audio_element_handle_t i2s);
+void monitor_i2s_start();
@@ -0,0 +1,67 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+
+#include "player.h"
+
+static const char *TAG = "PLAYER";
+
+static QueueHandle_t queue = NULL;
+static StaticQueue_t queue_buffer;
+static uint8_t queue_storage[PLAYER_QUEUE_LENGTH * sizeof(player_event_t)];
+static audio_event_iface_handle_t wake = NULL; // its internal queue is a member of the pipeline listener's queue set
+
+static bool player_tag_event(player_event_type_t type) {
+    return type == PLAYER_EVENT_TAG_PLACED || type == PLAYER_EVENT_TAG_REMOVED;
+}
+
+void player_init() {
+    queue = xQueueCreateStatic(PLAYER_QUEUE_LENGTH, sizeof(player_event_t), queue_storage, &queue_buffer);
+}
+
+esp_err_t player_listen(audio_event_iface_handle_t listener) {
+    audio_event_iface_cfg_t cfg = AUDIO_EVENT_IFACE_DEFAULT_CFG();
+    cfg.internal_queue_size = 1; // one pending wake-up is enough, player_receive() drains all events
+    cfg.external_queue_size = 0;
+    cfg.wait_time = 0;
+    audio_event_iface_handle_t evt = audio_event_iface_init(&cfg);
+    if (evt == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t ret = audio_event_iface_set_msg_listener(evt, listener);
+    if (ret != ESP_OK) {
+        audio_event_iface_destroy(evt);
+        return ret;
+    }
+    wake = evt;
+    return ESP_OK;
+}
+
+esp_err_t player_post(const player_event_t *event) {
+    if (xQueueSend(queue, event, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Queue full, %s dropped", player_event_name(event->type));
+        return ESP_ERR_TIMEOUT;
+    }
+    if (wake != NULL) {
+        audio_event_iface_msg_t msg = {0};
+        msg.source = wake;
+        audio_event_iface_cmd(wake, &msg); // fails while a wake-up is pending, which is fine
+    }
+    return ESP_OK;
+}
+
+bool player_receive(player_event_t *event) {
+    while (xQueueReceive(queue, event, 0) == pdTRUE) {
+        player_event_t next;
+        if (player_tag_event(event->type) && xQueuePeek(queue, &next, 0) == pdTRUE && player_tag_event(next.type)) {
+            ESP_LOGD(TAG, "%s %s superseded", player_event_name(event->type), event->no);
+            continue;
+        }
+        return true;
+    }
+    return false;
+}
+
+bool player_is_wake(const audio_event_iface_msg_t *msg) {
+    return wake != NULL && msg->source == (void *) wake;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "audio_event_iface.h"
+#include "player_fsm.h"
+
+#define PLAYER_QUEUE_LENGTH 8
+
+typedef struct {
+    player_event_type_t type;
+    char no[11]; // PLAYER_EVENT_TAG_PLACED
+    int64_t posted_us;
+} player_event_t;
+
+/*
+ * Typed events for the player, posted by any task and received only by sound_task, the single owner of the
+ * pipeline. Posting never blocks, so the RFID poller keeps its cadence while a swap waits for the old
+ * stream to stop. A tag event followed by a newer one in the queue is skipped on receive.
+ * Once player_listen() linked the queue to the pipeline listener, a post also wakes audio_event_iface_listen().
+ */
+void player_init(); // before the first post
+esp_err_t player_listen(audio_event_iface_handle_t listener);
+esp_err_t player_post(const player_event_t *event); // ESP_ERR_TIMEOUT if the queue is full
+bool player_receive(player_event_t *event); // does not wait
+bool player_is_wake(const audio_event_iface_msg_t *msg);
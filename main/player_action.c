@@ -0,0 +1,192 @@
+#include <string.h>
+#include <inttypes.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "player_action.h"
+#include "audio_engine.h"
+#include "boot.h"
+#include "playlist.h"
+#include "position_store.h"
+#include "system_sound.h"
+#include "tag_catalog.h"
+#include "trace.h"
+
+static const char *TAG = "SOUND";
+
+// tag swaps, from the tag event to the pipeline run
+static uint32_t swaps = 0;
+static int64_t swap_us_total = 0;
+static int64_t swap_us_max = 0;
+
+static int64_t player_scrub_to(seek_index_t *index, seek_scrub_t *scrub, int64_t now) {
+    int64_t byte_pos = seek_index_offset(index, scrub->target_ms);
+    audio_engine_pause();
+    audio_engine_seek(byte_pos);
+    audio_engine_resume();
+    ESP_LOGD(TAG, "scrub, held=%" PRId64 " ms, speed=%d, target=%" PRId64 " ms",
+            (now - scrub->pressed_us) / 1000, seek_scrub_speed(now - scrub->pressed_us), scrub->target_ms);
+    return byte_pos;
+}
+
+void player_scrub_start(seek_index_t *index, seek_scrub_t *scrub, bool seekable, int direction, bool other_held) {
+    if (other_held) { // both buttons, the release jumps to the beginning
+        seek_scrub_stop(scrub);
+        return;
+    }
+    if (seekable) {
+        seek_index_refresh(index);
+        int64_t ms = seek_index_time(index, audio_engine_position());
+        int64_t duration = seek_index_duration(index);
+        ESP_LOGI(TAG, "scrub from %" PRId64 " ms, duration=%" PRId64 ", indexed=%d", ms, duration, index->entries > 0);
+        seek_scrub_start(scrub, direction, ms, duration, esp_timer_get_time());
+    }
+}
+
+int player_scrub_step(seek_index_t *index, seek_scrub_t *scrub, int timeout_ms) {
+    if (!seek_scrub_active(scrub)) {
+        return timeout_ms;
+    }
+    int64_t now = esp_timer_get_time();
+    if (seek_scrub_due_ms(scrub, now) <= 0 && seek_scrub_step(scrub, now)) {
+        player_scrub_to(index, scrub, now);
+    }
+    int64_t due = seek_scrub_due_ms(scrub, now);
+    return due < timeout_ms ? due : timeout_ms;
+}
+
+void player_scrub_release(seek_index_t *index, seek_scrub_t *scrub, bool both) {
+    if (both) {
+        audio_engine_pause();
+        audio_engine_seek(0);
+        audio_engine_resume();
+    } else if (seek_scrub_active(scrub)) { // the target of the release time, not of the last step
+        int64_t now = esp_timer_get_time();
+        seek_scrub_step(scrub, now);
+        int64_t byte_pos = player_scrub_to(index, scrub, now);
+        ESP_LOGI(TAG, "scrub to %" PRId64 " ms after %" PRId64 " ms held, landed at %" PRId64 " ms", scrub->target_ms,
+                (now - scrub->pressed_us) / 1000, seek_index_time(index, byte_pos));
+    }
+    seek_scrub_stop(scrub);
+}
+
+// the old stream drains while the tag is looked up
+void player_play(const player_event_t *event, bool swap) {
+    boot_begin(BOOT_FIRST_PLAY);
+    if (swap) {
+        audio_engine_stop();
+        trace(TRACE_PIPELINE_STOP, 0);
+    }
+    system_sound_stop();
+    const char *no = event->no;
+    char sound_file[PLAYLIST_PATH_MAX];
+    const char *uri = NULL;
+    int64_t position = 0;
+
+    boot_begin(BOOT_LOOKUP);
+    int64_t stored;
+    bool resume = position_store_get(no, &stored);
+
+    // check if file, playlist or directory exists
+    uint32_t size;
+    const char *extension;
+    tag_kind_t kind = tag_catalog_lookup(no, &size, &extension);
+    if (kind != TAG_KIND_NONE && playlist_load(no, kind, extension) == ESP_OK) {
+        // fetch track and offset
+        uint32_t track = 0;
+        int64_t position_ms = 0;
+        if (!resume) {
+            ESP_LOGI(TAG, "No previous position found for %s", no);
+        } else if (POSITION_TRACK(stored) < playlist_count()) {
+            track = POSITION_TRACK(stored);
+            position_ms = POSITION_MS(stored);
+        } else { // playlist got shorter
+            ESP_LOGI(TAG, "Previous track %" PRIu32 " of %s is gone", POSITION_TRACK(stored), no);
+        }
+        playlist_path(track, sound_file);
+        ESP_LOGI(TAG, "Play %s: %s (%" PRIu32 "/%" PRIu32 ")", no, sound_file, track + 1, playlist_count());
+        uri = sound_file;
+
+        seek_index_t index;
+        if (position_ms == 0) {
+            // start of the track
+        } else if (seek_index_open(&index, sound_file) == ESP_OK) {
+            position = seek_index_offset(&index, position_ms);
+            seek_index_close(&index);
+            ESP_LOGI(TAG, "Previous position found for %s: %" PRId64 " ms, byte_pos=%" PRId64, no, position_ms, position);
+        } else {
+            ESP_LOGI(TAG, "Previous position for %s not seekable", no);
+        }
+    } else { // file does not exist
+        ESP_LOGI(TAG, "Not found %s", no); // tag_catalog_flush() adds the _miss marker later
+        playlist_clear();
+
+        uri = "/sdcard/system_not_found.mp3";
+    }
+    boot_end(BOOT_LOOKUP);
+    trace(TRACE_LOOKUP, position > 0);
+    if (swap) {
+        audio_engine_wait_for_stop();
+        trace(TRACE_PIPELINE_STOPPED, 0);
+    }
+    if (strcmp(uri, "/sdcard/system_not_found.mp3") == 0 && system_sound_play("not_found", false) == ESP_OK) {
+        boot_end(BOOT_FIRST_PLAY);
+        if (swap) {
+            position_store_flush();
+        }
+        return; // played from flash
+    }
+    if (audio_engine_play(uri, position) != ESP_OK && uri == sound_file) { // not playable, e.g. Ogg Vorbis
+        playlist_clear();
+        uri = "/sdcard/system_not_found.mp3";
+        if (system_sound_play("not_found", false) != ESP_OK) {
+            audio_engine_play(uri, 0);
+        }
+    }
+    trace(TRACE_PIPELINE_RUN, 0);
+    boot_end(BOOT_FIRST_PLAY);
+    int64_t swap_us = esp_timer_get_time() - event->posted_us;
+    swaps++;
+    swap_us_total += swap_us;
+    if (swap_us > swap_us_max) {
+        swap_us_max = swap_us;
+    }
+    ESP_LOGI(TAG, "Swap to %s took %" PRId64 " ms (%" PRIu32 " swaps, avg %" PRId64 " ms, max %" PRId64 " ms)",
+            uri, swap_us / 1000, swaps, swap_us_total / swaps / 1000, swap_us_max / 1000);
+    if (swap) { // a removal merged into the swap, flushed like player_stop() once the new tag plays
+        position_store_flush();
+    }
+}
+
+void player_stop() {
+    audio_engine_stop();
+    trace(TRACE_PIPELINE_STOP, 0);
+    system_sound_stop();
+    ESP_LOGI(TAG, "Stop");
+    playlist_clear();
+    position_store_flush();
+    audio_engine_wait_for_stop();
+    trace(TRACE_PIPELINE_STOPPED, 0);
+}
+
+void player_save_position(const char *no, int track, seek_index_t *index, bool seekable) {
+    int64_t byte_pos = audio_engine_position();
+    if (byte_pos > PLAYER_POSITION_MIN_BYTES && seekable) {
+        int64_t ms = seek_index_time(index, byte_pos);
+        ESP_LOGD(TAG, "Save last position for %s: track %d, %" PRId64 " ms", no, track, ms);
+        position_store_set(no, POSITION_MAKE(track, ms));
+    } else {
+        ESP_LOGD(TAG, "Skip last position for %s: %" PRId64, no, byte_pos);
+    }
+}
+
+bool player_shutdown() {
+    audio_engine_stop();
+    audio_engine_wait_for_stop();
+    if (system_sound_play("beep", true) == ESP_OK) {
+        return false;
+    }
+    audio_engine_play("/sdcard/system_beep.mp3", 0);
+    return true;
+}
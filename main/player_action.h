@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdbool.h>
+#include "player.h"
+#include "seek_index.h"
+#include "seek_scrub.h"
+
+#define PLAYER_POSITION_MIN_BYTES 30000 // closer to the start the position is not saved, a stopped pipeline reports 0
+
+/*
+ * The actions of player_transition(), run by sound_task (the pipeline owner) and on the host by the
+ * simulation. Playing looks the tag up while the old stream drains; scrubbing seeks snippet by snippet
+ * while a seek button is held.
+ */
+void player_play(const player_event_t *event, bool swap); // PLAYER_ACTION_PLAY and PLAYER_ACTION_SWAP
+void player_stop(); // PLAYER_ACTION_STOP
+void player_save_position(const char *no, int track, seek_index_t *index, bool seekable); // into RAM, of the running pipeline
+bool player_shutdown(); // PLAYER_ACTION_SHUTDOWN, false if the beep is already over
+
+void player_scrub_start(seek_index_t *index, seek_scrub_t *scrub, bool seekable, int direction, bool other_held);
+int player_scrub_step(seek_index_t *index, seek_scrub_t *scrub, int timeout_ms); // the timeout until the next step
+void player_scrub_release(seek_index_t *index, seek_scrub_t *scrub, bool both); // both buttons: back to the start
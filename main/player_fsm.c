@@ -0,0 +1,54 @@
+#include "player_fsm.h"
+
+typedef struct {
+    player_state_t next;
+    player_action_t action;
+} player_transition_t;
+
+static const char *state_names[PLAYER_STATES] = {"idle", "playing", "shutting_down", "asleep"};
+static const char *event_names[PLAYER_EVENTS] = {"tag_placed", "tag_removed", "button", "eof", "shutdown"};
+
+static const player_transition_t transitions[PLAYER_STATES][PLAYER_EVENTS] = {
+    [PLAYER_IDLE] = {
+        [PLAYER_EVENT_TAG_PLACED] = {PLAYER_PLAYING, PLAYER_ACTION_PLAY},
+        [PLAYER_EVENT_TAG_REMOVED] = {PLAYER_IDLE, PLAYER_ACTION_NONE},
+        [PLAYER_EVENT_BUTTON] = {PLAYER_IDLE, PLAYER_ACTION_BUTTON}, // volume works without a tag
+        [PLAYER_EVENT_EOF] = {PLAYER_IDLE, PLAYER_ACTION_NONE}, // stopped right before the end
+        [PLAYER_EVENT_SHUTDOWN] = {PLAYER_SHUTTING_DOWN, PLAYER_ACTION_SHUTDOWN},
+    },
+    [PLAYER_PLAYING] = {
+        [PLAYER_EVENT_TAG_PLACED] = {PLAYER_PLAYING, PLAYER_ACTION_SWAP}, // removal coalesced away
+        [PLAYER_EVENT_TAG_REMOVED] = {PLAYER_IDLE, PLAYER_ACTION_STOP},
+        [PLAYER_EVENT_BUTTON] = {PLAYER_PLAYING, PLAYER_ACTION_BUTTON},
+        [PLAYER_EVENT_EOF] = {PLAYER_PLAYING, PLAYER_ACTION_NEXT},
+        [PLAYER_EVENT_SHUTDOWN] = {PLAYER_SHUTTING_DOWN, PLAYER_ACTION_SHUTDOWN},
+    },
+    [PLAYER_SHUTTING_DOWN] = { // the reader is off, only the end of the beep matters
+        [PLAYER_EVENT_TAG_PLACED] = {PLAYER_SHUTTING_DOWN, PLAYER_ACTION_NONE},
+        [PLAYER_EVENT_TAG_REMOVED] = {PLAYER_SHUTTING_DOWN, PLAYER_ACTION_NONE},
+        [PLAYER_EVENT_BUTTON] = {PLAYER_SHUTTING_DOWN, PLAYER_ACTION_NONE},
+        [PLAYER_EVENT_EOF] = {PLAYER_ASLEEP, PLAYER_ACTION_SLEEP},
+        [PLAYER_EVENT_SHUTDOWN] = {PLAYER_SHUTTING_DOWN, PLAYER_ACTION_NONE},
+    },
+    [PLAYER_ASLEEP] = {
+        [PLAYER_EVENT_TAG_PLACED] = {PLAYER_ASLEEP, PLAYER_ACTION_NONE},
+        [PLAYER_EVENT_TAG_REMOVED] = {PLAYER_ASLEEP, PLAYER_ACTION_NONE},
+        [PLAYER_EVENT_BUTTON] = {PLAYER_ASLEEP, PLAYER_ACTION_NONE},
+        [PLAYER_EVENT_EOF] = {PLAYER_ASLEEP, PLAYER_ACTION_NONE},
+        [PLAYER_EVENT_SHUTDOWN] = {PLAYER_ASLEEP, PLAYER_ACTION_NONE},
+    },
+};
+
+player_state_t player_transition(player_state_t state, player_event_type_t event, player_action_t *action) {
+    const player_transition_t *t = &transitions[state][event];
+    *action = t->action;
+    return t->next;
+}
+
+const char *player_state_name(player_state_t state) {
+    return state_names[state];
+}
+
+const char *player_event_name(player_event_type_t event) {
+    return event_names[event];
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+typedef enum {
+    PLAYER_IDLE, // no tag on the reader
+    PLAYER_PLAYING, // tag on the reader, its tracks or the not found sound play
+    PLAYER_SHUTTING_DOWN, // shutdown beep
+    PLAYER_ASLEEP,
+    PLAYER_STATES,
+} player_state_t;
+
+typedef enum {
+    PLAYER_EVENT_TAG_PLACED,
+    PLAYER_EVENT_TAG_REMOVED,
+    PLAYER_EVENT_BUTTON,
+    PLAYER_EVENT_EOF, // FINISHED of the I2S writer
+    PLAYER_EVENT_SHUTDOWN, // no tag for SHUTDOWN_IF_NO_TAGS_CONSECUTIVELY polls
+    PLAYER_EVENTS,
+} player_event_type_t;
+
+typedef enum {
+    PLAYER_ACTION_NONE,
+    PLAYER_ACTION_PLAY, // look the tag up and play it
+    PLAYER_ACTION_SWAP, // stop, then play
+    PLAYER_ACTION_STOP,
+    PLAYER_ACTION_BUTTON, // volume and seek
+    PLAYER_ACTION_NEXT, // next track, or forget the position at the end
+    PLAYER_ACTION_SHUTDOWN, // stop and beep
+    PLAYER_ACTION_SLEEP,
+} player_action_t;
+
+/*
+ * States and transitions of the player, owned by sound_task. Pure, no ESP-IDF dependencies: the next
+ * state and the action to run are looked up in a table, the action itself is up to the caller.
+ */
+player_state_t player_transition(player_state_t state, player_event_type_t event, player_action_t *action);
+const char *player_state_name(player_state_t state);
+const char *player_event_name(player_event_type_t event);
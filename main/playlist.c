@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+
+#include "playlist.h"
+#include "media_probe.h"
+
+static const char *TAG = "PLAYLIST";
+
+static char tracks[PLAYLIST_MAX_TRACKS][PLAYLIST_PATH_MAX];
+static uint32_t count = 0;
+static char playlist_tag[11];
+static SemaphoreHandle_t lock = NULL;
+
+static void playlist_add(const char *path) {
+    if (count >= PLAYLIST_MAX_TRACKS) {
+        ESP_LOGW(TAG, "More than %d tracks, skipping %s", PLAYLIST_MAX_TRACKS, path);
+        return;
+    }
+    if (strlcpy(tracks[count], path, PLAYLIST_PATH_MAX) >= PLAYLIST_PATH_MAX) {
+        ESP_LOGW(TAG, "Path too long, skipping %s", path);
+        return;
+    }
+    count++;
+}
+
+static bool playlist_playable(const char *name) {
+    static const char *extensions[MEDIA_EXTENSION_COUNT] = MEDIA_EXTENSIONS;
+    const char *ext = strrchr(name, '.');
+    for (int i = 0; ext != NULL && i < MEDIA_EXTENSION_COUNT; i++) {
+        if (strcasecmp(ext + 1, extensions[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int playlist_compare(const void *a, const void *b) {
+    return strcmp((const char *) a, (const char *) b);
+}
+
+static void playlist_load_directory(const char *no) {
+    char path[PLAYLIST_PATH_MAX];
+    snprintf(path, sizeof(path), "/sdcard/%s", no);
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_type == DT_REG && playlist_playable(entry->d_name)) {
+            if (snprintf(path, sizeof(path), "/sdcard/%s/%s", no, entry->d_name) >= (int) sizeof(path)) {
+                ESP_LOGW(TAG, "Path too long, skipping %s", entry->d_name);
+            } else {
+                playlist_add(path);
+            }
+        }
+    }
+    closedir(dir);
+    qsort(tracks, count, PLAYLIST_PATH_MAX, playlist_compare);
+}
+
+static void playlist_load_m3u(const char *no) {
+    char m3u[PLAYLIST_PATH_MAX];
+    snprintf(m3u, sizeof(m3u), "/sdcard/%s.m3u", no);
+    FILE *file = fopen(m3u, "r");
+    if (file == NULL) {
+        return;
+    }
+    static char line[PLAYLIST_LINE_MAX]; // under the lock
+    bool first = true;
+    bool rest = false; // of a line longer than the buffer
+    while (fgets(line, sizeof(line), file) != NULL) {
+        size_t n = strlen(line);
+        bool complete = (n > 0 && line[n - 1] == '\n') || feof(file);
+        if (rest || !complete) {
+            if (!rest) {
+                ESP_LOGW(TAG, "Line longer than %d bytes in %s, skipping it", PLAYLIST_LINE_MAX - 2, m3u);
+            }
+            rest = !complete;
+            continue;
+        }
+        char *start = line;
+        if (first && strncmp(start, "\xEF\xBB\xBF", 3) == 0) { // UTF-8 BOM of Windows editors
+            start += 3;
+        }
+        first = false;
+        char *end = line + n;
+        while (end > start && isspace((unsigned char) end[-1])) {
+            *--end = 0;
+        }
+        if (start[0] == 0 || start[0] == '#') {
+            continue;
+        }
+        char path[PLAYLIST_PATH_MAX];
+        struct stat st;
+        if (snprintf(path, sizeof(path), "%s%s", start[0] == '/' ? "" : "/sdcard/", start) >= (int) sizeof(path)) {
+            ESP_LOGW(TAG, "Path too long, skipping %s", start);
+        } else if (stat(path, &st) != 0) {
+            ESP_LOGW(TAG, "Not found, skipping %s", path);
+        } else {
+            playlist_add(path);
+        }
+    }
+    fclose(file);
+}
+
+esp_err_t playlist_init() {
+    lock = xSemaphoreCreateMutex();
+    return lock != NULL ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t playlist_load(const char *no, tag_kind_t kind, const char *extension) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    count = 0;
+    strlcpy(playlist_tag, no, sizeof(playlist_tag));
+    if (kind == TAG_KIND_DIRECTORY) {
+        playlist_load_directory(no);
+    } else if (kind == TAG_KIND_PLAYLIST) {
+        playlist_load_m3u(no);
+    } else if (kind == TAG_KIND_FILE) {
+        char path[PLAYLIST_PATH_MAX];
+        snprintf(path, sizeof(path), "/sdcard/%s.%s", no, extension);
+        playlist_add(path);
+    }
+    if (count == 0) {
+        playlist_tag[0] = 0;
+    }
+    uint32_t n = count;
+    xSemaphoreGive(lock);
+
+    ESP_LOGI(TAG, "%s: %" PRIu32 " tracks", no, n);
+    return n > 0 ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+void playlist_clear() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    count = 0;
+    playlist_tag[0] = 0;
+    xSemaphoreGive(lock);
+}
+
+bool playlist_no(char *no) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool found = playlist_tag[0] != 0;
+    strcpy(no, playlist_tag);
+    xSemaphoreGive(lock);
+    return found;
+}
+
+uint32_t playlist_count() {
+    return count;
+}
+
+bool playlist_path(uint32_t track, char *path) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool found = track < count;
+    if (found) {
+        strcpy(path, tracks[track]);
+    }
+    xSemaphoreGive(lock);
+    return found;
+}
+
+int playlist_index(const char *path) {
+    int index = -1;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (uint32_t i = 0; i < count && index < 0; i++) {
+        if (strcmp(tracks[i], path) == 0) {
+            index = i;
+        }
+    }
+    xSemaphoreGive(lock);
+    return index;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "tag_catalog.h"
+#include "media_probe.h"
+
+#define PLAYLIST_MAX_TRACKS 64
+#define PLAYLIST_PATH_MAX MEDIA_PATH_MAX
+#define PLAYLIST_LINE_MAX 258 // m3u line with CR LF, longer lines are skipped
+
+/*
+ * Tracks of the tag that is currently played: /sdcard/<no>.<ext> alone, the audio files of the directory /sdcard/<no>/
+ * in name order or the entries of /sdcard/<no>.m3u (paths relative to /sdcard, lines starting with # are skipped,
+ * so are entries with too long paths and files that do not exist).
+ * Loaded and read by sound_task, on a tag event and as tracks start.
+ */
+esp_err_t playlist_init();
+esp_err_t playlist_load(const char *no, tag_kind_t kind, const char *extension); // extension of TAG_KIND_FILE
+void playlist_clear();
+bool playlist_no(char *no); // false without playlist
+uint32_t playlist_count();
+bool playlist_path(uint32_t track, char *path); // path has PLAYLIST_PATH_MAX bytes
+int playlist_index(const char *path); // -1 if path is not part of the playlist
@@ -0,0 +1,282 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+#include "position_store.h"
+#include "seek_index.h"
+
+static const char *TAG = "POSITION";
+
+#define POSITION_STORE_NAMESPACE "resume" // milliseconds
+#define POSITION_STORE_LEGACY "position" // byte offsets into /sdcard/<no>.mp3, converted on first lookup
+
+typedef struct {
+    char no[11];
+    int64_t position;
+    uint32_t used; // LRU clock
+    bool valid;
+    bool dirty; // position differs from NVS
+    bool erased; // key has to be removed from NVS
+    bool legacy; // key still in POSITION_STORE_LEGACY, removed by the flush that writes the entry
+} position_entry_t;
+
+static position_entry_t entries[POSITION_STORE_MAX_ENTRIES];
+static uint32_t lru_clock = 0;
+static nvs_handle nvs_position;
+static nvs_handle nvs_legacy;
+static bool legacy_open = false;
+static SemaphoreHandle_t lock = NULL;
+static int64_t last_flush = 0;
+static uint32_t writes = 0;
+
+static position_entry_t *position_store_find(const char *no) {
+    for (int i = 0; i < POSITION_STORE_MAX_ENTRIES; i++) {
+        if ((entries[i].valid || entries[i].erased) && strcmp(entries[i].no, no) == 0) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+/* Least recently used entry that is not excluded, NULL if there is none */
+static position_entry_t *position_store_lru(position_entry_t *exclude) {
+    position_entry_t *lru = NULL;
+    for (int i = 0; i < POSITION_STORE_MAX_ENTRIES; i++) {
+        if (&entries[i] != exclude && (entries[i].valid || entries[i].erased) && (lru == NULL || entries[i].used < lru->used)) {
+            lru = &entries[i];
+        }
+    }
+    return lru;
+}
+
+static void position_store_evict(position_entry_t *entry) {
+    ESP_LOGI(TAG, "Evict position for %s", entry->no);
+    esp_err_t ret = nvs_erase_key(nvs_position, entry->no);
+    if (ret != ESP_OK && ret != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGW(TAG, "Evict %s failed: %d", entry->no, ret);
+    }
+    memset(entry, 0, sizeof(*entry));
+}
+
+esp_err_t position_store_init() {
+    if (lock == NULL) {
+        lock = xSemaphoreCreateMutex();
+    }
+    if (lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memset(entries, 0, sizeof(entries));
+
+    // byte offsets need the seek index of the file, they are converted tag by tag when first looked up
+    nvs_iterator_t legacy = nvs_entry_find(NVS_DEFAULT_PART_NAME, POSITION_STORE_LEGACY, NVS_TYPE_I64);
+    if (legacy != NULL) {
+        nvs_release_iterator(legacy);
+        legacy_open = nvs_open(POSITION_STORE_LEGACY, NVS_READWRITE, &nvs_legacy) == ESP_OK;
+    }
+
+    esp_err_t ret = nvs_open(POSITION_STORE_NAMESPACE, NVS_READWRITE, &nvs_position);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // load what fits
+    int n = 0;
+    bool overflow = false;
+    nvs_iterator_t it = nvs_entry_find(NVS_DEFAULT_PART_NAME, POSITION_STORE_NAMESPACE, NVS_TYPE_I64);
+    while (it != NULL) {
+        nvs_entry_info_t info;
+        nvs_entry_info(it, &info);
+        it = nvs_entry_next(it);
+
+        if (n < POSITION_STORE_MAX_ENTRIES && nvs_get_i64(nvs_position, info.key, &entries[n].position) == ESP_OK) {
+            strlcpy(entries[n].no, info.key, sizeof(entries[n].no));
+            entries[n].valid = true;
+            entries[n].used = lru_clock++;
+            n++;
+        } else {
+            overflow = true;
+        }
+    }
+
+    // anything beyond the limit is removed from NVS (not while iterating)
+    while (overflow) {
+        overflow = false;
+        it = nvs_entry_find(NVS_DEFAULT_PART_NAME, POSITION_STORE_NAMESPACE, NVS_TYPE_I64);
+        while (it != NULL) {
+            nvs_entry_info_t info;
+            nvs_entry_info(it, &info);
+            if (position_store_find(info.key) == NULL) {
+                nvs_release_iterator(it);
+                nvs_erase_key(nvs_position, info.key);
+                overflow = true;
+                break;
+            }
+            it = nvs_entry_next(it);
+        }
+    }
+
+    last_flush = esp_timer_get_time();
+    ESP_LOGI(TAG, "Loaded %d positions", n);
+    return nvs_commit(nvs_position);
+}
+
+/* Converts the byte offset of a former "position" key into ms, false if there is none or the file is not there (yet) */
+static bool position_store_migrate(const char *no, int64_t *position) {
+    int64_t offset;
+    if (nvs_get_i64(nvs_legacy, no, &offset) != ESP_OK) {
+        return false;
+    }
+    char path[32];
+    snprintf(path, sizeof(path), "/sdcard/%s.mp3", no);
+    seek_index_t index;
+    if (seek_index_open(&index, path) != ESP_OK) { // kept until the tag resolves
+        ESP_LOGI(TAG, "Legacy position for %s kept, %s not seekable", no, path);
+        return false;
+    }
+    int64_t total_bytes = index.total_bytes;
+    int64_t ms = seek_index_time(&index, offset);
+    seek_index_close(&index);
+    if (offset <= 0 || offset >= total_bytes) {
+        ESP_LOGI(TAG, "Legacy position for %s outside of %s, dropped", no, path);
+        nvs_erase_key(nvs_legacy, no);
+        nvs_commit(nvs_legacy);
+        return false;
+    }
+
+    *position = POSITION_MAKE(0, ms);
+    ESP_LOGI(TAG, "Legacy position for %s: byte_pos=%" PRId64 " -> %" PRId64 " ms", no, offset, (int64_t) POSITION_MS(*position));
+    position_store_set(no, *position);
+    xSemaphoreTake(lock, portMAX_DELAY);
+    position_entry_t *entry = position_store_find(no);
+    if (entry != NULL) {
+        entry->legacy = true;
+    }
+    xSemaphoreGive(lock);
+    return true;
+}
+
+bool position_store_get(const char *no, int64_t *position) {
+    bool found = false;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    position_entry_t *entry = position_store_find(no);
+    if (entry != NULL && entry->valid) {
+        entry->used = lru_clock++;
+        *position = entry->position;
+        found = true;
+    }
+    xSemaphoreGive(lock);
+    if (!found && legacy_open) { // SD card access outside the lock
+        found = position_store_migrate(no, position);
+    }
+    return found;
+}
+
+void position_store_set(const char *no, int64_t position) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    position_entry_t *entry = position_store_find(no);
+    if (entry == NULL) {
+        for (int i = 0; i < POSITION_STORE_MAX_ENTRIES && entry == NULL; i++) {
+            if (!entries[i].valid && !entries[i].erased) {
+                entry = &entries[i];
+            }
+        }
+        if (entry == NULL) {
+            entry = position_store_lru(NULL);
+            position_store_evict(entry);
+        }
+        strlcpy(entry->no, no, sizeof(entry->no));
+    }
+    if (!entry->valid || entry->position != position) {
+        entry->position = position;
+        entry->dirty = true;
+    }
+    entry->valid = true;
+    entry->erased = false;
+    entry->used = lru_clock++;
+    xSemaphoreGive(lock);
+}
+
+void position_store_erase(const char *no) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    position_entry_t *entry = position_store_find(no);
+    if (entry != NULL) {
+        entry->valid = false;
+        entry->dirty = false;
+        entry->erased = true;
+    }
+    xSemaphoreGive(lock);
+}
+
+esp_err_t position_store_flush() {
+    esp_err_t ret = ESP_OK;
+    uint32_t flushed = 0;
+    uint32_t migrated = 0;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (int i = 0; i < POSITION_STORE_MAX_ENTRIES && ret == ESP_OK; i++) {
+        position_entry_t *entry = &entries[i];
+        if (entry->erased) {
+            ret = nvs_erase_key(nvs_position, entry->no);
+            if (ret == ESP_ERR_NVS_NOT_FOUND) { // never flushed
+                ret = ESP_OK;
+            }
+            if (entry->legacy) {
+                nvs_erase_key(nvs_legacy, entry->no);
+                migrated++;
+            }
+            memset(entry, 0, sizeof(*entry));
+            flushed++;
+        } else if (entry->dirty) {
+            ret = nvs_set_i64(nvs_position, entry->no, entry->position);
+            while (ret == ESP_ERR_NVS_NOT_ENOUGH_SPACE) { // make room by dropping old tags instead of erasing the partition
+                position_entry_t *lru = position_store_lru(entry);
+                if (lru == NULL) {
+                    break;
+                }
+                position_store_evict(lru);
+                ret = nvs_set_i64(nvs_position, entry->no, entry->position);
+            }
+            if (ret == ESP_OK) {
+                entry->dirty = false;
+                flushed++;
+            }
+            if (ret == ESP_OK && entry->legacy) { // the old key goes once the new one is written
+                nvs_erase_key(nvs_legacy, entry->no);
+                entry->legacy = false;
+                migrated++;
+            }
+        }
+    }
+    if (flushed > 0 && ret == ESP_OK) {
+        ret = nvs_commit(nvs_position);
+        if (migrated > 0) {
+            nvs_commit(nvs_legacy);
+        }
+        writes += flushed;
+        ESP_LOGI(TAG, "Flushed %" PRIu32 " positions (%" PRIu32 " since boot)", flushed, writes);
+    }
+    last_flush = esp_timer_get_time();
+    xSemaphoreGive(lock);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Flush failed: %d", ret);
+    }
+    return ret;
+}
+
+esp_err_t position_store_flush_if_due() {
+    if (esp_timer_get_time() - last_flush < POSITION_STORE_FLUSH_INTERVAL_MS * 1000LL) {
+        return ESP_OK;
+    }
+    return position_store_flush();
+}
+
+uint32_t position_store_writes() {
+    return writes;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define POSITION_STORE_MAX_ENTRIES 64 // least recently used entries are evicted beyond this
+#define POSITION_STORE_FLUSH_INTERVAL_MS 30000
+
+// track index of a playlist in the upper bits, ms within the track below (single MP3s have track 0)
+#define POSITION_TRACK_SHIFT 40
+#define POSITION_MAKE(track, ms) (((int64_t) (track) << POSITION_TRACK_SHIFT) | (int64_t) (ms))
+#define POSITION_TRACK(position) ((uint32_t) ((position) >> POSITION_TRACK_SHIFT))
+#define POSITION_MS(position) ((position) & ((1LL << POSITION_TRACK_SHIFT) - 1))
+
+/*
+ * Playback positions (ms) per tag, kept in RAM and written to the "resume" NVS namespace in coalesced flushes.
+ * NVS itself appends entries and levels wear across its pages, we only have to keep the number of writes
+ * and keys down (and never erase the whole partition, which would also lose the volume).
+ * Byte offsets of the former "position" namespace are converted with the seek index when a tag is first looked up.
+ */
+esp_err_t position_store_init();
+bool position_store_get(const char *no, int64_t *position);
+void position_store_set(const char *no, int64_t position);
+void position_store_erase(const char *no);
+esp_err_t position_store_flush(); // call on tag removal and before deep sleep
+esp_err_t position_store_flush_if_due();
+uint32_t position_store_writes(); // NVS writes since boot
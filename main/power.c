@@ -0,0 +1,67 @@
+#include <stdio.h>
+
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "sdkconfig.h"
+
+#include "power.h"
+
+static const char *TAG = "POWER";
+
+static esp_pm_lock_handle_t cpu_lock = NULL;
+static esp_pm_lock_handle_t awake_lock = NULL;
+static bool locked = false; // playback locks held
+
+esp_err_t power_init() {
+#if CONFIG_PM_ENABLE
+    esp_pm_config_esp32_t config = {
+        .max_freq_mhz = POWER_MAX_FREQ_MHZ,
+        .min_freq_mhz = POWER_MIN_FREQ_MHZ,
+        .light_sleep_enable = true,
+    };
+    esp_err_t ret = esp_pm_configure(&config);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    ret = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "playback", &cpu_lock);
+    if (ret == ESP_OK) {
+        ret = esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "awake", &awake_lock);
+    }
+    ESP_LOGI(TAG, "%d-%d MHz with light sleep", POWER_MIN_FREQ_MHZ, POWER_MAX_FREQ_MHZ);
+    return ret;
+#else
+    return ESP_OK;
+#endif
+}
+
+void power_playback(bool playing) {
+    if (cpu_lock == NULL || __atomic_exchange_n(&locked, playing, __ATOMIC_SEQ_CST) == playing) { // rfid_task and sound_task
+        return;
+    }
+    if (playing) {
+        esp_pm_lock_acquire(cpu_lock);
+        esp_pm_lock_acquire(awake_lock);
+    } else {
+        esp_pm_lock_release(awake_lock);
+        esp_pm_lock_release(cpu_lock);
+    }
+    ESP_LOGD(TAG, "Playback %d", playing);
+}
+
+void power_awake_begin() {
+    if (awake_lock != NULL) {
+        esp_pm_lock_acquire(awake_lock);
+    }
+}
+
+void power_awake_end() {
+    if (awake_lock != NULL) {
+        esp_pm_lock_release(awake_lock);
+    }
+}
+
+void power_log() {
+#if CONFIG_PM_PROFILING
+    esp_pm_dump_locks(stdout); // time spent in each mode since boot, and lock hold times
+#endif
+}
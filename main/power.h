@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdbool.h>
+#include "esp_err.h"
+
+#define POWER_MAX_FREQ_MHZ 160
+#define POWER_MIN_FREQ_MHZ 40 // XTAL
+
+/*
+ * Dynamic frequency scaling and automatic light sleep (esp_pm). Without locks the chip idles at
+ * POWER_MIN_FREQ_MHZ and light-sleeps between RFID polls. Playback holds the CPU at POWER_MAX_FREQ_MHZ and
+ * keeps it awake, the RFID poll only keeps it awake for the I2C transfers. All calls are no-ops if
+ * CONFIG_PM_ENABLE is not set.
+ */
+esp_err_t power_init();
+void power_playback(bool playing); // only transitions count, repeated calls are ignored
+void power_awake_begin(); // nests
+void power_awake_end();
+void power_log(); // time per frequency, needs CONFIG_PM_PROFILING
@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "rc522.h"
+#include "rfid_poll.h"
+#include "player.h"
+#include "trace.h"
+
+static const char *TAG = "RFID";
+
+void rfid_poll_init(rfid_poll_t *poll) {
+    memset(poll, 0, sizeof(*poll));
+    poll->interval_ms = RFID_POLL_FAST_MS;
+}
+
+bool rfid_poll(rfid_poll_t *poll) {
+    char no[11];
+    rc522_uid_t uid;
+    bool present = poll->no[0] != 0;
+    bool verify = !present || (poll->stable_polls % RFID_VERIFY_EVERY) == 0;
+
+    trace(TRACE_RFID_POLL, poll->interval_ms);
+    uint32_t transactions = rc522_transactions();
+    esp_err_t ret = verify ? rc522_read_tag(&uid) : rc522_is_present(&uid);
+    // a single missed read does not remove a tag, confirm with a burst of quick re-reads
+    for (int i = 0; present && ret != ESP_OK && i < RFID_REMOVAL_CONFIRM_READS; i++) {
+        vTaskDelay(RFID_REMOVAL_CONFIRM_MS / portTICK_RATE_MS);
+        ret = verify ? rc522_read_tag(&uid) : rc522_is_present(&uid);
+    }
+    transactions = rc522_transactions() - transactions;
+    ESP_LOGD(TAG, "%s took %" PRIu32 " I2C transactions", verify ? "rc522_read_tag" : "rc522_is_present", transactions);
+    poll->stats.polls++;
+    poll->stats.transactions += transactions;
+    no[0] = 0;
+    if (ret == ESP_OK) { // both report the UID, a swapped figure is a change
+        uint8_t *tag = uid.bytes;
+        sprintf(no, "%02x%02x%02x%02x%02x", tag[0], tag[1], tag[2], tag[3], tag[4]);
+        ESP_LOGD(TAG, "RFID tag found: %s", no);
+        poll->no_tags_consecutively = 0;
+    } else {
+        poll->no_tags_consecutively++;
+        ESP_LOGD(TAG, "RFID tag not found (%d), no_tags_consecutively=%d", ret, poll->no_tags_consecutively);
+    }
+
+    if (strcmp(poll->no, no) != 0) { // tag changed, sound_task swaps while polling goes on
+        trace(TRACE_TAG_CHANGED, transactions);
+        player_event_t event = {
+            .type = no[0] == 0 ? PLAYER_EVENT_TAG_REMOVED : PLAYER_EVENT_TAG_PLACED,
+            .posted_us = esp_timer_get_time(),
+        };
+        strcpy(event.no, no);
+        if (player_post(&event) == ESP_OK) { // otherwise posted again with the next poll
+            strcpy(poll->no, no);
+            poll->stats.posts++;
+        }
+        poll->stable_polls = 0;
+        poll->interval_ms = RFID_POLL_FAST_MS;
+    } else { // back off while nothing changes
+        poll->stable_polls++;
+        poll->interval_ms *= 2;
+        if (no[0] == 0 && poll->interval_ms > RFID_POLL_INTERVAL_MS) {
+            poll->interval_ms = RFID_POLL_INTERVAL_MS; // keeps no_tags_consecutively a measure of time
+        } else if (poll->interval_ms > RFID_POLL_MAX_MS) {
+            poll->interval_ms = RFID_POLL_MAX_MS;
+        }
+    }
+    return poll->no_tags_consecutively < SHUTDOWN_IF_NO_TAGS_CONSECUTIVELY;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define RFID_POLL_INTERVAL_MS 250 // no tag: stays at this interval, so placing a figure is noticed quickly
+#define RFID_POLL_FAST_MS 50 // right after a change
+#define RFID_POLL_MAX_MS 1000 // tag present and stable
+#define RFID_VERIFY_EVERY 4 // REQA read with a computed HLTA on every n-th stable poll, WUPA presence checks in between
+#define RFID_REMOVAL_CONFIRM_READS 3
+#define RFID_REMOVAL_CONFIRM_MS 30
+#define SHUTDOWN_IF_NO_TAGS_CONSECUTIVELY (600000 / RFID_POLL_INTERVAL_MS) // 10 minutes
+
+// control path counters, logged by rfid_task
+typedef struct {
+    uint32_t polls;
+    uint32_t transactions; // I2C
+    uint32_t posts;
+    int64_t logged;
+} rfid_stats_t;
+
+typedef struct {
+    char no[11]; // tag posted last, empty without tag
+    int interval_ms; // until the next poll
+    int stable_polls;
+    int no_tags_consecutively;
+    rfid_stats_t stats;
+} rfid_poll_t;
+
+/*
+ * One poll of the RC522: a full UID read or a cheap presence check, a burst of re-reads before a tag counts
+ * as removed, and a player event when the tag changed. The interval backs off while nothing changes.
+ * rfid_task sleeps interval_ms between the polls.
+ */
+void rfid_poll_init(rfid_poll_t *poll);
+bool rfid_poll(rfid_poll_t *poll); // false once no tag was seen for SHUTDOWN_IF_NO_TAGS_CONSECUTIVELY polls
@@ -0,0 +1,406 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "seek_index.h"
+#include "tasks.h"
+
+static const char *TAG = "SEEK_INDEX";
+
+#define SEEK_INDEX_MAGIC 0x31494248 // "HBI1"
+#define SEEK_INDEX_SCAN_SIZE 2048 // window searched for a frame header
+#define SEEK_INDEX_MAX_RESYNC 65536
+
+typedef struct {
+    uint32_t magic;
+    uint32_t interval_ms;
+    uint32_t entries;
+    uint32_t mp3_size; // a changed file invalidates the index
+} seek_index_header_t;
+
+typedef struct {
+    uint32_t length;
+    uint32_t samples;
+    uint32_t sample_rate;
+    uint32_t bitrate;
+} seek_index_frame_t;
+
+static const uint16_t bitrates_v1[] = { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 };
+static const uint16_t bitrates_v2[] = { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 };
+static const uint32_t sample_rates[] = { 44100, 48000, 32000 };
+
+static uint8_t build_buf[4096];
+static uint8_t walk_buf[SEEK_INDEX_SCAN_SIZE]; // lookups run in sound_task only, the build has its own buffer
+static char build_path[MEDIA_PATH_MAX];
+static volatile bool building = false;
+static TaskHandle_t build_task = NULL; // created on the first build and kept, no stack churn per file
+static StackType_t build_stack[TASK_SEEK_INDEX_STACK];
+static StaticTask_t build_tcb;
+
+/* Parses an MPEG 1/2/2.5 layer III frame header */
+static bool seek_index_parse(const uint8_t *h, seek_index_frame_t *frame) {
+    if (h[0] != 0xFF || (h[1] & 0xE0) != 0xE0) {
+        return false;
+    }
+    uint8_t version = (h[1] >> 3) & 0x03; // 0: 2.5, 2: 2, 3: 1
+    uint8_t layer = (h[1] >> 1) & 0x03; // 1: III
+    uint8_t bitrate_index = h[2] >> 4;
+    uint8_t sample_rate_index = (h[2] >> 2) & 0x03;
+    uint8_t padding = (h[2] >> 1) & 0x01;
+    if (version == 1 || layer != 1 || bitrate_index == 0 || bitrate_index == 15 || sample_rate_index == 3) {
+        return false;
+    }
+
+    frame->sample_rate = sample_rates[sample_rate_index] >> (version == 3 ? 0 : (version == 2 ? 1 : 2));
+    if (version == 3) {
+        frame->bitrate = bitrates_v1[bitrate_index];
+        frame->samples = 1152;
+        frame->length = 144 * frame->bitrate * 1000 / frame->sample_rate + padding;
+    } else {
+        frame->bitrate = bitrates_v2[bitrate_index];
+        frame->samples = 576;
+        frame->length = 72 * frame->bitrate * 1000 / frame->sample_rate + padding;
+    }
+    return true;
+}
+
+/* Position of the first frame in buf that is followed by another valid frame, -1 if there is none */
+static int seek_index_find_frame(const uint8_t *buf, int n, seek_index_frame_t *frame) {
+    for (int i = 0; i + 4 <= n; i++) {
+        if (seek_index_parse(&buf[i], frame)) {
+            seek_index_frame_t next;
+            int j = i + frame->length;
+            if (j + 4 > n || seek_index_parse(&buf[j], &next)) { // can not check beyond the window
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+/* Size of the ID3v2 tag at the start of the file, 0 if there is none */
+static uint32_t seek_index_id3_size(FILE *file) {
+    uint8_t h[10];
+    if (fread(h, 1, sizeof(h), file) != sizeof(h) || memcmp(h, "ID3", 3) != 0) {
+        return 0;
+    }
+    uint32_t size = ((h[6] & 0x7F) << 21) | ((h[7] & 0x7F) << 14) | ((h[8] & 0x7F) << 7) | (h[9] & 0x7F);
+    return 10 + size + ((h[5] & 0x10) ? 10 : 0); // footer
+}
+
+static int64_t seek_index_align(seek_index_t *index, int64_t offset) {
+    FILE *file = fopen(index->path, "r");
+    if (file == NULL) {
+        return offset;
+    }
+    uint8_t *buf = malloc(SEEK_INDEX_SCAN_SIZE);
+    if (buf != NULL) {
+        fseek(file, offset, SEEK_SET);
+        int n = fread(buf, 1, SEEK_INDEX_SCAN_SIZE, file);
+        seek_index_frame_t frame;
+        int i = seek_index_find_frame(buf, n, &frame);
+        if (i >= 0) {
+            offset += i;
+        }
+        free(buf);
+    }
+    fclose(file);
+    return offset;
+}
+
+/* Samples before entry i, the build writes the first frame starting at or after i * SEEK_INDEX_INTERVAL_MS */
+static uint64_t seek_index_entry_samples(seek_index_t *index, uint32_t i) {
+    uint64_t samples = ((uint64_t) i * SEEK_INDEX_INTERVAL_MS * index->sample_rate + 999) / 1000;
+    return (samples + index->frame_samples - 1) / index->frame_samples * index->frame_samples;
+}
+
+/*
+ * Walks the frame headers from the frame at *offset with *samples before it, up to the frame that contains
+ * to_samples. At most one index interval is read, in SEEK_INDEX_SCAN_SIZE chunks.
+ */
+static void seek_index_walk(seek_index_t *index, int64_t *offset, uint64_t *samples, uint64_t to_samples) {
+    FILE *file = fopen(index->path, "r");
+    if (file == NULL) {
+        return;
+    }
+    int64_t buf_start = 0;
+    int buf_len = 0;
+    for (;;) {
+        if (*offset < buf_start || *offset + 4 > buf_start + buf_len) {
+            fseek(file, *offset, SEEK_SET);
+            buf_start = *offset;
+            buf_len = fread(walk_buf, 1, sizeof(walk_buf), file);
+            if (buf_len < 4) {
+                break;
+            }
+        }
+        seek_index_frame_t frame;
+        if (!seek_index_parse(&walk_buf[*offset - buf_start], &frame) || *samples + frame.samples > to_samples) {
+            break;
+        }
+        *samples += frame.samples;
+        *offset += frame.length;
+    }
+    fclose(file);
+}
+
+esp_err_t seek_index_open(seek_index_t *index, const char *path) {
+    memset(index, 0, sizeof(*index));
+    if (strlcpy(index->path, path, sizeof(index->path)) >= sizeof(index->path)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    strlcpy(index->idx_path, path, sizeof(index->idx_path));
+    char *ext = strrchr(index->idx_path, '.');
+    if (ext == NULL || strcasecmp(ext, ".mp3") != 0) { // frame parsing is MP3 only, other formats are not seekable
+        return ESP_ERR_INVALID_ARG;
+    }
+    strcpy(ext, ".idx");
+
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    index->total_bytes = st.st_size;
+
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+    uint8_t *buf = malloc(SEEK_INDEX_SCAN_SIZE);
+    if (buf == NULL) {
+        ret = ESP_ERR_NO_MEM;
+    } else {
+        index->data_start = seek_index_id3_size(file);
+        fseek(file, index->data_start, SEEK_SET);
+        int n = fread(buf, 1, SEEK_INDEX_SCAN_SIZE, file);
+        seek_index_frame_t frame;
+        int i = seek_index_find_frame(buf, n, &frame);
+        if (i >= 0) {
+            index->data_start += i;
+            index->bitrate = frame.bitrate;
+            index->sample_rate = frame.sample_rate;
+            index->frame_samples = frame.samples;
+            ret = ESP_OK;
+        }
+        free(buf);
+    }
+    fclose(file);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    seek_index_refresh(index);
+    return ESP_OK;
+}
+
+bool seek_index_refresh(seek_index_t *index) {
+    if (index->entries > 0) {
+        return true;
+    }
+    FILE *idx = fopen(index->idx_path, "r");
+    if (idx == NULL) {
+        return false;
+    }
+    seek_index_header_t header;
+    if (fread(&header, sizeof(header), 1, idx) != 1 || header.magic != SEEK_INDEX_MAGIC
+        || header.interval_ms != SEEK_INDEX_INTERVAL_MS || header.mp3_size != index->total_bytes) {
+        ESP_LOGI(TAG, "Stale index %s", index->idx_path);
+    } else if (header.entries > 0 && (index->offsets = malloc(header.entries * sizeof(uint32_t))) == NULL) {
+        ESP_LOGW(TAG, "No memory for %" PRIu32 " entries of %s, estimating", header.entries, index->idx_path);
+    } else if (fread(index->offsets, sizeof(uint32_t), header.entries, idx) != header.entries) {
+        ESP_LOGW(TAG, "Truncated index %s", index->idx_path);
+        free(index->offsets);
+        index->offsets = NULL;
+    } else {
+        index->entries = header.entries;
+    }
+    fclose(idx);
+    return index->entries > 0;
+}
+
+void seek_index_close(seek_index_t *index) {
+    free(index->offsets);
+    memset(index, 0, sizeof(*index));
+}
+
+int64_t seek_index_offset(seek_index_t *index, int64_t ms) {
+    if (ms <= 0) {
+        return index->data_start;
+    }
+    if (index->entries > 0) {
+        uint32_t i = ms / SEEK_INDEX_INTERVAL_MS;
+        if (i >= index->entries) {
+            i = index->entries - 1;
+        }
+        int64_t offset = index->offsets[i];
+        uint64_t samples = seek_index_entry_samples(index, i);
+        seek_index_walk(index, &offset, &samples, (uint64_t) ms * index->sample_rate / 1000);
+        return offset;
+    }
+
+    // estimate from the first frame (exact for CBR) and move to the next frame header
+    int64_t offset = index->data_start + ms * index->bitrate / 8;
+    if (offset >= index->total_bytes) {
+        offset = index->total_bytes - 1;
+    }
+    return seek_index_align(index, offset);
+}
+
+int64_t seek_index_time(seek_index_t *index, int64_t offset) {
+    if (offset <= index->data_start || index->bitrate == 0) {
+        return 0;
+    }
+    if (index->entries > 0) {
+        // last entry at or before offset
+        uint32_t lo = 0;
+        uint32_t hi = index->entries - 1;
+        while (lo < hi) {
+            uint32_t mid = (lo + hi + 1) / 2;
+            if (index->offsets[mid] <= offset) {
+                lo = mid;
+            } else {
+                hi = mid - 1;
+            }
+        }
+        // between it and the next one at their byte rate, the last interval at the rate of the one before
+        uint32_t a = lo + 1 < index->entries ? lo : (lo > 0 ? lo - 1 : lo);
+        uint64_t samples = seek_index_entry_samples(index, lo);
+        if (a + 1 < index->entries && offset > index->offsets[lo]) {
+            uint64_t span = seek_index_entry_samples(index, a + 1) - seek_index_entry_samples(index, a);
+            samples += (offset - index->offsets[lo]) * span / (index->offsets[a + 1] - index->offsets[a]);
+            samples -= samples % index->frame_samples; // start of the frame that contains offset
+        }
+        return samples * 1000 / index->sample_rate;
+    }
+    return (offset - index->data_start) * 8 / index->bitrate;
+}
+
+int64_t seek_index_duration(seek_index_t *index) {
+    if (index->entries > 0) {
+        return (int64_t) index->entries * SEEK_INDEX_INTERVAL_MS;
+    }
+    return seek_index_time(index, index->total_bytes);
+}
+
+esp_err_t seek_index_build(const char *path) {
+    int64_t start = esp_timer_get_time();
+    seek_index_t index;
+    esp_err_t ret = seek_index_open(&index, path);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (index.entries > 0) {
+        seek_index_close(&index);
+        return ESP_OK;
+    }
+
+    char tmp_path[MEDIA_PATH_MAX];
+    strlcpy(tmp_path, index.idx_path, sizeof(tmp_path));
+    strcpy(strrchr(tmp_path, '.'), ".tmp");
+
+    FILE *mp3 = fopen(path, "r");
+    if (mp3 == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    FILE *idx = fopen(tmp_path, "w");
+    if (idx == NULL) {
+        fclose(mp3);
+        return ESP_FAIL;
+    }
+
+    seek_index_header_t header = {
+        .magic = SEEK_INDEX_MAGIC,
+        .interval_ms = SEEK_INDEX_INTERVAL_MS,
+        .entries = 0,
+        .mp3_size = index.total_bytes,
+    };
+    fwrite(&header, sizeof(header), 1, idx);
+
+    int64_t buf_start = 0;
+    int buf_len = 0;
+    int64_t pos = index.data_start;
+    uint64_t samples = 0;
+    uint32_t sample_rate = 0;
+    uint32_t resync = 0;
+    for (;;) {
+        if (pos < buf_start || pos + 4 > buf_start + buf_len) { // refill
+            fseek(mp3, pos, SEEK_SET);
+            buf_start = pos;
+            buf_len = fread(build_buf, 1, sizeof(build_buf), mp3);
+            if (buf_len < 4) {
+                break;
+            }
+        }
+        seek_index_frame_t frame;
+        if (!seek_index_parse(&build_buf[pos - buf_start], &frame)) {
+            pos++;
+            if (++resync > SEEK_INDEX_MAX_RESYNC) { // trailing tags or garbage
+                break;
+            }
+            continue;
+        }
+        resync = 0;
+        if (sample_rate == 0) {
+            sample_rate = frame.sample_rate;
+        }
+        if (samples * 1000 / sample_rate >= (uint64_t) header.entries * SEEK_INDEX_INTERVAL_MS) {
+            uint32_t offset = pos;
+            fwrite(&offset, sizeof(offset), 1, idx);
+            header.entries++;
+        }
+        samples += frame.samples;
+        pos += frame.length;
+    }
+    fclose(mp3);
+
+    fseek(idx, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, idx);
+    fclose(idx);
+
+    if (header.entries == 0) {
+        remove(tmp_path);
+        return ESP_ERR_NOT_FOUND;
+    }
+    remove(index.idx_path);
+    if (rename(tmp_path, index.idx_path) != 0) {
+        remove(tmp_path);
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Built %s in %" PRId64 " ms: %" PRIu32 " entries, %u bytes, %" PRIu64 " s",
+            index.idx_path, (esp_timer_get_time() - start) / 1000, header.entries,
+            (unsigned) (sizeof(header) + header.entries * sizeof(uint32_t)), samples / sample_rate);
+    return ESP_OK;
+}
+
+static void seek_index_build_task(void *arg) {
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        esp_err_t ret = seek_index_build(build_path);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "Building index for %s failed: %d", build_path, ret);
+        }
+        building = false;
+    }
+}
+
+void seek_index_build_async(const char *path) {
+    if (building) {
+        return;
+    }
+    building = true;
+    strlcpy(build_path, path, sizeof(build_path));
+    if (build_task == NULL) {
+        build_task = xTaskCreateStaticPinnedToCore(seek_index_build_task, "SeekIndex", sizeof(build_stack), NULL, TASK_SEEK_INDEX_PRIO,
+                build_stack, &build_tcb, TASK_SEEK_INDEX_CORE);
+    }
+    xTaskNotifyGive(build_task);
+}
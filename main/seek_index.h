@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "media_probe.h"
+
+#define SEEK_INDEX_INTERVAL_MS 1000 // one frame offset per second of audio
+
+/*
+ * Maps playback time to frame aligned byte offsets of an MP3. The index is built once per file in the
+ * background and cached next to it on the SD card (/sdcard/<no>.mp3 -> /sdcard/<no>.idx). Until it exists,
+ * offsets are estimated from the bitrate of the first frame and aligned to the next frame header. From the
+ * entry before the requested time the frame headers are walked, so seeks land on the frame that contains it,
+ * in VBR files too. The entries are loaded into RAM once (4 bytes per second of audio), so position to time
+ * lookups never touch the card, they interpolate between two entries. seek_index_close() frees them.
+ */
+typedef struct {
+    char path[MEDIA_PATH_MAX];
+    char idx_path[MEDIA_PATH_MAX];
+    int64_t total_bytes;
+    uint32_t data_start; // first frame after the ID3v2 tag
+    uint32_t bitrate; // kbit/s of the first frame
+    uint32_t sample_rate; // of the first frame, entry times are counted in its frames
+    uint32_t frame_samples;
+    uint32_t entries; // 0 until the index is built
+    uint32_t *offsets; // of the entries, in RAM
+} seek_index_t;
+
+esp_err_t seek_index_open(seek_index_t *index, const char *path); // index is overwritten, close an open one first
+bool seek_index_refresh(seek_index_t *index); // picks up an index built after seek_index_open(), true if ready
+void seek_index_close(seek_index_t *index); // also after a failed open, and again
+int64_t seek_index_offset(seek_index_t *index, int64_t ms);
+int64_t seek_index_time(seek_index_t *index, int64_t offset);
+int64_t seek_index_duration(seek_index_t *index);
+
+esp_err_t seek_index_build(const char *path);
+void seek_index_build_async(const char *path); // low priority task, one build at a time
@@ -0,0 +1,72 @@
+#include <math.h>
+
+#include "seek_scrub.h"
+
+// hold time at which the speed reaches SEEK_SCRUB_MAX_SPEED
+static double seek_scrub_ramp_s() {
+    return SEEK_SCRUB_DOUBLING_MS / 1000.0 * log2((double) SEEK_SCRUB_MAX_SPEED / SEEK_SCRUB_START_SPEED);
+}
+
+int seek_scrub_speed(int64_t held_us) {
+    double t = held_us / 1000000.0;
+    if (t >= seek_scrub_ramp_s()) {
+        return SEEK_SCRUB_MAX_SPEED;
+    }
+    return (int) (SEEK_SCRUB_START_SPEED * exp2(t * 1000.0 / SEEK_SCRUB_DOUBLING_MS));
+}
+
+int64_t seek_scrub_distance_ms(int64_t held_us) {
+    if (held_us <= 0) {
+        return 0;
+    }
+    // integral of START * 2^(t / DOUBLING) during the ramp, MAX per second after it
+    double t = held_us / 1000000.0;
+    double doubling = SEEK_SCRUB_DOUBLING_MS / 1000.0;
+    double ramp = seek_scrub_ramp_s();
+    double k = SEEK_SCRUB_START_SPEED * doubling / M_LN2;
+    double s;
+    if (t <= ramp) {
+        s = k * (exp2(t / doubling) - 1);
+    } else {
+        s = k * ((double) SEEK_SCRUB_MAX_SPEED / SEEK_SCRUB_START_SPEED - 1) + SEEK_SCRUB_MAX_SPEED * (t - ramp);
+    }
+    return (int64_t) (s * 1000.0 + 0.5);
+}
+
+void seek_scrub_start(seek_scrub_t *scrub, int direction, int64_t position_ms, int64_t duration_ms, int64_t now_us) {
+    scrub->direction = direction;
+    scrub->pressed_us = now_us;
+    scrub->stepped_us = now_us;
+    scrub->start_ms = position_ms;
+    scrub->target_ms = position_ms;
+    scrub->duration_ms = duration_ms;
+}
+
+void seek_scrub_stop(seek_scrub_t *scrub) {
+    scrub->direction = 0;
+}
+
+bool seek_scrub_active(const seek_scrub_t *scrub) {
+    return scrub->direction != 0;
+}
+
+int64_t seek_scrub_due_ms(const seek_scrub_t *scrub, int64_t now_us) {
+    return SEEK_SCRUB_STEP_MS - (now_us - scrub->stepped_us) / 1000;
+}
+
+bool seek_scrub_step(seek_scrub_t *scrub, int64_t now_us) {
+    int64_t target = scrub->start_ms + scrub->direction * seek_scrub_distance_ms(now_us - scrub->pressed_us);
+    int64_t last = scrub->duration_ms - SEEK_SCRUB_END_MARGIN_MS;
+    if (scrub->direction > 0 && target > last) { // never backwards when pressed within the margin
+        target = last > scrub->start_ms ? last : scrub->start_ms;
+    }
+    if (target < 0) {
+        target = 0;
+    }
+    scrub->stepped_us = now_us;
+    if (target == scrub->target_ms) {
+        return false;
+    }
+    scrub->target_ms = target;
+    return true;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SEEK_SCRUB_STEP_MS 600 // a snippet of this length is heard at every position
+#define SEEK_SCRUB_START_SPEED 10 // seconds of audio per second held, right after the long press
+#define SEEK_SCRUB_MAX_SPEED 120
+#define SEEK_SCRUB_DOUBLING_MS 3000 // the speed doubles every 3 s held, up to the maximum
+#define SEEK_SCRUB_END_MARGIN_MS 5000 // fast-forward stops a few seconds before the end instead of at it
+
+/*
+ * Hold-to-seek: while a button is held the target moves by the integral of an accelerating speed over the
+ * hold time (esp_timer microseconds), so it does not depend on when the steps are taken. Every
+ * SEEK_SCRUB_STEP_MS the player jumps to the target and plays on from there until the next step, the
+ * release jumps to the target of the release time. Times are passed in, the module has no ESP-IDF dependencies.
+ */
+typedef struct {
+    int direction; // 1 fast-forward, -1 rewind, 0 idle
+    int64_t pressed_us;
+    int64_t stepped_us; // last step, or the press
+    int64_t start_ms;
+    int64_t target_ms;
+    int64_t duration_ms;
+} seek_scrub_t;
+
+void seek_scrub_start(seek_scrub_t *scrub, int direction, int64_t position_ms, int64_t duration_ms, int64_t now_us);
+void seek_scrub_stop(seek_scrub_t *scrub);
+bool seek_scrub_active(const seek_scrub_t *scrub);
+int64_t seek_scrub_due_ms(const seek_scrub_t *scrub, int64_t now_us); // until the next step, <= 0 if due
+bool seek_scrub_step(seek_scrub_t *scrub, int64_t now_us); // updates target_ms, false if it did not move
+int64_t seek_scrub_distance_ms(int64_t held_us); // audio covered after holding that long
+int seek_scrub_speed(int64_t held_us); // seconds of audio per second held
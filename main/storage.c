@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "ff.h"
+#include "diskio.h"
+#include "periph_sdcard.h"
+#include "fatfs_stream.h"
+#include "board.h"
+
+#include "storage.h"
+
+static const char *TAG = "STORAGE";
+
+static const uint32_t read_sizes[] = { 4096, 8192, 16384 };
+#define STORAGE_READ_SIZES ((int) (sizeof(read_sizes) / sizeof(read_sizes[0])))
+#define STORAGE_NVS_NAMESPACE "storage"
+#define STORAGE_NVS_KEY "tuning"
+
+// the card a tuning was measured on, a new card, a reformat or the other bus width probe again
+typedef struct {
+    uint32_t serial; // volume serial number of the boot sector
+    uint32_t clusters;
+    uint32_t cluster_size;
+    uint32_t mode;
+    storage_tuning_t tuning;
+} storage_cache_t;
+
+static periph_sdcard_mode_t mounted_mode = SD_MODE_1_LINE;
+
+static esp_err_t storage_mount_mode(esp_periph_set_handle_t set, periph_sdcard_mode_t mode) {
+    periph_sdcard_cfg_t cfg = {
+        .root = "/sdcard",
+        .card_detect_pin = get_sdcard_intr_gpio(),
+        .mode = mode,
+    };
+    esp_periph_handle_t sdcard = periph_sdcard_init(&cfg);
+    if (sdcard == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t ret = esp_periph_start(set, sdcard);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    for (int waited = 0; !periph_sdcard_is_mounted(sdcard); waited += 100) {
+        if (waited >= STORAGE_MOUNT_TIMEOUT_MS) {
+            esp_periph_stop(sdcard);
+            esp_periph_remove_from_set(set, sdcard);
+            return ESP_ERR_TIMEOUT;
+        }
+        vTaskDelay(100 / portTICK_RATE_MS);
+    }
+    return ESP_OK;
+}
+
+esp_err_t storage_mount(esp_periph_set_handle_t set) {
+    int64_t start = esp_timer_get_time();
+    esp_err_t ret = storage_mount_mode(set, SD_MODE_4_LINE);
+    if (ret == ESP_OK) {
+        mounted_mode = SD_MODE_4_LINE;
+        ESP_LOGI(TAG, "Mounted in 4-line mode in %" PRId64 " ms", (esp_timer_get_time() - start) / 1000);
+        return ESP_OK;
+    }
+    ESP_LOGW(TAG, "4-line mode failed (%d), falling back to 1-line", ret);
+    ret = storage_mount_mode(set, SD_MODE_1_LINE);
+    if (ret == ESP_OK) {
+        mounted_mode = SD_MODE_1_LINE;
+        ESP_LOGI(TAG, "Mounted in 1-line mode in %" PRId64 " ms", (esp_timer_get_time() - start) / 1000);
+    } else {
+        ESP_LOGE(TAG, "Mount failed: %d", ret);
+    }
+    return ret;
+}
+
+/* Volume serial number from the boot sector, 0 if it can not be read */
+static uint32_t storage_volume_serial(FATFS *fs) {
+    uint8_t *sector = malloc(FF_MAX_SS);
+    uint32_t serial = 0;
+    if (sector != NULL && disk_read(fs->pdrv, sector, fs->volbase, 1) == RES_OK) {
+        int at = fs->fs_type == FS_FAT32 ? 67 : 39; // BS_VolID32, BS_VolID
+#if FF_FS_EXFAT
+        at = fs->fs_type == FS_EXFAT ? 100 : at; // VolumeSerialNumber
+#endif
+        serial = sector[at] | (sector[at + 1] << 8) | (sector[at + 2] << 16) | ((uint32_t) sector[at + 3] << 24);
+    }
+    free(sector);
+    return serial;
+}
+
+static bool storage_card(storage_cache_t *card) {
+    FATFS *fs;
+    DWORD free_clusters;
+    if (f_getfree("0:", &free_clusters, &fs) != FR_OK) { // cheap with a valid FSINFO sector
+        return false;
+    }
+    memset(card, 0, sizeof(*card));
+#if FF_MAX_SS != FF_MIN_SS
+    card->cluster_size = fs->csize * fs->ssize;
+#else
+    card->cluster_size = fs->csize * FF_MAX_SS;
+#endif
+    card->clusters = fs->n_fatent - 2;
+    card->serial = storage_volume_serial(fs);
+    card->mode = mounted_mode;
+    return true;
+}
+
+static bool storage_cache_load(const storage_cache_t *card, storage_tuning_t *tuning) {
+    nvs_handle_t nvs;
+    if (nvs_open(STORAGE_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return false;
+    }
+    storage_cache_t cache;
+    size_t size = sizeof(cache);
+    bool found = nvs_get_blob(nvs, STORAGE_NVS_KEY, &cache, &size) == ESP_OK && size == sizeof(cache)
+        && cache.serial == card->serial && cache.clusters == card->clusters
+        && cache.cluster_size == card->cluster_size && cache.mode == card->mode;
+    nvs_close(nvs);
+    if (found) {
+        *tuning = cache.tuning;
+    }
+    return found;
+}
+
+static void storage_cache_save(storage_cache_t *card, const storage_tuning_t *tuning) {
+    nvs_handle_t nvs;
+    if (nvs_open(STORAGE_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        return;
+    }
+    card->tuning = *tuning;
+    if (nvs_set_blob(nvs, STORAGE_NVS_KEY, card, sizeof(*card)) != ESP_OK || nvs_commit(nvs) != ESP_OK) {
+        ESP_LOGW(TAG, "Tuning not saved");
+    }
+    nvs_close(nvs);
+}
+
+/* First regular file in /sdcard of at least min_size bytes */
+static bool storage_probe_file(char *path, size_t n, uint32_t min_size) {
+    DIR *dir = opendir("/sdcard");
+    if (dir == NULL) {
+        return false;
+    }
+    bool found = false;
+    struct dirent *entry;
+    while (!found && (entry = readdir(dir)) != NULL) {
+        struct stat st;
+        snprintf(path, n, "/sdcard/%s", entry->d_name);
+        found = entry->d_type == DT_REG && stat(path, &st) == 0 && st.st_size >= min_size;
+    }
+    closedir(dir);
+    return found;
+}
+
+void storage_defaults(storage_tuning_t *tuning) {
+    memset(tuning, 0, sizeof(*tuning));
+    tuning->read_size = FATFS_STREAM_BUF_SIZE;
+    tuning->read_ahead = FATFS_STREAM_RINGBUFFER_SIZE;
+}
+
+/* Measures the read sizes on the first large file, false if there is none */
+static bool storage_measure(storage_tuning_t *tuning) {
+    uint32_t largest = read_sizes[STORAGE_READ_SIZES - 1];
+    uint32_t needed = 0;
+    for (int i = 0; i < STORAGE_READ_SIZES; i++) {
+        needed += read_sizes[i] * STORAGE_PROBE_READS;
+    }
+    char path[300];
+    if (!storage_probe_file(path, sizeof(path), needed)) {
+        ESP_LOGW(TAG, "No file to probe, keeping defaults");
+        return false;
+    }
+    uint8_t *buf = malloc(largest);
+    FILE *file = fopen(path, "r");
+    if (buf == NULL || file == NULL) {
+        free(buf);
+        if (file != NULL) {
+            fclose(file);
+        }
+        return false;
+    }
+    setvbuf(file, NULL, _IONBF, 0); // measure FatFS, not the stdio buffer
+
+    uint32_t best_kb_per_s = 0;
+    for (int i = 0; i < STORAGE_READ_SIZES; i++) { // reads continue where the previous size stopped, no cache hits
+        uint32_t size = read_sizes[i];
+        uint32_t max_us = 0;
+        int64_t start = esp_timer_get_time();
+        for (int j = 0; j < STORAGE_PROBE_READS; j++) {
+            int64_t read_start = esp_timer_get_time();
+            fread(buf, 1, size, file);
+            uint32_t us = esp_timer_get_time() - read_start;
+            if (us > max_us) {
+                max_us = us;
+            }
+        }
+        uint32_t total_us = esp_timer_get_time() - start;
+        uint32_t kb_per_s = (uint64_t) size * STORAGE_PROBE_READS * 1000000 / 1024 / (total_us > 0 ? total_us : 1);
+        ESP_LOGI(TAG, "Probe %5" PRIu32 " byte reads: %" PRIu32 " KB/s, %" PRIu32 " us avg, %" PRIu32 " us max",
+                size, kb_per_s, total_us / STORAGE_PROBE_READS, max_us);
+
+        // a larger read has to gain at least 10% to be worth the RAM
+        if (kb_per_s * 10 > best_kb_per_s * 11) {
+            best_kb_per_s = kb_per_s;
+            tuning->read_size = size;
+            tuning->kb_per_s = kb_per_s;
+            tuning->read_us_avg = total_us / STORAGE_PROBE_READS;
+            tuning->read_us_max = max_us;
+        }
+    }
+    fclose(file);
+    free(buf);
+
+    // whole clusters per read where the cluster fits, so reads do not straddle cluster boundaries needlessly
+    if (tuning->cluster_size > tuning->read_size && tuning->cluster_size <= largest) {
+        tuning->read_size = tuning->cluster_size;
+    }
+    // bridge the slowest read twice at the highest bitrate, on top of one read in flight
+    uint32_t bridge = (uint64_t) STORAGE_MAX_BITRATE_KBPS * 1000 / 8 * tuning->read_us_max * 2 / 1000000;
+    uint32_t read_ahead = tuning->read_size * 2 + bridge;
+    read_ahead = (read_ahead + tuning->read_size - 1) / tuning->read_size * tuning->read_size;
+    if (read_ahead < STORAGE_READ_AHEAD_MIN) {
+        read_ahead = STORAGE_READ_AHEAD_MIN;
+    } else if (read_ahead > STORAGE_READ_AHEAD_MAX) {
+        read_ahead = STORAGE_READ_AHEAD_MAX;
+    }
+    tuning->read_ahead = read_ahead;
+    return true;
+}
+
+void storage_probe(storage_tuning_t *tuning) {
+    storage_defaults(tuning);
+    storage_cache_t card;
+    if (!storage_card(&card)) {
+        ESP_LOGW(TAG, "No file system, keeping defaults");
+        return;
+    }
+    tuning->cluster_size = card.cluster_size;
+    if (storage_cache_load(&card, tuning)) {
+        ESP_LOGI(TAG, "Tuning of card %08" PRIx32 " from NVS", card.serial);
+    } else if (storage_measure(tuning)) {
+        storage_cache_save(&card, tuning);
+    } else {
+        return;
+    }
+    ESP_LOGI(TAG, "Cluster %" PRIu32 " bytes, reading %" PRIu32 " bytes with %" PRIu32 " bytes read-ahead (%" PRIu32 " KB/s)",
+            tuning->cluster_size, tuning->read_size, tuning->read_ahead, tuning->kb_per_s);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_peripherals.h"
+
+#define STORAGE_MOUNT_TIMEOUT_MS 3000 // per bus width
+#define STORAGE_PROBE_READS 16 // per read size
+#define STORAGE_MAX_BITRATE_KBPS 320 // read-ahead has to bridge the slowest read at this rate
+#define STORAGE_READ_AHEAD_MIN (8 * 1024)
+#define STORAGE_READ_AHEAD_MAX (32 * 1024) // no SPIRAM
+
+typedef struct {
+    uint32_t cluster_size;
+    uint32_t read_size; // fatfs_stream buf_sz, a multiple of the cluster size where possible
+    uint32_t read_ahead; // fatfs_stream out_rb_size
+    uint32_t kb_per_s; // at read_size
+    uint32_t read_us_avg;
+    uint32_t read_us_max;
+} storage_tuning_t;
+
+/*
+ * Mounts the SD card on /sdcard in 4-line mode and falls back to 1-line if that does not come up. Then reads
+ * from the first large file with increasing read sizes and derives the fatfs_stream buffer sizes from the
+ * measured throughput and latency. Without a suitable file the ADF defaults are kept. The tuning is stored in
+ * NVS for the card (volume serial number, cluster count and size, bus width) and only measured again when
+ * another card is inserted or the card was reformatted.
+ */
+esp_err_t storage_mount(esp_periph_set_handle_t set);
+void storage_probe(storage_tuning_t *tuning); // card mounted
+void storage_defaults(storage_tuning_t *tuning); // ADF defaults, without a card
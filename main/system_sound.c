@@ -0,0 +1,152 @@
+#include <string.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "driver/i2s.h"
+
+#include "system_sound.h"
+#include "power.h"
+#include "tasks.h"
+
+static const char *TAG = "CUE";
+
+#define SYSTEM_SOUND_MAGIC 0x31534248 // "HBS1"
+#define SYSTEM_SOUND_SUBTYPE 0x40 // see partitions.csv
+#define SYSTEM_SOUND_CHUNK 1024 // bytes per i2s_write, bounds the latency of system_sound_stop()
+
+typedef struct __attribute__((packed)) {
+    char name[16];
+    uint32_t offset;
+    uint32_t length;
+    uint32_t sample_rate;
+    uint16_t channels;
+    uint16_t bits;
+} system_sound_entry_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint32_t count;
+    system_sound_entry_t entries[];
+} system_sound_header_t;
+
+static const uint8_t *image = NULL; // memory mapped partition
+static const system_sound_header_t *header = NULL;
+static uint32_t image_size = 0;
+static i2s_port_t port = I2S_NUM_0;
+static QueueHandle_t queue = NULL;
+static SemaphoreHandle_t idle = NULL; // taken while a cue owns I2S
+static volatile bool abort_cue = false;
+static volatile int32_t volume = 1 << 14;
+static int16_t scaled[SYSTEM_SOUND_CHUNK / sizeof(int16_t)];
+static StackType_t cue_stack[TASK_CUE_STACK];
+static StaticTask_t cue_tcb;
+
+static void system_sound_task(void *arg) {
+    const system_sound_entry_t *entry;
+    while (xQueueReceive(queue, &entry, portMAX_DELAY) == pdTRUE) {
+        ESP_LOGI(TAG, "Play %s: %" PRIu32 " bytes", entry->name, entry->length);
+        power_awake_begin();
+        i2s_set_clk(port, entry->sample_rate, entry->bits, entry->channels);
+        const uint8_t *pcm = image + entry->offset;
+        uint32_t written = 0;
+        while (written < entry->length && !abort_cue) {
+            size_t chunk = entry->length - written > SYSTEM_SOUND_CHUNK ? SYSTEM_SOUND_CHUNK : entry->length - written;
+            const void *src = pcm + written;
+            if (entry->bits == 16) {
+                memcpy(scaled, src, chunk);
+                int32_t factor = volume;
+                for (int i = 0; i < chunk / sizeof(int16_t); i++) {
+                    scaled[i] = (scaled[i] * factor) >> 14;
+                }
+                src = scaled;
+            }
+            size_t n = 0;
+            if (i2s_write(port, src, chunk, &n, portMAX_DELAY) != ESP_OK) {
+                break;
+            }
+            written += n;
+        }
+        i2s_zero_dma_buffer(port);
+        power_awake_end();
+        xSemaphoreGive(idle);
+    }
+    vTaskDelete(NULL);
+}
+
+esp_err_t system_sound_init(int i2s_port) {
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, SYSTEM_SOUND_SUBTYPE, "sounds");
+    if (partition == NULL) {
+        ESP_LOGW(TAG, "No sounds partition");
+        return ESP_ERR_NOT_FOUND;
+    }
+    spi_flash_mmap_handle_t handle;
+    const void *ptr;
+    esp_err_t ret = esp_partition_mmap(partition, 0, partition->size, SPI_FLASH_MMAP_DATA, &ptr, &handle);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Can not map sounds partition (%d)", ret);
+        return ret;
+    }
+    const system_sound_header_t *h = ptr;
+    if (h->magic != SYSTEM_SOUND_MAGIC || sizeof(*h) + h->count * sizeof(system_sound_entry_t) > partition->size) {
+        ESP_LOGW(TAG, "Sounds partition is empty, flash it with make flash-sounds");
+        spi_flash_munmap(handle);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    queue = xQueueCreate(1, sizeof(system_sound_entry_t *));
+    idle = xSemaphoreCreateBinary();
+    if (queue == NULL || idle == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    xSemaphoreGive(idle);
+    image = ptr;
+    image_size = partition->size;
+    header = h;
+    port = i2s_port;
+    xTaskCreateStaticPinnedToCore(system_sound_task, "Cue", sizeof(cue_stack), NULL, TASK_CUE_PRIO, cue_stack, &cue_tcb, TASK_CUE_CORE);
+    ESP_LOGI(TAG, "%" PRIu32 " cues in flash", header->count);
+    return ESP_OK;
+}
+
+esp_err_t system_sound_play(const char *name, bool wait) {
+    if (header == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    const system_sound_entry_t *entry = NULL;
+    for (uint32_t i = 0; i < header->count && entry == NULL; i++) {
+        if (strncmp(header->entries[i].name, name, sizeof(header->entries[i].name)) == 0) {
+            entry = &header->entries[i];
+        }
+    }
+    if (entry == NULL || entry->offset + entry->length > image_size) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    abort_cue = true; // one cue at a time, the task gives idle back when this one is done
+    xSemaphoreTake(idle, portMAX_DELAY);
+    abort_cue = false;
+    xQueueSend(queue, &entry, portMAX_DELAY);
+    if (wait) {
+        xSemaphoreTake(idle, portMAX_DELAY);
+        xSemaphoreGive(idle);
+    }
+    return ESP_OK;
+}
+
+void system_sound_set_volume(int32_t factor) {
+    volume = factor;
+}
+
+void system_sound_stop() {
+    if (header == NULL) {
+        return;
+    }
+    abort_cue = true;
+    xSemaphoreTake(idle, portMAX_DELAY);
+    xSemaphoreGive(idle);
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+/*
+ * Short cues (beep, not_found) stored as raw PCM in the "sounds" flash partition (see tools/mksounds.py)
+ * and written straight to I2S, without SD card or MP3 decoder. The playback pipeline must be stopped while
+ * a cue plays, system_sound_stop() frees I2S again.
+ */
+esp_err_t system_sound_init(int i2s_port); // ESP_ERR_NOT_FOUND if the partition was not flashed
+esp_err_t system_sound_play(const char *name, bool wait); // ESP_ERR_NOT_FOUND: fall back to /sdcard/system_<name>.mp3
+void system_sound_stop();
+void system_sound_set_volume(int32_t factor); // Q14 for 16 bit cues, takes effect with the next chunk
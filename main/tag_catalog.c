@@ -0,0 +1,333 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "ff.h"
+
+#include "tag_catalog.h"
+#include "media_probe.h"
+
+static const char *TAG = "CATALOG";
+
+#define TAG_CATALOG_MAGIC 0x31434248 // "HBC1"
+#define TAG_CATALOG_MIN_CAPACITY 64
+
+#define TAG_CATALOG_USED 0x01
+#define TAG_CATALOG_FOUND 0x02 // something to play exists, otherwise negative entry
+#define TAG_CATALOG_MISS_PENDING 0x04 // "_miss" marker not written yet
+#define TAG_CATALOG_M3U 0x08 // with FOUND: /sdcard/<no>.m3u
+#define TAG_CATALOG_DIRECTORY 0x10 // with FOUND: /sdcard/<no>/
+#define TAG_CATALOG_EXTENSION_SHIFT 5 // upper 3 bits: index into MEDIA_EXTENSIONS of /sdcard/<no>.<ext>
+#define TAG_CATALOG_EXTENSION(flags) ((flags) >> TAG_CATALOG_EXTENSION_SHIFT)
+
+typedef struct __attribute__((packed)) {
+    uint8_t uid[5];
+    uint8_t flags;
+    uint32_t size;
+    uint16_t duration_s;
+} tag_catalog_entry_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t count;
+    uint32_t fingerprint; // FNV-1a over names, sizes and times of the media files and the tag directory names
+} tag_catalog_header_t;
+
+static tag_catalog_entry_t *entries = NULL;
+static uint32_t capacity = 0; // power of two
+static uint32_t count = 0;
+static uint32_t fingerprint = 2166136261u;
+static bool ready = false;
+static const char *extensions[MEDIA_EXTENSION_COUNT] = MEDIA_EXTENSIONS;
+static bool dirty = false;
+static SemaphoreHandle_t lock = NULL;
+
+static bool tag_catalog_parse(const char *no, uint8_t *uid) {
+    if (strlen(no) < 10) {
+        return false;
+    }
+    for (int i = 0; i < 5; i++) {
+        unsigned int b;
+        if (sscanf(&no[i * 2], "%2x", &b) != 1) {
+            return false;
+        }
+        uid[i] = b;
+    }
+    return true;
+}
+
+static uint32_t tag_catalog_hash(const uint8_t *uid) {
+    uint64_t key = 0;
+    memcpy(&key, uid, 5);
+    return (uint32_t) ((key * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+/* Slot holding uid, or the empty slot where it belongs */
+static tag_catalog_entry_t *tag_catalog_slot(tag_catalog_entry_t *table, uint32_t cap, const uint8_t *uid) {
+    uint32_t i = tag_catalog_hash(uid) & (cap - 1);
+    while ((table[i].flags & TAG_CATALOG_USED) && memcmp(table[i].uid, uid, 5) != 0) {
+        i = (i + 1) & (cap - 1);
+    }
+    return &table[i];
+}
+
+static tag_catalog_entry_t *tag_catalog_insert(const uint8_t *uid) {
+    if ((count + 1) * 4 > capacity * 3) { // keep the load below 3/4
+        uint32_t cap = capacity == 0 ? TAG_CATALOG_MIN_CAPACITY : capacity * 2;
+        tag_catalog_entry_t *table = calloc(cap, sizeof(tag_catalog_entry_t));
+        if (table == NULL) {
+            return NULL;
+        }
+        for (uint32_t i = 0; i < capacity; i++) {
+            if (entries[i].flags & TAG_CATALOG_USED) {
+                *tag_catalog_slot(table, cap, entries[i].uid) = entries[i];
+            }
+        }
+        free(entries);
+        entries = table;
+        capacity = cap;
+    }
+    tag_catalog_entry_t *entry = tag_catalog_slot(entries, capacity, uid);
+    if (!(entry->flags & TAG_CATALOG_USED)) {
+        memset(entry, 0, sizeof(*entry));
+        memcpy(entry->uid, uid, 5);
+        entry->flags = TAG_CATALOG_USED;
+        count++;
+    }
+    return entry;
+}
+
+static void tag_catalog_fingerprint(const void *data, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        fingerprint = (fingerprint ^ ((const uint8_t *) data)[i]) * 16777619u;
+    }
+}
+
+static tag_catalog_entry_t *tag_catalog_add(const char *name, bool tag, uint8_t flags) {
+    tag_catalog_fingerprint(name, strlen(name));
+
+    uint8_t uid[5];
+    if (!tag || !tag_catalog_parse(name, uid)) {
+        return NULL;
+    }
+    tag_catalog_entry_t *entry = tag_catalog_insert(uid);
+    if (entry != NULL) {
+        if (TAG_CATALOG_EXTENSION(entry->flags) != 0) { // several files for one tag, the first one that is not MP3 wins
+            flags &= ~(0x07 << TAG_CATALOG_EXTENSION_SHIFT);
+        }
+        entry->flags |= TAG_CATALOG_FOUND | flags;
+    }
+    return entry;
+}
+
+static void tag_catalog_add_file(const FILINFO *info) {
+    // <no>.<ext> or <no>.m3u, system_*.mp3 only counts for the fingerprint
+    const char *ext = strrchr(info->fname, '.');
+    int media = -1;
+    for (int i = 0; ext != NULL && i < MEDIA_EXTENSION_COUNT; i++) {
+        if (strcasecmp(ext + 1, extensions[i]) == 0) {
+            media = i;
+        }
+    }
+    bool m3u = ext != NULL && strcasecmp(ext, ".m3u") == 0;
+    if (media < 0 && !m3u) { // catalog.bin, .idx, _miss markers
+        return;
+    }
+    bool tag = ext - info->fname == 10;
+    tag_catalog_entry_t *entry = tag_catalog_add(info->fname, tag, m3u ? TAG_CATALOG_M3U : media << TAG_CATALOG_EXTENSION_SHIFT);
+    // a file replaced under the same name has another size or time
+    uint32_t stamp[3] = {info->fsize, info->fdate, info->ftime};
+    tag_catalog_fingerprint(stamp, sizeof(stamp));
+    if (entry != NULL && !m3u && TAG_CATALOG_EXTENSION(entry->flags) == media) {
+        entry->size = info->fsize;
+    }
+}
+
+/* The root directory entries in one pass, FatFS has size and time of each file in them, no stat per file */
+static void tag_catalog_scan() {
+    static FF_DIR dir; // sound_task, once at boot
+    static FILINFO info;
+    if (f_opendir(&dir, "0:/") != FR_OK) {
+        ESP_LOGW(TAG, "Can not read the card");
+        return;
+    }
+    while (f_readdir(&dir, &info) == FR_OK && info.fname[0] != 0) {
+        if (!(info.fattrib & AM_DIR)) {
+            tag_catalog_add_file(&info);
+        } else if (strlen(info.fname) == 10) { // <no>
+            tag_catalog_add(info.fname, true, TAG_CATALOG_DIRECTORY);
+        }
+    }
+    f_closedir(&dir);
+}
+
+static bool tag_catalog_load() {
+    FILE *file = fopen(TAG_CATALOG_FILE, "r");
+    if (file == NULL) {
+        return false;
+    }
+    tag_catalog_header_t header;
+    bool loaded = false;
+    if (fread(&header, sizeof(header), 1, file) == 1 && header.magic == TAG_CATALOG_MAGIC && header.fingerprint == fingerprint) {
+        loaded = true;
+        for (uint32_t i = 0; i < header.count && loaded; i++) {
+            tag_catalog_entry_t stored;
+            loaded = fread(&stored, sizeof(stored), 1, file) == 1;
+            if (loaded) {
+                tag_catalog_entry_t *entry = tag_catalog_insert(stored.uid);
+                loaded = entry != NULL;
+                if (loaded) {
+                    *entry = stored;
+                }
+            }
+        }
+    }
+    fclose(file);
+    return loaded;
+}
+
+static void tag_catalog_save() {
+    FILE *file = fopen(TAG_CATALOG_FILE, "w");
+    if (file == NULL) {
+        ESP_LOGW(TAG, "Can not write %s", TAG_CATALOG_FILE);
+        return;
+    }
+    tag_catalog_header_t header = {
+        .magic = TAG_CATALOG_MAGIC,
+        .count = count,
+        .fingerprint = fingerprint,
+    };
+    fwrite(&header, sizeof(header), 1, file);
+    for (uint32_t i = 0; i < capacity; i++) {
+        if (entries[i].flags & TAG_CATALOG_USED) {
+            fwrite(&entries[i], sizeof(entries[i]), 1, file);
+        }
+    }
+    fclose(file);
+    dirty = false;
+}
+
+esp_err_t tag_catalog_init() {
+    int64_t start = esp_timer_get_time();
+    if (lock == NULL) {
+        lock = xSemaphoreCreateMutex();
+    }
+    if (lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    free(entries); // again after the card changed
+    entries = NULL;
+    capacity = 0;
+    count = 0;
+    fingerprint = 2166136261u;
+    ready = false;
+
+    tag_catalog_scan();
+    uint32_t scanned = count;
+
+    if (tag_catalog_load()) {
+        ESP_LOGI(TAG, "Loaded %" PRIu32 " tags in %" PRId64 " ms", count, (esp_timer_get_time() - start) / 1000);
+    } else { // files changed, negative entries and durations from the old catalog are dropped with it
+        tag_catalog_save();
+        ESP_LOGI(TAG, "Rebuilt catalog with %" PRIu32 " tags in %" PRId64 " ms", scanned, (esp_timer_get_time() - start) / 1000);
+    }
+
+    ready = true;
+    return ESP_OK;
+}
+
+static tag_kind_t tag_catalog_kind(uint8_t flags) {
+    if (!(flags & TAG_CATALOG_FOUND)) {
+        return TAG_KIND_NONE;
+    } else if (flags & TAG_CATALOG_DIRECTORY) {
+        return TAG_KIND_DIRECTORY;
+    } else if (flags & TAG_CATALOG_M3U) {
+        return TAG_KIND_PLAYLIST;
+    }
+    return TAG_KIND_FILE;
+}
+
+tag_kind_t tag_catalog_lookup(const char *no, uint32_t *size, const char **extension) {
+    uint8_t uid[5];
+    *extension = extensions[0];
+    if (!ready || !tag_catalog_parse(no, uid)) { // fall back to the card
+        struct stat st;
+        char path[28];
+        *size = 0;
+        snprintf(path, sizeof(path), "/sdcard/%s", no);
+        if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+            return TAG_KIND_DIRECTORY;
+        }
+        snprintf(path, sizeof(path), "/sdcard/%s.m3u", no);
+        if (stat(path, &st) == 0) {
+            return TAG_KIND_PLAYLIST;
+        }
+        for (int i = 0; i < MEDIA_EXTENSION_COUNT; i++) {
+            snprintf(path, sizeof(path), "/sdcard/%s.%s", no, extensions[i]);
+            if (stat(path, &st) == 0) {
+                *size = st.st_size;
+                *extension = extensions[i];
+                return TAG_KIND_FILE;
+            }
+        }
+        return TAG_KIND_NONE;
+    }
+
+    tag_kind_t kind = TAG_KIND_NONE;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    tag_catalog_entry_t *entry = capacity > 0 ? tag_catalog_slot(entries, capacity, uid) : NULL;
+    if (entry != NULL && (entry->flags & TAG_CATALOG_USED)) {
+        kind = tag_catalog_kind(entry->flags);
+        *size = entry->size;
+        *extension = extensions[TAG_CATALOG_EXTENSION(entry->flags)];
+    } else {
+        entry = tag_catalog_insert(uid);
+        if (entry != NULL) {
+            entry->flags |= TAG_CATALOG_MISS_PENDING;
+            dirty = true;
+        }
+    }
+    xSemaphoreGive(lock);
+    return kind;
+}
+
+void tag_catalog_set_duration(const char *no, uint32_t duration_s) {
+    uint8_t uid[5];
+    if (!ready || capacity == 0 || !tag_catalog_parse(no, uid)) {
+        return;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    tag_catalog_entry_t *entry = tag_catalog_slot(entries, capacity, uid);
+    if ((entry->flags & TAG_CATALOG_USED) && entry->duration_s != duration_s) {
+        entry->duration_s = duration_s > UINT16_MAX ? UINT16_MAX : duration_s;
+        dirty = true;
+    }
+    xSemaphoreGive(lock);
+}
+
+void tag_catalog_flush() {
+    if (!ready || !dirty) {
+        return;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    char path[28];
+    for (uint32_t i = 0; i < capacity; i++) {
+        if (entries[i].flags & TAG_CATALOG_MISS_PENDING) {
+            uint8_t *uid = entries[i].uid;
+            sprintf(path, "/sdcard/%02x%02x%02x%02x%02x.mp3_miss", uid[0], uid[1], uid[2], uid[3], uid[4]);
+            FILE *file = fopen(path, "w");
+            if (file != NULL) {
+                fclose(file);
+            }
+            entries[i].flags &= ~TAG_CATALOG_MISS_PENDING;
+        }
+    }
+    tag_catalog_save();
+    xSemaphoreGive(lock);
+}
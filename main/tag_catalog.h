@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define TAG_CATALOG_FILE "/sdcard/catalog.bin"
+
+typedef enum {
+    TAG_KIND_NONE = 0,
+    TAG_KIND_FILE, // /sdcard/<no>.<ext>, any of MEDIA_EXTENSIONS
+    TAG_KIND_PLAYLIST, // /sdcard/<no>.m3u
+    TAG_KIND_DIRECTORY, // /sdcard/<no>/*.<ext>
+} tag_kind_t;
+
+/*
+ * RAM hash table of the tags that have a /sdcard/<no>.<ext> (mp3, aac, m4a, opus, ogg, flac), .m3u or directory,
+ * built from one pass over the root directory entries at boot. Sizes and durations are persisted to TAG_CATALOG_FILE
+ * and only re-read from the card when a file name, size or modification time changes. Unknown tags get a negative entry, their "_miss" marker is written later by
+ * tag_catalog_flush() instead of on the tag-to-play path.
+ */
+esp_err_t tag_catalog_init(); // SD card must be mounted
+tag_kind_t tag_catalog_lookup(const char *no, uint32_t *size, const char **extension); // TAG_KIND_NONE if there is nothing to play
+void tag_catalog_set_duration(const char *no, uint32_t duration_s);
+void tag_catalog_flush(); // pending "_miss" markers and changed durations
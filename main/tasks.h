@@ -0,0 +1,61 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "fatfs_stream.h"
+#include "mp3_decoder.h"
+#include "aac_decoder.h"
+#include "opus_decoder.h"
+#include "flac_decoder.h"
+#include "i2s_stream.h"
+#include "filter_resample.h"
+
+/*
+ * Core, priority and stack (bytes) of every task, ADF element tasks included. Decoding and I2S get the
+ * APP core to themselves, SD card reads, RFID and control share the PRO core with the remaining system tasks.
+ * Check the result with the CPU and I2S input figures of the monitor (MONITOR tag) while swapping tags and seeking.
+ */
+#define TASK_CORE_IO 0
+#define TASK_CORE_AUDIO 1
+
+// ADF elements, priorities and stacks are the ADF defaults
+#define TASK_FATFS_CORE TASK_CORE_IO
+#define TASK_FATFS_PRIO FATFS_STREAM_TASK_PRIO
+#define TASK_FATFS_STACK FATFS_STREAM_TASK_STACK
+#define TASK_DECODER_CORE TASK_CORE_AUDIO // the one linked decoder of mp3, aac, opus and flac
+#define TASK_DECODER_PRIO MP3_DECODER_TASK_PRIO
+#define TASK_MP3_STACK MP3_DECODER_TASK_STACK_SIZE
+#define TASK_AAC_STACK AAC_DECODER_TASK_STACK_SIZE
+#define TASK_OPUS_STACK OPUS_DECODER_TASK_STACK_SIZE
+#define TASK_FLAC_STACK FLAC_DECODER_TASK_STACK_SIZE
+#define TASK_I2S_CORE TASK_CORE_AUDIO
+#define TASK_I2S_PRIO I2S_STREAM_TASK_PRIO
+#define TASK_I2S_STACK I2S_STREAM_TASK_STACK
+#define TASK_GAIN_CORE TASK_CORE_AUDIO
+#define TASK_GAIN_PRIO MP3_DECODER_TASK_PRIO
+#define TASK_GAIN_STACK (3 * 1024)
+#define TASK_RESAMPLE_CORE TASK_CORE_AUDIO
+#define TASK_RESAMPLE_PRIO RSP_FILTER_TASK_PRIO
+#define TASK_RESAMPLE_STACK RSP_FILTER_TASK_STACK
+
+// our tasks
+#define TASK_SOUND_CORE TASK_CORE_IO // control: events, buttons, positions
+#define TASK_SOUND_PRIO (configMAX_PRIORITIES - 1)
+#define TASK_SOUND_STACK 5120 // two seek_index_t and three paths deep in player_play()
+#define TASK_RFID_CORE TASK_CORE_IO
+#define TASK_RFID_PRIO (configMAX_PRIORITIES - 3)
+#define TASK_RFID_STACK 4096
+#define TASK_CUE_CORE TASK_CORE_AUDIO // writes to I2S
+#define TASK_CUE_PRIO (configMAX_PRIORITIES - 2)
+#define TASK_CUE_STACK 2048
+#define TASK_BEEP_CORE TASK_CORE_AUDIO
+#define TASK_BEEP_PRIO (configMAX_PRIORITIES - 2)
+#define TASK_BEEP_STACK 4096
+#define TASK_SEEK_INDEX_CORE TASK_CORE_IO
+#define TASK_SEEK_INDEX_PRIO (tskIDLE_PRIORITY + 1)
+#define TASK_SEEK_INDEX_STACK 4096
+#define TASK_TRACE_CORE TASK_CORE_IO
+#define TASK_TRACE_PRIO (tskIDLE_PRIORITY + 1)
+#define TASK_TRACE_STACK 2048
+#define TASK_MONITOR_CORE TASK_CORE_IO
+#define TASK_MONITOR_PRIO (tskIDLE_PRIORITY + 1)
+#define TASK_MONITOR_STACK 2560
@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/uart.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+#include "trace.h"
+#include "tasks.h"
+
+#if TRACE_ENABLED
+
+static const char *TAG = "TRACE";
+
+#define TRACE_UART_RX_BUFFER 256 // more than the hardware FIFO, as the driver requires
+
+typedef struct {
+    uint32_t time; // us, wraps after 71 minutes
+    uint16_t point;
+    uint16_t arg;
+} trace_entry_t;
+
+static const char *names[TRACE_MAX] = {
+    [TRACE_RFID_POLL] = "rfid_poll",
+    [TRACE_TAG_CHANGED] = "tag_changed",
+    [TRACE_PIPELINE_STOP] = "pipeline_stop",
+    [TRACE_LOOKUP] = "lookup",
+    [TRACE_PIPELINE_STOPPED] = "pipeline_stopped",
+    [TRACE_PIPELINE_RUN] = "pipeline_run",
+    [TRACE_MUSIC_INFO] = "music_info",
+    [TRACE_SET_CLK] = "set_clk",
+    [TRACE_I2S_WRITE] = "i2s_write",
+};
+
+static trace_entry_t entries[TRACE_SIZE];
+static StackType_t trace_stack[TASK_TRACE_STACK];
+static StaticTask_t trace_tcb;
+static uint32_t head = 0; // total number of tracepoints, entries[head % TRACE_SIZE] is written next
+
+void trace(trace_point_t point, uint16_t arg) {
+    uint32_t i = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED) & (TRACE_SIZE - 1);
+    entries[i].time = (uint32_t) esp_timer_get_time();
+    entries[i].point = point;
+    entries[i].arg = arg;
+}
+
+void trace_dump() {
+    uint32_t end = __atomic_load_n(&head, __ATOMIC_RELAXED);
+    uint32_t start = end > TRACE_SIZE ? end - TRACE_SIZE : 0;
+    printf("trace,begin,%" PRIu32 "\n", end - start);
+    for (uint32_t n = start; n < end; n++) {
+        trace_entry_t entry = entries[n & (TRACE_SIZE - 1)];
+        if (entry.point < TRACE_MAX) {
+            printf("trace,%" PRIu32 ",%" PRIu32 ",%s,%u\n", n, entry.time, names[entry.point], entry.arg);
+        }
+    }
+    printf("trace,end\n");
+}
+
+static void trace_task(void *arg) {
+    while (1) {
+        uint8_t c;
+        // blocks until the RX interrupt delivers a byte, the task does not run otherwise
+        if (uart_read_bytes(CONFIG_ESP_CONSOLE_UART_NUM, &c, 1, portMAX_DELAY) == 1 && c == 'd') {
+            trace_dump();
+        }
+    }
+}
+
+void trace_init() {
+    // console output keeps writing to the FIFO directly, the driver only takes over reception
+    esp_err_t ret = uart_driver_install(CONFIG_ESP_CONSOLE_UART_NUM, TRACE_UART_RX_BUFFER, 0, 0, NULL, 0);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "No console UART driver, trace dump not available: %d", ret);
+        return;
+    }
+    xTaskCreateStaticPinnedToCore(trace_task, "Trace", sizeof(trace_stack), NULL, TASK_TRACE_PRIO, trace_stack, &trace_tcb, TASK_TRACE_CORE);
+}
+
+#endif
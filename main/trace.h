@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+
+#define TRACE_ENABLED 1 // 0 compiles all tracepoints out
+#define TRACE_SIZE 256 // entries, power of two
+
+/*
+ * Timestamped tracepoints along the tag-to-audio path, recorded into a RAM ring buffer without locks
+ * (one atomic increment and an esp_timer read per point). Send "d" over the console UART to dump the buffer
+ * as CSV, the dump task sleeps on the UART RX interrupt until then. tools/trace_report.py turns a captured log
+ * into a per-stage latency breakdown.
+ */
+typedef enum {
+    TRACE_RFID_POLL, // arg: poll interval ms
+    TRACE_TAG_CHANGED, // arg: I2C transactions of the read
+    TRACE_PIPELINE_STOP,
+    TRACE_LOOKUP, // arg: 1 if a position is resumed
+    TRACE_PIPELINE_STOPPED,
+    TRACE_PIPELINE_RUN,
+    TRACE_MUSIC_INFO,
+    TRACE_SET_CLK, // arg: sample rate / 100
+    TRACE_I2S_WRITE, // first bytes written to I2S
+    TRACE_MAX,
+} trace_point_t;
+
+#if TRACE_ENABLED
+void trace(trace_point_t point, uint16_t arg);
+void trace_init(); // starts the dump task
+void trace_dump();
+#else
+#define trace(point, arg)
+#define trace_init()
+#define trace_dump()
+#endif
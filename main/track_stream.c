@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+
+#include "track_stream.h"
+
+static const char *TAG = "TRACK_STREAM";
+
+typedef struct {
+    FILE *file;
+    FILE *next_file; // opened ahead, first prefetch_len bytes already read into prefetch
+    char current[TRACK_STREAM_PATH_MAX]; // path of file, the URI is replaced (and freed) on a switch
+    char next_path[TRACK_STREAM_PATH_MAX];
+    char next_opened[TRACK_STREAM_PATH_MAX]; // path of next_file, next_path may have changed since
+    int64_t next_size;
+    char *prefetch;
+    int prefetch_len;
+    int buf_sz;
+    uint64_t read_bytes; // since init
+    portMUX_TYPE lock; // next_path set from other tasks, current read by them
+} track_stream_t;
+
+static void track_stream_drop_next(track_stream_t *stream) {
+    if (stream->next_file != NULL) {
+        fclose(stream->next_file);
+        stream->next_file = NULL;
+    }
+    stream->prefetch_len = 0;
+}
+
+static void track_stream_prefetch(track_stream_t *stream) {
+    char path[TRACK_STREAM_PATH_MAX];
+    portENTER_CRITICAL(&stream->lock);
+    strlcpy(path, stream->next_path, sizeof(path));
+    portEXIT_CRITICAL(&stream->lock);
+    if (path[0] == 0) {
+        return;
+    }
+    struct stat st;
+    stream->next_file = stat(path, &st) == 0 ? fopen(path, "r") : NULL;
+    if (stream->next_file == NULL) {
+        ESP_LOGW(TAG, "Can not open next track %s", path);
+        portENTER_CRITICAL(&stream->lock);
+        stream->next_path[0] = 0;
+        portEXIT_CRITICAL(&stream->lock);
+        return;
+    }
+    strlcpy(stream->next_opened, path, sizeof(stream->next_opened));
+    stream->next_size = st.st_size;
+    stream->prefetch_len = fread(stream->prefetch, 1, stream->buf_sz, stream->next_file);
+    ESP_LOGI(TAG, "Prefetched %d bytes of %s", stream->prefetch_len, path);
+}
+
+static esp_err_t _track_open(audio_element_handle_t self) {
+    track_stream_t *stream = (track_stream_t *) audio_element_getdata(self);
+    const char *uri = audio_element_get_uri(self);
+    if (uri == NULL) {
+        return ESP_FAIL;
+    }
+    stream->file = fopen(uri, "r");
+    if (stream->file == NULL) {
+        ESP_LOGE(TAG, "Can not open %s", uri);
+        return ESP_FAIL;
+    }
+    portENTER_CRITICAL(&stream->lock);
+    strlcpy(stream->current, uri, sizeof(stream->current));
+    portEXIT_CRITICAL(&stream->lock);
+    struct stat st;
+    audio_element_info_t info;
+    audio_element_getinfo(self, &info);
+    if (stat(uri, &st) == 0) {
+        info.total_bytes = st.st_size;
+    }
+    if (info.byte_pos > 0 && fseek(stream->file, info.byte_pos, SEEK_SET) != 0) {
+        ESP_LOGW(TAG, "Can not seek %s to %" PRId64, uri, info.byte_pos);
+        info.byte_pos = 0;
+    }
+    audio_element_setinfo(self, &info);
+    return ESP_OK;
+}
+
+/* Switches to the prefetched next track, copies its first bytes into buffer */
+static int track_stream_switch(audio_element_handle_t self, track_stream_t *stream, char *buffer, int len) {
+    char path[TRACK_STREAM_PATH_MAX];
+    portENTER_CRITICAL(&stream->lock);
+    strlcpy(path, stream->next_path, sizeof(path));
+    portEXIT_CRITICAL(&stream->lock);
+    if (stream->next_file != NULL && strcmp(path, stream->next_opened) != 0) { // changed after prefetching
+        track_stream_drop_next(stream);
+    }
+    if (stream->next_file == NULL) {
+        track_stream_prefetch(stream); // not opened ahead, e.g. queued late or track shorter than the prefetch distance
+    }
+    if (stream->next_file == NULL) {
+        return 0; // finished
+    }
+    fclose(stream->file);
+    stream->file = stream->next_file;
+    stream->next_file = NULL;
+    strlcpy(path, stream->next_opened, sizeof(path));
+    portENTER_CRITICAL(&stream->lock);
+    if (strcmp(stream->next_path, path) == 0) {
+        stream->next_path[0] = 0;
+    }
+    strlcpy(stream->current, path, sizeof(stream->current));
+    portEXIT_CRITICAL(&stream->lock);
+    audio_element_set_uri(self, path);
+
+    int n = stream->prefetch_len < len ? stream->prefetch_len : len;
+    memcpy(buffer, stream->prefetch, n);
+    stream->read_bytes += stream->prefetch_len;
+    if (n < stream->prefetch_len) { // smaller read than the prefetch, continue behind what was handed out
+        fseek(stream->file, n, SEEK_SET);
+    }
+    stream->prefetch_len = 0;
+
+    audio_element_info_t info;
+    audio_element_getinfo(self, &info);
+    info.byte_pos = n;
+    info.total_bytes = stream->next_size;
+    audio_element_setinfo(self, &info);
+    audio_element_report_info(self);
+    ESP_LOGI(TAG, "Continue with %s", path);
+    return n;
+}
+
+static int _track_read(audio_element_handle_t self, char *buffer, int len, TickType_t ticks_to_wait, void *context) {
+    track_stream_t *stream = (track_stream_t *) audio_element_getdata(self);
+    int n = fread(buffer, 1, len, stream->file);
+    if (n <= 0) {
+        return track_stream_switch(self, stream, buffer, len);
+    }
+    audio_element_update_byte_pos(self, n);
+    stream->read_bytes += n;
+
+    if (stream->next_file == NULL && stream->next_path[0] != 0) {
+        audio_element_info_t info;
+        audio_element_getinfo(self, &info);
+        if (info.total_bytes - info.byte_pos < TRACK_STREAM_PREFETCH_BYTES) {
+            track_stream_prefetch(stream);
+        }
+    }
+    return n;
+}
+
+static int _track_process(audio_element_handle_t self, char *in_buffer, int in_len) {
+    int r_size = audio_element_input(self, in_buffer, in_len);
+    if (r_size <= 0) {
+        return r_size;
+    }
+    return audio_element_output(self, in_buffer, r_size);
+}
+
+static esp_err_t _track_close(audio_element_handle_t self) {
+    track_stream_t *stream = (track_stream_t *) audio_element_getdata(self);
+    if (stream->file != NULL) {
+        fclose(stream->file);
+        stream->file = NULL;
+    }
+    track_stream_drop_next(stream); // next_path stays queued, it is opened again when needed
+    if (audio_element_get_state(self) != AEL_STATE_PAUSED) { // a pause keeps the position for seeking
+        audio_element_info_t info;
+        audio_element_getinfo(self, &info);
+        info.byte_pos = 0;
+        audio_element_setinfo(self, &info);
+    }
+    return ESP_OK;
+}
+
+static esp_err_t _track_destroy(audio_element_handle_t self) {
+    track_stream_t *stream = (track_stream_t *) audio_element_getdata(self);
+    free(stream->prefetch);
+    free(stream);
+    return ESP_OK;
+}
+
+audio_element_handle_t track_stream_init(track_stream_cfg_t *config) {
+    track_stream_t *stream = calloc(1, sizeof(track_stream_t));
+    if (stream == NULL) {
+        return NULL;
+    }
+    stream->buf_sz = config->buf_sz;
+    stream->prefetch = malloc(config->buf_sz);
+    stream->lock = (portMUX_TYPE) portMUX_INITIALIZER_UNLOCKED;
+    if (stream->prefetch == NULL) {
+        free(stream);
+        return NULL;
+    }
+
+    audio_element_cfg_t cfg = DEFAULT_AUDIO_ELEMENT_CONFIG();
+    cfg.open = _track_open;
+    cfg.close = _track_close;
+    cfg.process = _track_process;
+    cfg.destroy = _track_destroy;
+    cfg.read = _track_read;
+    cfg.buffer_len = config->buf_sz;
+    cfg.out_rb_size = config->out_rb_size;
+    cfg.task_stack = config->task_stack;
+    cfg.task_core = config->task_core;
+    cfg.task_prio = config->task_prio;
+    cfg.tag = "track";
+    audio_element_handle_t el = audio_element_init(&cfg);
+    if (el == NULL) {
+        free(stream->prefetch);
+        free(stream);
+        return NULL;
+    }
+    audio_element_setdata(el, stream);
+    return el;
+}
+
+void track_stream_set_next(audio_element_handle_t self, const char *path) {
+    track_stream_t *stream = (track_stream_t *) audio_element_getdata(self);
+    portENTER_CRITICAL(&stream->lock);
+    strlcpy(stream->next_path, path != NULL ? path : "", sizeof(stream->next_path));
+    portEXIT_CRITICAL(&stream->lock);
+}
+
+void track_stream_current(audio_element_handle_t self, char *path) {
+    track_stream_t *stream = (track_stream_t *) audio_element_getdata(self);
+    portENTER_CRITICAL(&stream->lock);
+    strlcpy(path, stream->current, TRACK_STREAM_PATH_MAX);
+    portEXIT_CRITICAL(&stream->lock);
+}
+
+uint64_t track_stream_read_bytes(audio_element_handle_t self) {
+    track_stream_t *stream = (track_stream_t *) audio_element_getdata(self);
+    return stream->read_bytes;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "audio_element.h"
+#include "fatfs_stream.h"
+#include "media_probe.h"
+
+#define TRACK_STREAM_PATH_MAX MEDIA_PATH_MAX
+#define TRACK_STREAM_PREFETCH_BYTES (64 * 1024) // next track is opened this far before the end of the current one
+
+/*
+ * File reader like fatfs_stream, but it continues with a queued next track at the end of the current one
+ * instead of finishing, so the decoder sees one continuous stream and the pipeline keeps running. The next
+ * file is opened and its first buffer read ahead before the current track ends. On every switch the URI and
+ * info (byte_pos, total_bytes) change to the new track and AEL_MSG_CMD_REPORT_MUSIC_INFO is sent from this element.
+ * The URI is replaced from the element task then, other tasks ask track_stream_current() for the track instead.
+ */
+typedef struct {
+    int buf_sz;
+    int out_rb_size;
+    int task_stack;
+    int task_core;
+    int task_prio;
+} track_stream_cfg_t;
+
+#define TRACK_STREAM_CFG_DEFAULT() {                \
+    .buf_sz = FATFS_STREAM_BUF_SIZE,                \
+    .out_rb_size = FATFS_STREAM_RINGBUFFER_SIZE,    \
+    .task_stack = FATFS_STREAM_TASK_STACK,          \
+    .task_core = FATFS_STREAM_TASK_CORE,            \
+    .task_prio = FATFS_STREAM_TASK_PRIO,            \
+}
+
+audio_element_handle_t track_stream_init(track_stream_cfg_t *config);
+void track_stream_set_next(audio_element_handle_t self, const char *path); // NULL: finish at the end of the current track
+void track_stream_current(audio_element_handle_t self, char *path); // path has TRACK_STREAM_PATH_MAX bytes, "" before the first open
+uint64_t track_stream_read_bytes(audio_element_handle_t self); // since init, prefetches included
@@ -0,0 +1,69 @@
+#!/usr/bin/env python
+#
+# Decodes the system MP3s to raw PCM and packs them into the image for the "sounds" partition.
+#
+#   python tools/mksounds.py sounds.bin system_beep.mp3 system_not_found.mp3
+#
+# Cue names are the file names without "system_" and extension (beep, not_found). Requires ffmpeg.
+# Layout (little endian): "HBS1", count, count * (name[16], offset, length, sample_rate, channels:u16, bits:u16), PCM
+from __future__ import print_function
+
+import os
+import struct
+import subprocess
+import sys
+
+MAGIC = b'HBS1'
+PARTITION_SIZE = 0xF0000  # see partitions.csv
+SAMPLE_RATE = 22050
+CHANNELS = 2
+BITS = 16
+
+
+def decode(path):
+    return subprocess.check_output(['ffmpeg', '-loglevel', 'error', '-i', path,
+                                    '-f', 's16le', '-acodec', 'pcm_s16le',
+                                    '-ac', str(CHANNELS), '-ar', str(SAMPLE_RATE), '-'])
+
+
+def name_of(path):
+    name = os.path.splitext(os.path.basename(path))[0]
+    if name.startswith('system_'):
+        name = name[len('system_'):]
+    return name.encode('ascii')
+
+
+def main():
+    if len(sys.argv) < 3:
+        print('usage: mksounds.py <image> <mp3>...', file=sys.stderr)
+        return 1
+
+    image, mp3s = sys.argv[1], sys.argv[2:]
+    cues = [(name_of(path), decode(path)) for path in mp3s]
+
+    # entries are 32 bytes and PCM frames 4 bytes, so every cue stays 4 byte aligned
+    offset = 8 + 32 * len(cues)
+    header = MAGIC + struct.pack('<I', len(cues))
+    data = b''
+    for name, pcm in cues:
+        if len(name) > 15:
+            print('cue name too long: %s' % name, file=sys.stderr)
+            return 1
+        header += struct.pack('<16sIIIHH', name, offset, len(pcm), SAMPLE_RATE, CHANNELS, BITS)
+        data += pcm
+        offset += len(pcm)
+    blob = header + data
+    if len(blob) > PARTITION_SIZE:
+        print('%d bytes do not fit into the sounds partition (%d)' % (len(blob), PARTITION_SIZE), file=sys.stderr)
+        return 1
+
+    with open(image, 'wb') as f:
+        f.write(blob)
+    for name, pcm in cues:
+        print('%-15s %6.2f s' % (name.decode('ascii'), float(len(pcm)) / (SAMPLE_RATE * CHANNELS * BITS // 8)))
+    print('%s: %d of %d bytes' % (image, len(blob), PARTITION_SIZE))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,97 @@
+#!/usr/bin/env python
+#
+# Per-stage latency breakdown of the tag-to-audio path from a trace dump (send "d" on the console).
+#
+#   make monitor | tee hoerbox.log
+#   python tools/trace_report.py hoerbox.log
+#
+# Every tag_changed starts a swap, each stage is measured from the stage before it.
+from __future__ import print_function
+
+import fileinput
+
+STAGES = ['tag_changed', 'pipeline_stop', 'lookup', 'pipeline_stopped', 'pipeline_run',
+          'music_info', 'set_clk', 'i2s_write']
+WRAP = 1 << 32
+
+
+def parse(lines):
+    points = {}  # sequence number -> (time, name, arg), dumps overlap
+    for line in lines:
+        fields = line.strip().split(',')
+        if len(fields) == 5 and fields[0] == 'trace' and fields[1].isdigit():
+            points[int(fields[1])] = (int(fields[2]), fields[3], int(fields[4]))
+    return [points[n] for n in sorted(points)]
+
+
+def swaps(points):
+    swap = None
+    last = None
+    for time, name, arg in points:
+        if name == 'rfid_poll':
+            last = (time, arg)
+        elif name == 'tag_changed':
+            if swap:
+                yield swap
+            swap = {'tag_changed': time}
+            if last:
+                swap['rfid_read'] = (time - last[0]) % WRAP
+                swap['poll_interval'] = last[1] * 1000
+        elif swap is not None and name in STAGES and name not in swap:
+            swap[name] = time
+    if swap:
+        yield swap
+
+
+def percentile(values, p):
+    return values[min(len(values) - 1, int(len(values) * p / 100.0))]
+
+
+def histogram(values):
+    buckets = {}
+    for v in values:
+        ms = v / 1000.0
+        bucket = 1
+        while bucket < ms:
+            bucket *= 2
+        buckets[bucket] = buckets.get(bucket, 0) + 1
+    top = max(buckets.values())
+    for bucket in sorted(buckets):
+        print('    <= %5d ms %4d %s' % (bucket, buckets[bucket], '#' * (40 * buckets[bucket] // top)))
+
+
+def main():
+    stages = {}
+    totals = []
+    for swap in swaps(parse(fileinput.input())):
+        for key in ('poll_interval', 'rfid_read'):
+            if key in swap:
+                stages.setdefault(key, []).append(swap[key])
+        previous = swap['tag_changed']
+        for stage in STAGES[1:]:
+            if stage in swap:
+                stages.setdefault(stage, []).append((swap[stage] - previous) % WRAP)
+                previous = swap[stage]
+        if 'i2s_write' in swap:
+            totals.append((swap['i2s_write'] - swap['tag_changed']) % WRAP)
+    if totals:
+        stages['total'] = totals
+    if not stages:
+        print('no swaps found')
+        return 1
+
+    print('%-17s %5s %8s %8s %8s %8s' % ('stage (ms)', 'n', 'mean', 'p50', 'p95', 'max'))
+    for stage in ['poll_interval', 'rfid_read'] + STAGES[1:] + ['total']:
+        values = sorted(stages.get(stage, []))
+        if values:
+            print('%-17s %5d %8.1f %8.1f %8.1f %8.1f' % (stage, len(values), sum(values) / 1000.0 / len(values),
+                  percentile(values, 50) / 1000.0, percentile(values, 95) / 1000.0, values[-1] / 1000.0))
+    for stage in ['rfid_read'] + STAGES[1:] + ['total']:
+        if stage in stages:
+            print('\n%s' % stage)
+            histogram(stages[stage])
+    return 0
+
+
+if __name__ == '__main__':
+    raise SystemExit(main())